@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace vkbase {
+
+	// GL_HALF_FLOAT, not a core glTF component type but accepted by the decoder
+	const int COMPONENT_TYPE_HALF_FLOAT = 0x140B;
+
+	// Instruction sets of the accessor decoding kernels, the best supported one is picked at runtime
+	enum class DecodeIsa : uint32_t {
+		Scalar = 0,
+		SSE41,
+		AVX2,
+		Count,
+	};
+
+	// A strided array of elements with 1 to 4 components, as described by a glTF accessor and its buffer view
+	struct AccessorSource {
+		const unsigned char* data;
+		size_t count;
+		// bytes between two elements (bufferView.byteStride, or the element size for tightly packed data)
+		size_t stride;
+		// TINYGLTF_COMPONENT_TYPE_* or COMPONENT_TYPE_HALF_FLOAT
+		int componentType;
+		uint32_t componentCount;
+		// integer components are mapped to [0, 1] (unsigned) or [-1, 1] (signed)
+		bool normalized;
+	};
+
+	DecodeIsa bestDecodeIsa();
+
+	const char* decodeIsaName(DecodeIsa isa);
+
+	// Converts the source elements to floats, writing componentCount floats per element every destinationStride bytes
+	// (so attributes can be decoded straight into an interleaved vertex), nothing else of the destination is touched
+	// Returns false for unsupported component types (and 32 bit integers)
+	bool decodeAccessor(const AccessorSource& source, float* destination, size_t destinationStride, DecodeIsa isa = bestDecodeIsa());
+
+#ifdef VKTINY_BENCHMARK
+	// Throughput of every kernel on every supported instruction set, checked against the scalar kernels
+	void benchmarkAccessorDecoding();
+#endif
+
+}
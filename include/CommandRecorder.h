@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ThreadPool.h"
+
+
+namespace vkbase {
+
+	// Records the commands of one subpass into secondary command buffers on several threads
+	// The items (e.g. sorted draws) are split into contiguous ranges, one secondary buffer per range, which the primary
+	// buffer executes in range order. Every range has its own command pool per frame in flight, as pools must not be used
+	// by two threads at once. Recording a frame resets its pools, so the GPU has to be done with the frame's last recording
+	class CommandRecorder {
+
+	public:
+		CommandRecorder(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t threadCount = ThreadPool::defaultThreadCount());
+
+		// Destroys the command pools, none of the buffers may still be in use
+		~CommandRecorder();
+
+		CommandRecorder(const CommandRecorder&) = delete;
+		CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+		typedef std::function<void(VkCommandBuffer commandBuffer, size_t first, size_t count)> RecordRange;
+
+		// Calls recordRange for every range of [0, itemCount) on the workers and the calling thread, between beginning the
+		// range's buffer for the inherited render pass and ending it. Returns the buffers in range order, throws if one fails
+		// or rethrows the first exception recordRange threw once every range finished
+		// At most maxThreads ranges of at least minItemsPerThread items are recorded
+		const std::vector<VkCommandBuffer>& record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance, size_t itemCount,
+			const RecordRange& recordRange, uint32_t maxThreads = UINT32_MAX);
+
+		// Buffers of the frame's last record, they can be executed again as long as what they recorded is still valid
+		const std::vector<VkCommandBuffer>& buffers(uint32_t frame) const {
+			return frames[frame].recorded;
+		}
+
+		// Time every range of the last record took, in range order
+		const std::vector<double>& rangeMs() const {
+			return lastRangeMs;
+		}
+
+		uint32_t threadCount() const {
+			return threads;
+		}
+
+		// Ranges are not split below this, small item counts are recorded by fewer threads
+		size_t minItemsPerThread = 256;
+
+	private:
+		struct Frame {
+			// One pool and buffer per range
+			std::vector<VkCommandPool> pools;
+			std::vector<VkCommandBuffer> commandBuffers;
+			std::vector<VkCommandBuffer> recorded;
+		};
+
+		VkDevice device;
+		uint32_t threads;
+		std::vector<Frame> frames;
+		std::vector<double> lastRangeMs;
+		// threads - 1 workers, the calling thread records a range as well; null when recording on one thread
+		std::unique_ptr<ThreadPool> workers;
+	};
+
+}
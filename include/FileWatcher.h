@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Reports modifications of a set of files without blocking
+	// Uses inotify on Linux and falls back to polling the modification times elsewhere
+	// Directories are watched rather than the files, so editors that save by replacing a file are noticed too
+	class FileWatcher {
+
+	public:
+		FileWatcher();
+
+		~FileWatcher();
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		// Replaces the watched files, returns false if none of their directories can be watched
+		bool watch(const std::vector<std::string>& files);
+
+		// Watched files that were written, created or replaced since the last call (each reported once)
+		std::vector<std::string> poll();
+
+		struct FileState {
+			uint64_t size = 0;
+			// nanoseconds where the platform provides them
+			int64_t modifiedTime = 0;
+		};
+
+		static bool fileState(const std::string& filename, FileState& state);
+
+	private:
+
+		// Watched files with their last seen state (used by the polling fallback)
+		std::unordered_map<std::string, FileState> files;
+
+#ifdef __linux__
+		int inotifyFd = -1;
+		// inotify watch descriptor -> watched directory
+		std::unordered_map<int, std::string> directories;
+#endif
+	};
+
+}
@@ -4,31 +4,58 @@
 #include "VulkanGlobals.h"
 
 #include "VulkanTexture.h"
+#include "ThreadPool.h"
+#include "SceneCache.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include "AccessorDecoder.h"
+#include "MeshoptDecoder.h"
+#include "FileWatcher.h"
+#include "SceneStreaming.h"
+#include "NodeHierarchy.h"
+#include "RenderQueue.h"
 
+#include <atomic>
+#include <memory>
+#include <thread>
 
 
 
 namespace vkbase {
 
+	// Level of detail limit per primitive, level 0 is the primitive's own index range
+	const uint32_t MAX_LOD_LEVELS = 8;
+
+	// Simplified index range of a primitive, uses the primitive's vertices and index pool
+	struct PrimitiveLod {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		// Geometric error in mesh space (distance the simplified surface may deviate from the original)
+		float error;
+	};
+
+	// Indices are relative to vertexOffset and live in the 16 or 32 bit index pool (indexType)
 	struct Primitive {
 		uint32_t firstIndex;
 		uint32_t indexCount;
 		int32_t materialIndex;
+		int32_t vertexOffset;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		// Range of the primitive's clusters in GLTFBase::clusters (empty if clusters are disabled or not a triangle list)
+		uint32_t firstCluster = 0;
+		uint32_t clusterCount = 0;
+		// Range of the primitive's simplified levels in GLTFBase::lods (level 1 and up, ordered from fine to coarse)
+		uint32_t firstLod = 0;
+		uint32_t lodCount = 0;
 	};
 
 	struct Mesh {
 		std::vector<Primitive> primitives;
-	};
-
-	// A node represents an object in the glTF scene graph
-	struct Node {
-		Node* parent;
-		std::vector<Node> children;
-		Mesh mesh;
-		glm::mat4 matrix;
-		std::string name;
-		bool visible = true;
-
+		// Dequantization of packed vertex positions (position = offset + scale * unorm), identity for full vertices
+		glm::vec3 positionOffset = glm::vec3(0.0f);
+		float positionScale = 1.0f;
+		// Mesh space bounding sphere (xyz center, w radius) of all primitives
+		glm::vec4 boundingSphere = glm::vec4(0.0f);
 	};
 
 	// A glTF material stores information in e.g. the texture that is attached to it and colors
@@ -39,8 +66,9 @@ namespace vkbase {
 		std::string alphaMode = "OPAQUE";
 		float alphaCutOff;
 		bool doubleSided = false;
-		VkDescriptorSet descriptorSet;
-		VkPipeline pipeline;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// Not owned, materials with the same state share a pipeline (see vkbase::PipelineRegistry)
+		VkPipeline pipeline = VK_NULL_HANDLE;
 	};
 
 	// In this sample, we are only interested in the image
@@ -48,6 +76,187 @@ namespace vkbase {
 		int32_t imageIndex;
 	};
 
+	// Options for loading a glTF model
+	// Everything that changes the loaded data has to be part of GLTFBase::settingsHash (scene cache key)
+	struct LoaderSettings {
+		// Number of threads used to decode vertex and index data
+		uint32_t threadCount = ThreadPool::defaultThreadCount();
+		// Load from (and write) a binary cache of the decoded scene next to the asset
+		bool sceneCache = true;
+		// Reorder triangles and vertices for the vertex cache, overdraw and vertex fetch (prints ACMR/ATVR per primitive)
+		bool optimizeMeshes = false;
+		// Layout of the vertex buffer, the pipeline's vertex input and vertex shader have to match it
+		VertexFormat vertexFormat = VertexFormat::Full;
+		// Generate tangents for primitives that have normals and texture coordinates but no TANGENT accessor
+		bool generateTangents = true;
+		// Split every triangle list primitive into clusters with bounding spheres and normal cones (GLTFBase::clusters)
+		bool buildClusters = true;
+		// Simplified levels generated per primitive (0 = off), every level targets half the triangles of the previous one
+		uint32_t lodCount = 0;
+		// Largest simplification error per level, relative to the primitive's extent
+		float lodTargetError = 0.05f;
+		// Keep CPU copies of the geometry and the source file versions for GLTFBase::reloadAsync
+		bool hotReload = false;
+		// Stream the geometry and images from the scene cache in spatial chunks around the camera (GLTFBase::pollStreaming)
+		// The cache is built by a regular load first, hotReload is ignored while streaming
+		bool streaming = false;
+		// Bytes of chunk geometry and images that may be resident at once
+		uint64_t streamingBudget = 256ull << 20;
+		// Edge length of the cubic chunk cells in the scene's root space, 0 splits the scene's largest extent into 8 cells
+		float streamingChunkSize = 0.0f;
+		// Bytes staged per streaming batch (at least one chunk per batch)
+		uint64_t streamingUploadLimit = 32ull << 20;
+		// Decode the scene with 1..N threads before the actual load and print the timings (VKTINY_BENCHMARK builds only)
+		// Slows the load down considerably, hot reloads never run it
+		bool benchmarkDecode = false;
+	};
+
+	// View used to pick a level of detail per instance from its projected error
+	struct LodView {
+		// Transform from the scene's root to world space (applied in the vertex shader)
+		glm::mat4 sceneMatrix = glm::mat4(1.0f);
+		glm::vec3 cameraPosition = glm::vec3(0.0f);
+		// Pixels per world unit at distance 1 (viewport height / (2 * tan(fovy / 2))), 0 always draws level 0
+		float projectionScale = 0.0f;
+		// Largest allowed screen space error in pixels
+		float errorThreshold = 1.0f;
+	};
+
+	// Destination ranges of a glTF primitive inside the model's vertex and index buffers
+	// Ranges are assigned in scene traversal order before decoding, so primitives can be decoded in parallel
+	struct PrimitiveDecodeInfo {
+		const tinygltf::Primitive* primitive;
+		uint32_t meshIndex;
+		uint32_t primitiveIndex;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		// Primitives with fewer than 65536 vertices go to the 16 bit index pool
+		VkIndexType indexType;
+	};
+
+	// Range of a mesh's model matrices in the instance buffer
+	// Instances are sorted by their level of detail, levelCounts[l] instances use level l
+	struct MeshInstances {
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		uint32_t levelCounts[MAX_LOD_LEVELS];
+		// View distances of the nearest and farthest instance (bounding sphere centers), the draw sort depths
+		float nearestDistance;
+		float farthestDistance;
+	};
+
+	// Draw of one primitive compiled from the scene, GLTFBase::bind only adds the frame's instance ranges
+	struct DrawPacket {
+		VkPipeline pipeline;
+		VkDescriptorSet descriptorSet;
+		VkBuffer vertexBuffer;
+		VkBuffer indexBuffer;
+		VkIndexType indexType;
+		int32_t vertexOffset;
+		// Set with the pipeline's dynamic cull mode if GLTFBase::dynamicCullMode
+		VkCullModeFlags cullMode;
+		// Transform slot, index into GLTFBase::meshInstances
+		uint32_t mesh;
+		// Sort key state, pipelineId numbers the distinct pipelines of the draw list
+		RenderPass pass;
+		uint32_t pipelineId;
+		uint32_t material;
+		// Index ranges of levels 0 to levelCount - 1 in GLTFBase::drawLevels, coarser levels use the last one
+		uint32_t firstLevel;
+		uint32_t levelCount;
+	};
+
+	// Vertex cache efficiency of a primitive before and after the mesh optimization stage
+	struct PrimitiveOptimizationStats {
+		bool optimized;
+		meshopt::VertexCacheStats before;
+		meshopt::VertexCacheStats after;
+	};
+
+	// Device local buffer waiting for its copy from a staging buffer (GLTFBase::recordUploads)
+	struct BufferUpload {
+		std::unique_ptr<Buffer> staging;
+		VkBuffer destination;
+		VkDeviceSize size;
+		// Ranges to copy, the whole buffer if empty
+		std::vector<VkBufferCopy> regions;
+	};
+
+	// Geometry buffer of a hot reload, replace is set if the size changed (buffer is null if the new data is empty)
+	struct BufferReload {
+		bool replace = false;
+		std::unique_ptr<Buffer> buffer;
+	};
+
+	// What a hot reload changed (GLTFBase::pollReload), the owner of the pipelines and descriptor sets applies it
+	struct ReloadChanges {
+		// Vertex and index bytes that were uploaded
+		VkDeviceSize geometryBytes = 0;
+		// Materials whose alpha mode, alpha cutoff or culling changed and need a new pipeline
+		std::vector<uint32_t> pipelineMaterials;
+		// Materials whose texture indices changed and need new descriptors
+		std::vector<uint32_t> textureMaterials;
+		// Replaced images, descriptors referencing them are stale
+		std::vector<uint32_t> images;
+		// The material count changed, every material needs a new pipeline and descriptor set
+		bool materialsResized = false;
+	};
+
+	enum class LoadState : uint32_t {
+		// parsing, decoding and staging on the loader thread
+		Loading = 0,
+		// everything is staged, waiting for the render thread to submit the uploads
+		Staged,
+		// uploads are submitted, waiting for their fence
+		Uploading,
+		// the model can be drawn
+		Resident,
+		Failed,
+		Cancelled,
+	};
+
+	// Handle of a background load (GLTFBase::loadAsync), shared by the loader thread and the render thread
+	struct ModelLoad {
+		std::atomic<LoadState> state{ LoadState::Loading };
+		// Fraction of the loader thread's work that is done (0 to 1)
+		std::atomic<float> progress{ 0.0f };
+		std::atomic<bool> cancelRequested{ false };
+
+		bool resident() const {
+			return state == LoadState::Resident;
+		}
+
+		bool finished() const {
+			LoadState current = state;
+			return current == LoadState::Resident || current == LoadState::Failed || current == LoadState::Cancelled;
+		}
+
+		// Stops the loader thread at its next checkpoint, has no effect once the uploads are submitted
+		void cancel() {
+			cancelRequested = true;
+		}
+	};
+
+	// Buffers of a streamed chunk, its meshes are copies of GLTFBase::meshes with the primitives rebased to these buffers
+	struct ChunkGeometry {
+		std::vector<Mesh> meshes;
+		// Levels of detail of the rebased primitives (Primitive::firstLod indexes this table)
+		std::vector<PrimitiveLod> lods;
+		// Byte ranges of the cache's vertex and index sections (srcOffset) and where they go in the chunk's buffers (dstOffset)
+		std::vector<VkBufferCopy> vertexRanges;
+		std::vector<VkBufferCopy> indexRanges;
+		std::vector<VkBufferCopy> indexRanges16;
+		VkDeviceSize vertexBytes = 0;
+		VkDeviceSize indexBytes = 0;
+		VkDeviceSize indexBytes16 = 0;
+		// Only set while the chunk is loading or resident
+		std::unique_ptr<Buffer> vertexBuffer;
+		std::unique_ptr<Buffer> indexBuffer;
+		std::unique_ptr<Buffer> indexBuffer16;
+	};
+
 	// Single index buffer for all primitives
 	struct Indices {
 		int count;
@@ -59,35 +268,315 @@ namespace vkbase {
 class GLTFBase {
 
 public:
-	GLTFBase(const std::string& filepath, VkQueue copyQueue) {};
-
-	virtual ~GLTFBase() {};
-
-	virtual void bind(VkCommandBuffer draw, VkPipelineLayout pipelineLayout);
+	GLTFBase(const std::string& filepath, VkQueue copyQueue, const vkbase::LoaderSettings& settings = {}) : settings(settings) {};
+
+	virtual ~GLTFBase();
+
+	// Records the draws of the frame in flight, whose instance buffer the GPU must be done with
+	virtual void bind(VkCommandBuffer draw, VkPipelineLayout pipelineLayout, uint32_t frame = 0) {
+		prepareBind(frame);
+		renderQueueStats = recordBind(draw, pipelineLayout, frame, 0, bindCount());
+	}
+
+	// First half of bind, writes the frame's instances and sorts the draws
+	// Returns a key of everything recordBind would record, a command buffer recorded with the same key can be reused
+	uint64_t prepareBind(uint32_t frame);
+
+	// Second half of bind, records the draws [first, first + count) in the order of the last prepareBind of this frame
+	// Every call starts with nothing bound, so disjoint ranges can be recorded into separate command buffers on several threads
+	vkbase::RenderQueueStats recordBind(VkCommandBuffer draw, VkPipelineLayout pipelineLayout, uint32_t frame, size_t first, size_t count) const;
+
+	// Number of draws sorted by the last prepareBind
+	size_t bindCount() const {
+		return renderQueue.size();
+	}
+
+	// Starts loading filepath on a background thread and returns right away
+	// Parsing, decoding and staging run on the loader thread, the GPU upload is driven by pollLoad
+	std::shared_ptr<vkbase::ModelLoad> loadAsync(const std::string& filepath);
+
+	// Submits the staged uploads once the loader thread is done and completes the load once their fence signals
+	// Never blocks, call it once per frame from the thread that owns copyQueue (models loaded synchronously are always resident)
+	// Nothing but the handle may be touched before it returns LoadState::Resident
+	vkbase::LoadState pollLoad(void);
+
+	// Files the model was loaded from (glTF file, external buffers and images), empty without settings.hotReload
+	const std::vector<std::string>& sourceFiles() const {
+		return sources;
+	}
+
+	// Parses the model's file again on a loader thread while the loaded model keeps drawing
+	// Needs settings.hotReload, returns null while a load or reload is running
+	std::shared_ptr<vkbase::ModelLoad> reloadAsync(void);
+
+	// Drives a reload like pollLoad: once the new parse is staged it uploads only the changed vertex and index ranges
+	// and images, swaps in the new scene and returns true with the changes for the caller's pipelines and descriptors
+	// Call it between submitting a frame and recording the next one, so no recorded frame references replaced objects
+	bool pollReload(vkbase::ReloadChanges& changes);
+
+	// Loads and evicts chunks of a streamed model (settings.streaming) around lodView's camera, one batch at a time
+	// Returns true with the images that were loaded or evicted, descriptors referencing them have to be written again
+	// (evicted images are replaced by a placeholder texture). Call it like pollReload, between submitting a frame and
+	// recording the next one, evicted chunks are only released once a later batch's upload has completed
+	bool pollStreaming(std::vector<uint32_t>& images);
+
+	// The material pipelines leave the cull mode dynamic (VK_EXT_extended_dynamic_state), bind sets it per material
+	bool dynamicCullMode = false;
+
+	// Compiles the draw list again before the next bind
+	// Loads, reloads and streaming do this themselves, callers only need it after replacing material pipelines or descriptor sets
+	void invalidateDrawList(void) {
+		drawListDirty = true;
+	}
+
+	// Packets of the scene, one per drawable primitive, compiled first if the scene changed since the last bind
+	const std::vector<vkbase::DrawPacket>& drawList() {
+		if (drawListDirty) {
+			compileDrawList();
+		}
+		return drawPackets;
+	}
+
+	// Draws and binds recorded by the last bind, callers of recordBind set the sum of their ranges
+	const vkbase::RenderQueueStats& renderStats() const {
+		return renderQueueStats;
+	}
+
+	void setRenderStats(const vkbase::RenderQueueStats& stats) {
+		renderQueueStats = stats;
+	}
+
+	// Residency of a streamed model, all zero without settings.streaming
+	const vkbase::StreamingStats& streamingStats() const {
+		return streamResidency.stats();
+	}
 
 	std::unique_ptr<vkbase::Buffer> vertexBuffer;
+	// 32 and 16 bit index pools, either one is null if no primitive uses it
 	std::unique_ptr<vkbase::Buffer> indexBuffer;
+	std::unique_ptr<vkbase::Buffer> indexBuffer16;
 
 	std::vector<vkbase::TextureIndices> textures;
 	std::vector<vkbase::Material> materials;
-	std::vector<vkbase::Node> nodes;
+	// Scene graph of the first glTF scene, world matrices are updated with the instances when the draws are recorded
+	vkbase::NodeHierarchy nodes;
+
+	// Cluster table of all primitives, firstIndex is an offset into the primitive's index pool
+	// Bounds are in mesh space (before the packed vertex dequantization)
+	std::vector<vkbase::meshopt::Meshlet> clusters;
+
+	// Simplified levels of all primitives, index ranges live in the primitive's index pool
+	std::vector<vkbase::PrimitiveLod> lods;
+
+	// Camera the levels of detail are selected for, read when the draw commands are recorded
+	vkbase::LodView lodView;
 
 	virtual VkDescriptorImageInfo getTextureDescriptor(const size_t index) = 0;
 
+	vkbase::VertexFormat vertexFormat() const {
+		return settings.vertexFormat;
+	}
+
 protected:
+	// Loads the scene from its cache if it is up to date, otherwise parses the glTF file (and updates the cache)
+	virtual int loadFromFile(const std::string& filepath);
+
+	// CPU side of loadFromFile, stages all buffers and images without touching a queue
+	virtual int prepareFromFile(const std::string& filepath);
+
+	// Parsing and decoding part of prepareFromFile, only fills the CPU side of the model
+	virtual int decodeFile(const std::string& filepath, tinygltf::Model& input);
+
+	// Remembers the files and image versions a hot reload is compared against
+	void recordSources(const std::vector<std::string>& files, const tinygltf::Model& input);
+
+	// Changes with the image's content, from its file's size and modification time or the hash of its buffer view
+	uint64_t imageVersion(const tinygltf::Model& input, const tinygltf::Image& image) const;
+
+	// Loader thread part of a reload, diffs reloadModel against the model and stages what changed
+	virtual int stageReload(tinygltf::Model& input);
+
+	void stageReloadBuffer(const void* previous, VkDeviceSize previousSize, const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+		vkbase::Buffer* current, vkbase::BufferReload& reload, vkbase::ReloadChanges& changes);
+
+	// Stages the pages of data that differ from previous (same size) for a copy into destination, returns the staged bytes
+	VkDeviceSize stageChangedRanges(const void* previous, const void* data, VkDeviceSize size, VkBuffer destination);
+
+	// Render thread part of a reload, swaps the new scene in once its uploads are recorded
+	void applyReload(vkbase::ReloadChanges& changes);
+
+	// Drops a staged or failed reload
+	void discardReload(void);
+
+	// Replacement for an image of a reload, null if it can't be loaded
+	virtual std::unique_ptr<vkbase::BaseTexture> stageReloadImage(tinygltf::Model& input, uint32_t index) {
+		return nullptr;
+	}
+
+	// Moves reloadedImages into the image table (resized to imageCount), the replaced images go to retiredImages
+	virtual void installReloadImages(size_t imageCount) {}
+
+	// Copies of the staged buffers and images, followed by a barrier for vertex and index reads
+	void recordUploads(VkCommandBuffer cmd);
+
+	// Releases the staging memory once the recorded uploads have completed
+	void finishUploads(void);
+
+	virtual void recordImageUploads(VkCommandBuffer cmd) {}
+
+	virtual void finishImageUploads(void) {}
+
+	// Cancels a background load and waits for the loader thread and a submitted upload, derived destructors call it first
+	void abortLoad(void);
+
+	// Checkpoints of the loader thread, no-ops for synchronous loads
+	bool loadCancelled(void) const;
+
+	void reportLoadProgress(float progress);
+
+	virtual bool loadFromCache(const std::string& filepath);
+
+	// Partitions the scene loaded from streamCache into chunks and lays out their buffers
+	virtual void setupStreaming(void);
+
+	// Copies a chunk's ranges out of the mapped cache into new staged buffers (streaming thread)
+	void stageChunk(vkbase::ChunkGeometry& chunk);
+
+	// Texture bound for streamed images that aren't resident
+	VkDescriptorImageInfo placeholderDescriptor(void) const;
+
+	// Binary glTF (GLB): the BIN chunk stays in a memory mapping and is never copied into tinygltf::Buffer::data
+	static bool isBinaryFile(const std::string& filepath);
+
+	virtual bool loadBinaryFile(const std::string& filepath, tinygltf::Model& model);
+
+	// tinygltf rejects buffers without a uri outside of GLB files, which EXT_meshopt_compression fallback buffers may be
+	virtual bool loadTextFile(const std::string& filepath, tinygltf::Model& model);
+
+	// Decodes all EXT_meshopt_compression buffer views in parallel into the (fallback) buffers they describe,
+	// accessors then read the decoded data like any other buffer view
+	virtual int decodeCompressedViews(tinygltf::Model& model, uint32_t threadCount);
+
+	// Start of a buffer's data, either the mapped GLB payload or tinygltf's copy
+	const unsigned char* bufferData(const tinygltf::Model& model, int buffer) const;
+	// Readable bytes at bufferData
+	size_t bufferSize(const tinygltf::Model& model, int buffer) const;
+
+	virtual void writeCache(const std::string& filepath, const tinygltf::Model& model);
+
+	virtual uint64_t settingsHash() const;
+
 	virtual int loadTextures(tinygltf::Model& model);
 
 	virtual int loadMaterials(tinygltf::Model& model);
 
 	virtual int loadImages(tinygltf::Model& model) = 0;
 
-	virtual int loadNode(const tinygltf::Node& inputnode, const tinygltf::Model& model, vkbase::Node* parent, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
+	virtual int loadScene(const tinygltf::Model& model);
+
+	// Appends the node and then its children to nodes (parent is -1 for scene roots)
+	virtual int loadNode(const tinygltf::Node& inputnode, const tinygltf::Model& model, int32_t parent);
+
+	virtual int decodePrimitives(const tinygltf::Model& model, uint32_t threadCount);
+
+	virtual int decodePrimitive(const tinygltf::Model& model, const vkbase::PrimitiveDecodeInfo& info, Vertex* vertexBuffer, uint32_t* indexBuffer);
+
+	// Tangents for a decoded primitive without a TANGENT accessor (see meshopt::generateTangents)
+	virtual void generatePrimitiveTangents(const vkbase::PrimitiveDecodeInfo& info, Vertex* vertexBuffer, const uint32_t* indexBuffer);
+
+	// Quantizes the decoded vertices into packedVertices, positions relative to the bounds of their mesh
+	virtual void packVertices(uint32_t threadCount);
+
+	// Vertex cache, overdraw and vertex fetch optimization of a decoded primitive (in place)
+	// Indices are relative to the primitive's first vertex
+	virtual void optimizePrimitive(const vkbase::PrimitiveDecodeInfo& info, Vertex* vertexBuffer, uint32_t* indexBuffer, vkbase::PrimitiveOptimizationStats& stats);
+
+	// Meshlets of a decoded primitive, indices relative to the primitive's first vertex and index
+	virtual std::vector<vkbase::meshopt::Meshlet> buildPrimitiveClusters(const vkbase::PrimitiveDecodeInfo& info, const Vertex* vertexBuffer, const uint32_t* indexBuffer);
 
-	virtual void drawNode(VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout, vkbase::Node node);
+	// Simplified levels of a decoded primitive, each level is simplified from the previous one
+	// Indices are appended to lodIndices, returned ranges are relative to its start
+	virtual std::vector<vkbase::PrimitiveLod> buildPrimitiveLods(const vkbase::PrimitiveDecodeInfo& info, const Vertex* vertexBuffer, const uint32_t* indexBuffer, std::vector<uint32_t>& lodIndices);
+
+	// Bounding spheres of all meshes from the decoded (full) vertices
+	void computeMeshBounds(void);
+
+	// Coarsest level whose projected error stays below lodView.errorThreshold, levelErrors[l] is the mesh's error at level l
+	uint32_t selectLod(const vkbase::Mesh& mesh, const std::vector<float>& levelErrors, const glm::mat4& transform) const;
+
+	// Index range of a primitive at a level, primitives with fewer levels use their coarsest one
+	vkbase::PrimitiveLod primitiveLod(const vkbase::Primitive& primitive, uint32_t level) const;
+
+	// Same for primitives whose levels live in lodTable (streamed chunks)
+	vkbase::PrimitiveLod primitiveLod(const vkbase::Primitive& primitive, uint32_t level, const std::vector<vkbase::PrimitiveLod>& lodTable) const;
+
+	// Flattens the drawable primitives (all meshes, or the resident chunks of a streamed model) into drawPackets
+	virtual void compileDrawList(void);
+
+	// Appends the packets of a mesh's primitives, index ranges come from lodTable and the mesh's buffers
+	void compileMeshDraws(const vkbase::Mesh& mesh, uint32_t meshIndex, const std::vector<vkbase::PrimitiveLod>& lodTable,
+		vkbase::Buffer* vertexPool, vkbase::Buffer* pool, vkbase::Buffer* pool16);
+
+#ifdef VKTINY_BENCHMARK
+	void benchmarkDecode(const tinygltf::Model& model);
+#endif
+
+	// Gathers the world matrices of all visible nodes grouped by mesh and writes them to the frame's instance buffer
+	virtual void updateInstances(uint32_t frame);
+
+	// World matrices of all visible nodes grouped by mesh, in one pass over the node arrays
+	void collectInstances(std::vector<std::vector<glm::mat4>>& transforms);
 
 	virtual void createVertexBuffers(void);
 	virtual void createIndexBuffers(void);
 
+	// Creates a device local buffer and stages data for it, the copy is recorded by recordUploads
+	std::unique_ptr<vkbase::Buffer> stageBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
+
+	std::vector<vkbase::BufferUpload> pendingUploads;
+
+	// Background load, null if the model was loaded synchronously
+	std::shared_ptr<vkbase::ModelLoad> asyncLoad;
+	std::thread loadThread;
+	VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+	VkFence uploadFence = VK_NULL_HANDLE;
+
+	// Hot reload state, the new scene is parsed into reloadModel and swapped in by pollReload
+	std::string sourcePath;
+	std::vector<std::string> sources;
+	std::vector<uint64_t> imageVersions;
+	bool reloading = false;
+	std::unique_ptr<GLTFBase> reloadModel;
+	vkbase::ReloadChanges reloadChanges;
+	vkbase::BufferReload reloadVertexBuffer;
+	vkbase::BufferReload reloadIndexBuffer;
+	vkbase::BufferReload reloadIndexBuffer16;
+	std::vector<uint32_t> reloadedImageIndices;
+	std::vector<std::unique_ptr<vkbase::BaseTexture>> reloadedImages;
+	size_t reloadImageCount = 0;
+	// Replaced objects, released once the upload fence of the reload or stream batch signals
+	std::vector<std::unique_ptr<vkbase::Buffer>> retiredBuffers;
+	std::vector<std::unique_ptr<vkbase::BaseTexture>> retiredImages;
+
+	// Streaming state, chunk batches are staged on streamThread and uploaded with uploadCommandBuffer and uploadFence
+	// Streamed and evicted images go through reloadedImages and installReloadImages (streaming and hot reload exclude each other)
+	std::unique_ptr<vkbase::SceneCache> streamCache;
+	vkbase::ChunkResidency streamResidency;
+	std::vector<vkbase::ChunkGeometry> chunkGeometry;
+	// Image uris of the streamed scene
+	tinygltf::Model streamImages;
+	std::unique_ptr<vkbase::PNGTexture> placeholderImage;
+	std::shared_ptr<vkbase::ModelLoad> streamBatch;
+	// Evicted chunk buffers and images, released by evictionFence independently of the batch uploads
+	VkFence evictionFence = VK_NULL_HANDLE;
+	std::vector<std::unique_ptr<vkbase::Buffer>> evictedBuffers;
+	std::vector<std::unique_ptr<vkbase::BaseTexture>> evictedImages;
+	std::thread streamThread;
+	std::vector<uint32_t> streamLoads;
+	std::vector<uint32_t> streamLoadImages;
+	// Device memory of the images staged by the current batch, parallel to reloadedImageIndices
+	std::vector<uint64_t> streamImageBytes;
+
 	tinygltf::TinyGLTF loader;
 
 	std::string error;
@@ -97,8 +586,52 @@ protected:
 
 	std::string path;
 
+	vkbase::LoaderSettings settings;
+
+	// Mapping of the GLB file while it is being loaded, mappedBuffers[i] is set for buffers stored in its BIN chunk
+	// mappedBufferSizes[i] is the length of the BIN chunk then, reads of the buffer must stay inside it
+	vkbase::MappedFile binaryFile;
+	std::vector<const unsigned char*> mappedBuffers;
+	std::vector<size_t> mappedBufferSizes;
+
+	// CPU side copies of the geometry (empty if the model was loaded from its scene cache)
 	std::vector<Vertex> vertices;
+	// Replaces vertices if settings.vertexFormat is VertexFormat::Packed
+	std::vector<vkbase::PackedVertex> packedVertices;
 	std::vector<uint32_t> indices;
+	std::vector<uint16_t> indices16;
+
+	// Primitive ranges of every glTF mesh, reserved (and decoded) only once no matter how many nodes use it
+	std::vector<vkbase::Mesh> meshes;
+
+	// Per instance transform stream, bound at INSTANCE_BUFFER_BIND_ID
+	// One per frame in flight, so the transforms of a frame still on the GPU are never overwritten
+	struct InstanceBuffer {
+		std::unique_ptr<vkbase::Buffer> buffer;
+		VmaAllocationInfo allocInfo = {};
+		size_t capacity = 0;
+	};
+	std::vector<InstanceBuffer> instanceBuffers;
+	std::vector<glm::mat4> instanceTransforms;
+	std::vector<vkbase::MeshInstances> meshInstances;
+
+	// Flat draw list, rebuilt by bind only when the scene changed (drawListDirty)
+	std::vector<vkbase::DrawPacket> drawPackets;
+	std::vector<vkbase::PrimitiveLod> drawLevels;
+	bool drawListDirty = true;
+	// Incremented by every compileDrawList, part of the prepareBind key
+	uint64_t drawListVersion = 0;
+
+	// Packets with instances sorted by pass, state and depth, refilled by every bind
+	vkbase::RenderQueue renderQueue;
+	vkbase::RenderQueueStats renderQueueStats;
+
+	// Filled by loadNode, consumed by decodePrimitives
+	std::vector<vkbase::PrimitiveDecodeInfo> primitiveDecodes;
+	uint32_t vertexTotal = 0;
+	uint32_t indexTotal = 0;
+	uint32_t indexTotal16 = 0;
+	std::vector<vkbase::PrimitiveOptimizationStats> optimizationStats;
 
 	vkbase::Indices bufferIndices;
 
@@ -110,7 +643,10 @@ class GLTFKtxModel : public GLTFBase {
 
 public:
 
-	GLTFKtxModel(const std::string& filepath, VkQueue copyQueue);
+	GLTFKtxModel(const std::string& filepath, VkQueue copyQueue, const vkbase::LoaderSettings& settings = {});
+
+	// Empty model for loadAsync
+	GLTFKtxModel(VkQueue copyQueue, const vkbase::LoaderSettings& settings = {});
 
 	virtual ~GLTFKtxModel() override;
 
@@ -120,6 +656,14 @@ protected:
 
 	int loadImages(tinygltf::Model& model) override;
 
+	void recordImageUploads(VkCommandBuffer cmd) override;
+
+	void finishImageUploads(void) override;
+
+	std::unique_ptr<vkbase::BaseTexture> stageReloadImage(tinygltf::Model& input, uint32_t index) override;
+
+	void installReloadImages(size_t imageCount) override;
+
 	std::vector<vkbase::KtxTexture> images;
 
 private:
@@ -130,7 +674,10 @@ class GLTFPngModel : public GLTFBase {
 
 public:
 
-	GLTFPngModel(const std::string& filepath, VkQueue copyQueue);
+	GLTFPngModel(const std::string& filepath, VkQueue copyQueue, const vkbase::LoaderSettings& settings = {});
+
+	// Empty model for loadAsync
+	GLTFPngModel(VkQueue copyQueue, const vkbase::LoaderSettings& settings = {});
 
 	virtual ~GLTFPngModel() override;
 
@@ -140,6 +687,17 @@ protected:
 
 	int loadImages(tinygltf::Model& model) override;
 
+	void recordImageUploads(VkCommandBuffer cmd) override;
+
+	void finishImageUploads(void) override;
+
+	std::unique_ptr<vkbase::BaseTexture> stageReloadImage(tinygltf::Model& input, uint32_t index) override;
+
+	void installReloadImages(size_t imageCount) override;
+
+	// Decodes image index of input if tinygltf didn't and stages it into texture
+	bool stageImage(tinygltf::Model& input, size_t index, vkbase::PNGTexture& texture);
+
 	std::vector<vkbase::PNGTexture> images;
 
 private:
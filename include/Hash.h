@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace vkbase {
+
+	// Non cryptographic 64 bit hash, processes the input in 8 byte words
+	// Used to detect changed content (cache validation, state deduplication), not for security
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+		const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+		const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint64_t h = seed ^ (size * prime1);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t word;
+			memcpy(&word, bytes + i, sizeof(word));
+			word *= prime2;
+			word = (word << 31) | (word >> 33);
+			h ^= word * prime1;
+			h = ((h << 27) | (h >> 37)) * prime1 + prime2;
+		}
+
+		uint64_t tail = 0;
+		for (size_t shift = 0; i < size; i++, shift += 8) {
+			tail |= static_cast<uint64_t>(bytes[i]) << shift;
+		}
+		h ^= (tail * prime2) ^ size;
+
+		// final avalanche
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	template<typename T>
+	inline uint64_t hashValue(const T& value, uint64_t seed = 0) {
+		return hashBytes(&value, sizeof(T), seed);
+	}
+
+	inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+		return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+	}
+
+}
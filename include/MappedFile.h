@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace vkbase {
+
+	// Read only memory mapping of a whole file
+	// The contents are paged in on first access, so reading from the mapping goes straight to the page cache
+	class MappedFile {
+
+	public:
+		MappedFile() = default;
+
+		explicit MappedFile(const std::string& filename) {
+			open(filename);
+		}
+
+		~MappedFile() {
+			close();
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& filename) {
+			close();
+#ifdef _WIN32
+			fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (fileHandle == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+				close();
+				return false;
+			}
+			mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mappingHandle == nullptr) {
+				close();
+				return false;
+			}
+			mappedData = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+			mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat fileStat;
+			if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+				::close(fd);
+				return false;
+			}
+			mappedSize = static_cast<size_t>(fileStat.st_size);
+			void* ptr = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			// the mapping keeps its own reference to the file
+			::close(fd);
+			mappedData = (ptr == MAP_FAILED) ? nullptr : ptr;
+#endif
+			if (mappedData == nullptr) {
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+#ifdef _WIN32
+			if (mappedData) {
+				UnmapViewOfFile(mappedData);
+			}
+			if (mappingHandle) {
+				CloseHandle(mappingHandle);
+				mappingHandle = nullptr;
+			}
+			if (fileHandle != INVALID_HANDLE_VALUE) {
+				CloseHandle(fileHandle);
+				fileHandle = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mappedData) {
+				munmap(mappedData, mappedSize);
+			}
+#endif
+			mappedData = nullptr;
+			mappedSize = 0;
+		}
+
+		// Hint that the whole file will be read front to back
+		void adviseSequential() const {
+#ifndef _WIN32
+			if (mappedData) {
+				madvise(mappedData, mappedSize, MADV_SEQUENTIAL);
+				madvise(mappedData, mappedSize, MADV_WILLNEED);
+			}
+#endif
+		}
+
+		// Drops the pages of a range from the process, they are read from the file again on the next access
+		// Used once a range has been copied elsewhere, so mapping a file larger than memory doesn't pin it
+		void release(const void* data, size_t size) const {
+#ifndef _WIN32
+			if (!mappedData || size == 0) {
+				return;
+			}
+			uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+			uintptr_t mappingBegin = reinterpret_cast<uintptr_t>(mappedData);
+			uintptr_t begin = std::max(reinterpret_cast<uintptr_t>(data) & ~(pageSize - 1), mappingBegin);
+			uintptr_t end = std::min((reinterpret_cast<uintptr_t>(data) + size + pageSize - 1) & ~(pageSize - 1), mappingBegin + mappedSize);
+			if (end > begin) {
+				madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+			}
+#endif
+		}
+
+		bool isOpen() const {
+			return mappedData != nullptr;
+		}
+
+		const unsigned char* data() const {
+			return static_cast<const unsigned char*>(mappedData);
+		}
+
+		size_t size() const {
+			return mappedSize;
+		}
+
+	private:
+		void* mappedData = nullptr;
+		size_t mappedSize = 0;
+#ifdef _WIN32
+		HANDLE fileHandle = INVALID_HANDLE_VALUE;
+		HANDLE mappingHandle = nullptr;
+#endif
+	};
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Load time processing of triangle lists (reordering, clusters, simplification and tangents)
+	// All functions work on a single primitive with indices relative to its first vertex and are fully
+	// deterministic (same input, same output), so the results can be stored in the scene cache
+	namespace meshopt {
+
+		// Size of the simulated post transform vertex cache (FIFO)
+		const uint32_t VERTEX_CACHE_SIZE = 16;
+
+		// Cluster limits, sized for mesh shader workgroups (64 vertices, 124 triangles fit the NV/EXT recommendations)
+		const uint32_t MESHLET_MAX_VERTICES = 64;
+		const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+		// A contiguous range of a primitive's triangles with its culling bounds (in the primitive's local space)
+		struct Meshlet {
+			// range in the index buffer the meshlet was built from
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			uint32_t vertexCount;
+			// bounding sphere
+			float center[3];
+			float radius;
+			// backface cone, the cluster is backfacing if dot(normalize(coneApex - cameraPosition), coneAxis) >= coneCutoff
+			// coneCutoff is 1 (never culled) if the triangle normals spread too far
+			float coneApex[3];
+			float coneCutoff;
+			float coneAxis[3];
+			uint32_t reserved;
+		};
+
+		struct VertexCacheStats {
+			// average cache miss ratio, transformed vertices per triangle (0.5 is the optimum for regular grids, 3 the worst case)
+			float acmr;
+			// average transform to vertex ratio, transformed vertices per referenced vertex (1 is the optimum)
+			float atvr;
+		};
+
+		VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+		// Reorders the triangles for the post transform vertex cache (Tipsify, Sander et al. 2007)
+		void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+		// Reorders clusters of the cache optimized triangle list so that outward facing clusters are drawn first
+		// threshold is the allowed ACMR increase (1.05 = 5%) when splitting into smaller clusters
+		void optimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+		// Splits a triangle list into meshlets of at most maxVertices unique vertices and maxTriangles triangles
+		// Triangles are taken in index buffer order (run the vertex cache optimization first for tight clusters),
+		// so every meshlet is a contiguous range of the index buffer and no reordering is needed
+		std::vector<Meshlet> buildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+			uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+		// Bounding sphere and normal cone of a range of triangles
+		void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const float* positions, size_t positionStride);
+
+		// CPU culling tests, cameraPosition and planes have to be in the meshlet's space
+		bool meshletBackfacing(const Meshlet& meshlet, const float* cameraPosition);
+
+		// planes are (a, b, c, d) with normals pointing inside, a point p is inside if dot(abc, p) + d >= 0
+		bool meshletOutsideFrustum(const Meshlet& meshlet, const float (*planes)[4], uint32_t planeCount);
+
+		// Quadric error edge collapse simplification (Garland and Heckbert 1997) of a triangle list into destination
+		// (at least indexCount entries), stops at targetIndexCount or when the next collapse would exceed targetError
+		// Errors are relative to the mesh extent (see simplifyScale), resultError receives the largest accepted error
+		// Vertices on mesh borders and attribute seams (several vertices sharing a position) never move, and no
+		// collapse may pull a triangle across a seam, so UV and normal discontinuities are preserved
+		// Returns the number of indices written to destination
+		size_t simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+			size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+		// Scale that converts relative simplification errors into position units (largest extent of the vertex bounds)
+		float simplifyScale(const float* positions, size_t positionStride, size_t vertexCount);
+
+		// Per vertex tangents for normal mapping (xyz tangent, w bitangent sign, bitangent = cross(normal, tangent) * w)
+		// Follows MikkTSpace: per triangle tangents from the UV gradients are projected into the plane of each corner's
+		// normal and accumulated weighted by the corner angle, then orthogonalized against the vertex normal
+		// Vertices are not split, triangles with mirrored UVs sharing a vertex average their tangents
+		// positions, normals, uvs and tangents share vertexStride, tangents receive 4 floats per vertex
+		void generateTangents(const uint32_t* indices, size_t indexCount, const float* positions, const float* normals, const float* uvs, size_t vertexStride,
+			size_t vertexCount, float* tangents);
+
+		// Reorders the vertices in order of first use and remaps the indices, so vertex fetch walks memory linearly
+		// Unreferenced vertices are moved to the end, the vertex count stays the same
+		void optimizeVertexFetch(void* vertices, size_t vertexSize, uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+	}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace vkbase {
+
+	// Decoder for EXT_meshopt_compression buffer views (bitstream version 0 of the vertex codec, 0 and 1 of the index codec)
+	// All functions are bounds checked and return false for malformed or truncated data
+	namespace meshopt {
+
+		// EXT_meshopt_compression "mode"
+		enum class CompressionMode : uint32_t {
+			Attributes = 0,
+			Triangles,
+			Indices,
+		};
+
+		// EXT_meshopt_compression "filter", applied to the decoded attributes
+		enum class CompressionFilter : uint32_t {
+			None = 0,
+			Octahedral,
+			Quaternion,
+			Exponential,
+		};
+
+		// A compressed buffer view, decodes into count * stride bytes
+		struct CompressedView {
+			const unsigned char* data;
+			size_t size;
+			size_t count;
+			size_t stride;
+			CompressionMode mode;
+			CompressionFilter filter;
+		};
+
+		// Byte wise delta encoded vertices, vertexSize has to be a multiple of 4 and at most 256
+		bool decodeVertexBuffer(void* destination, size_t vertexCount, size_t vertexSize, const unsigned char* data, size_t size);
+
+		// Triangle list encoded against an edge and a vertex FIFO, indexSize is 2 or 4
+		bool decodeIndexBuffer(void* destination, size_t indexCount, size_t indexSize, const unsigned char* data, size_t size);
+
+		// Arbitrary index sequences, delta encoded against the previous two indices
+		bool decodeIndexSequence(void* destination, size_t indexCount, size_t indexSize, const unsigned char* data, size_t size);
+
+		// In place filters over count elements of stride bytes
+		// Octahedral: signed 8 or 16 bit xyz unit vectors (stride 4 or 8), the fourth component is kept
+		// Quaternion: signed 16 bit unit quaternions stored as three components plus the index of the largest one (stride 8)
+		// Exponential: 32 bit floats stored as a 24 bit mantissa and an 8 bit exponent (stride multiple of 4)
+		bool decodeFilter(void* data, size_t count, size_t stride, CompressionFilter filter);
+
+		// Decodes a buffer view with its mode and filter into destination (count * stride bytes)
+		bool decodeView(const CompressedView& view, unsigned char* destination);
+
+	}
+
+}
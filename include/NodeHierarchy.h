@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace vkbase {
+
+	// glTF scene graph flattened in topological order, every node follows its parent
+	// Each node property is a separate array indexed by node. World matrices are computed in a single linear pass over
+	// the arrays, only for nodes whose local transform changed and their descendants
+	class NodeHierarchy {
+
+	public:
+		// Appends a node with an identity transform, parent is -1 for a root or an already added node
+		uint32_t addNode(int32_t parent, const std::string& name);
+
+		void clear(void);
+
+		size_t size() const {
+			return parentIndices.size();
+		}
+
+		// The local transform is translation * rotation * scale * matrix, glTF nodes use either TRS or the matrix
+		void setTranslation(uint32_t node, const glm::vec3& translation);
+		void setRotation(uint32_t node, const glm::quat& rotation);
+		void setScale(uint32_t node, const glm::vec3& scale);
+		void setMatrix(uint32_t node, const glm::mat4& matrix);
+
+		void setMesh(uint32_t node, int32_t mesh) {
+			meshIndices[node] = mesh;
+		}
+
+		// Hidden nodes hide their descendants too
+		void setVisible(uint32_t node, bool visible);
+
+		// Recomputes the local and world matrices of changed nodes and their descendants
+		// Returns false if nothing changed since the last update
+		bool updateWorldMatrices(void);
+
+		int32_t parent(uint32_t node) const {
+			return parentIndices[node];
+		}
+
+		const glm::vec3& translation(uint32_t node) const {
+			return translations[node];
+		}
+
+		const glm::quat& rotation(uint32_t node) const {
+			return rotations[node];
+		}
+
+		const glm::vec3& scale(uint32_t node) const {
+			return scales[node];
+		}
+
+		const glm::mat4& matrix(uint32_t node) const {
+			return matrices[node];
+		}
+
+		// Index into GLTFBase::meshes or -1, nodes sharing a glTF mesh are instances of its primitive ranges
+		int32_t mesh(uint32_t node) const {
+			return meshIndices[node];
+		}
+
+		const std::string& name(uint32_t node) const {
+			return names[node];
+		}
+
+		// Visible itself and all of its ancestors, valid after updateWorldMatrices
+		bool visible(uint32_t node) const {
+			return visibleInScene[node] != 0;
+		}
+
+		// Valid after updateWorldMatrices
+		const glm::mat4& worldMatrix(uint32_t node) const {
+			return worldMatrices[node];
+		}
+
+	private:
+		enum : uint8_t {
+			LOCAL_CHANGED = 1,
+			// moved with its parent or visibility changed
+			WORLD_CHANGED = 2,
+		};
+
+		void markDirty(uint32_t node, uint8_t flags) {
+			dirty[node] |= flags;
+			anyDirty = true;
+		}
+
+		std::vector<int32_t> parentIndices;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		std::vector<glm::mat4> matrices;
+		std::vector<glm::mat4> localMatrices;
+		std::vector<glm::mat4> worldMatrices;
+		std::vector<int32_t> meshIndices;
+		std::vector<std::string> names;
+		std::vector<uint8_t> visibleFlags;
+		std::vector<uint8_t> visibleInScene;
+		// LOCAL_CHANGED | WORLD_CHANGED per node, descendants are updated with their parent
+		std::vector<uint8_t> dirty;
+		bool anyDirty = false;
+	};
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Reads pipeline cache data written by savePipelineCache
+	// Returns nothing if the file is missing, truncated or was written by another device or driver, the driver would
+	// reject such data anyway and some drivers do not survive damaged data
+	std::vector<unsigned char> loadPipelineCacheData(const std::string& filename, const VkPhysicalDeviceProperties& properties);
+
+	// Writes the data of the cache to a temporary file and renames it, so a crash never leaves a partial cache behind
+	bool savePipelineCache(const std::string& filename, VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties& properties);
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ThreadPool.h"
+
+
+namespace vkbase {
+
+	// Owns graphics pipelines and hands out one shared VkPipeline per unique create info state
+	// The key is the create info serialized field by field (shader modules, layout and render pass by handle), so two
+	// create infos that only differ in pointers or padding share a pipeline. pNext chains are not part of the key
+	// New states are compiled on worker threads against the shared pipeline cache (which Vulkan synchronizes internally)
+	// With pipelineLibraries (VK_EXT_graphics_pipeline_library enabled) a state is split into its vertex input,
+	// pre-rasterization, fragment shader and fragment output parts, every distinct part is compiled once as a library and
+	// the pipelines are fast-linked from them. Otherwise, or without the extension in the headers, pipelines are monolithic
+	class PipelineRegistry {
+
+	public:
+		PipelineRegistry(VkDevice device, VkPipelineCache pipelineCache, bool pipelineLibraries = false, uint32_t threadCount = ThreadPool::defaultThreadCount());
+
+		// Waits for running compilations and destroys every pipeline, none may still be in use
+		~PipelineRegistry();
+
+		PipelineRegistry(const PipelineRegistry&) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+		// Returns the id of this state, a new state is copied and queued on the workers (pNext chains are not copied)
+		uint32_t request(const VkGraphicsPipelineCreateInfo& createInfo);
+
+		// Returns the pipeline of a requested state, VK_NULL_HANDLE while it is still compiling; throws if the creation failed
+		VkPipeline pipeline(uint32_t id);
+
+		// Returns the pipeline of a requested state, compiling it on the calling thread if no worker has started it yet
+		// Throws if the creation fails
+		VkPipeline wait(uint32_t id);
+
+		// Returns the pipeline of this state, created on first request; throws if the creation fails
+		VkPipeline graphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo) {
+			return wait(request(createInfo));
+		}
+
+		// Number of distinct pipelines
+		size_t size() const {
+			return compilations.size();
+		}
+
+		// Requests since the registry was created, requests - size() pipelines were shared instead of created
+		uint32_t requestCount() const {
+			return requests;
+		}
+
+		uint32_t threadCount() const {
+			return workers->size();
+		}
+
+		bool usesLibraries() const {
+			return pipelineLibraries;
+		}
+
+		// Number of distinct pipeline libraries, zero without usesLibraries()
+		size_t libraryCount() const {
+			return libraries.size();
+		}
+
+		// Serialized state of a create info, requests with equal keys share a pipeline
+		static std::vector<unsigned char> stateKey(const VkGraphicsPipelineCreateInfo& createInfo);
+
+		// Summed time of the finished vkCreateGraphicsPipelines calls, i.e. compiling pipelines missing from the pipeline cache
+		// With libraries, this is the time to compile the libraries plus the time to link the pipelines
+		double creationMs();
+
+	private:
+		struct KeyHash {
+			size_t operator()(const std::vector<unsigned char>& key) const;
+		};
+
+		struct Compilation;
+
+		// Returns the library of one part of the state, queued on the workers if it is new
+		std::shared_ptr<Compilation> requestLibrary(const VkGraphicsPipelineCreateInfo& createInfo, uint32_t libraryFlags);
+
+		// Creates the pipeline unless another thread already claimed the compilation
+		void compile(Compilation& compilation);
+
+		// Compiles or waits for the compilation, returns its result
+		VkResult finish(Compilation& compilation);
+
+		VkDevice device;
+		VkPipelineCache pipelineCache;
+		std::unordered_map<std::vector<unsigned char>, uint32_t, KeyHash> stateIds;
+		std::vector<std::shared_ptr<Compilation>> compilations;
+		std::unordered_map<std::vector<unsigned char>, std::shared_ptr<Compilation>, KeyHash> libraries;
+		std::unique_ptr<ThreadPool> workers;
+		bool pipelineLibraries = false;
+		uint32_t requests = 0;
+	};
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Passes in the order they are drawn, from the glTF material's alphaMode
+	enum class RenderPass : uint32_t {
+		Opaque = 0,
+		Masked,
+		Blended,
+	};
+
+	// 64 bit draw sort key, ascending keys are drawn first
+	// Opaque and masked: pass (2 bits) | pipeline (14) | material (16) | depth (24), state changes first, then front to back
+	// Blended: pass (2 bits) | inverted depth (24) | pipeline (14) | material (16), back to front first
+	// depth is a non negative view distance, pipeline and material are small indices (clamped to their bits)
+	uint64_t drawSortKey(RenderPass pass, uint32_t pipeline, uint32_t material, float depth);
+
+	// Binds of the last recorded frame, avoided counts are the binds a per draw packet recording would have issued on top
+	struct RenderQueueStats {
+		uint32_t packets = 0;
+		uint32_t draws = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorSetBinds = 0;
+		uint32_t vertexBufferBinds = 0;
+		uint32_t indexBufferBinds = 0;
+		uint32_t pipelineBindsAvoided = 0;
+		uint32_t descriptorSetBindsAvoided = 0;
+
+		// Sums the stats of draws recorded in separate command buffers
+		RenderQueueStats& operator+=(const RenderQueueStats& other) {
+			packets += other.packets;
+			draws += other.draws;
+			pipelineBinds += other.pipelineBinds;
+			descriptorSetBinds += other.descriptorSetBinds;
+			vertexBufferBinds += other.vertexBufferBinds;
+			indexBufferBinds += other.indexBufferBinds;
+			pipelineBindsAvoided += other.pipelineBindsAvoided;
+			descriptorSetBindsAvoided += other.descriptorSetBindsAvoided;
+			return *this;
+		}
+	};
+
+	// Items (e.g. draw packet indices) sorted by a 64 bit key with an LSD radix sort, rebuilt every frame
+	class RenderQueue {
+
+	public:
+		void clear(void) {
+			keys.clear();
+			items.clear();
+		}
+
+		void push(uint64_t key, uint32_t item) {
+			keys.push_back(key);
+			items.push_back(item);
+		}
+
+		// Sorts by ascending key, items with equal keys keep their push order
+		void sort(void);
+
+		size_t size() const {
+			return items.size();
+		}
+
+		uint32_t item(size_t index) const {
+			return items[index];
+		}
+
+		uint64_t key(size_t index) const {
+			return keys[index];
+		}
+
+	private:
+		std::vector<uint64_t> keys;
+		std::vector<uint32_t> items;
+		std::vector<uint64_t> scratchKeys;
+		std::vector<uint32_t> scratchItems;
+	};
+
+}
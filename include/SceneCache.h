@@ -0,0 +1,139 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+
+namespace vkbase {
+
+	// Sections of a scene cache file, every section is an array of plain structs
+	enum class SceneCacheSection : uint32_t {
+		Sources = 0,
+		Strings,
+		Vertices,
+		Indices,
+		Nodes,
+		Primitives,
+		Materials,
+		Textures,
+		Images,
+		Meshes,
+		Indices16,
+		Clusters,
+		Lods,
+	};
+
+	// Source file the cache was built from, a cache entry is only used while all of its sources are unchanged
+	struct SceneCacheSource {
+		uint64_t size;
+		int64_t modifiedTime;
+		uint64_t contentHash;
+		uint32_t pathOffset;
+		uint32_t pathLength;
+	};
+
+	// Strings are stored as (offset, length) pairs into the strings section
+	struct SceneCacheString {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	// Node hierarchy in topological order (GLTFBase::nodes), children always follow their parent
+	// The local transform is translation * rotation * scale * matrix like in NodeHierarchy
+	struct SceneCacheNode {
+		glm::mat4 matrix;
+		// xyzw quaternion
+		glm::vec4 rotation;
+		glm::vec3 translation;
+		int32_t parent;
+		glm::vec3 scale;
+		int32_t mesh;
+		SceneCacheString name;
+	};
+
+	// Meshes reference a range of the primitives section, nodes share them through SceneCacheNode::mesh
+	struct SceneCacheMesh {
+		uint32_t firstPrimitive;
+		uint32_t primitiveCount;
+		// xyz offset, w scale of packed vertex positions
+		glm::vec4 positionOffsetScale;
+		glm::vec4 boundingSphere;
+	};
+
+	struct SceneCacheMaterial {
+		glm::vec4 baseColorFactor;
+		uint32_t baseColorTextureIndex;
+		uint32_t normalTextureIndex;
+		float alphaCutOff;
+		uint32_t doubleSided;
+		SceneCacheString alphaMode;
+	};
+
+	// Collects the sections of a scene and writes them to disk
+	class SceneCacheWriter {
+
+	public:
+		// Adds a source file and records its size, modification time and content hash
+		bool addSource(const std::string& filename);
+
+		SceneCacheString addString(const std::string& string);
+
+		void setSection(SceneCacheSection section, const void* data, size_t size);
+
+		template<typename T>
+		void setSection(SceneCacheSection section, const std::vector<T>& data) {
+			setSection(section, data.data(), data.size() * sizeof(T));
+		}
+
+		// Writes to a temporary file first and renames it, so readers never see a partially written cache
+		bool write(const std::string& filename, uint64_t settingsHash);
+
+	private:
+		std::vector<SceneCacheSource> sources;
+		std::vector<char> strings;
+		std::vector<std::pair<SceneCacheSection, std::vector<unsigned char>>> sections;
+	};
+
+	// Memory mapped scene cache file
+	class SceneCache {
+
+	public:
+		// Maps the cache and checks it against the loader settings and its source files
+		bool open(const std::string& filename, uint64_t settingsHash);
+
+		template<typename T>
+		const T* section(SceneCacheSection id, size_t& count) const {
+			size_t size = 0;
+			const unsigned char* data = sectionData(id, size);
+			count = size / sizeof(T);
+			return reinterpret_cast<const T*>(data);
+		}
+
+		const unsigned char* sectionData(SceneCacheSection id, size_t& size) const;
+
+		std::string string(const SceneCacheString& string) const;
+
+		// Lets the system drop the pages of a copied range of a section (see MappedFile::release)
+		void release(const void* data, size_t size) const {
+			file.release(data, size);
+		}
+
+		// Paths of the source files the cache was built from
+		std::vector<std::string> sourcePaths() const;
+
+		static std::string cachePath(const std::string& assetPath) {
+			return assetPath + ".vkcache";
+		}
+
+	private:
+		bool sourcesValid() const;
+
+		MappedFile file;
+	};
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Spatial cell of a streamed scene, every instanced mesh belongs to exactly one chunk
+	struct StreamChunk {
+		// Bounds of all instances of the chunk's meshes in the scene's root space (xyz center, w radius)
+		glm::vec4 boundingSphere = glm::vec4(0.0f);
+		std::vector<uint32_t> meshes;
+		// Images referenced by the materials of the chunk's primitives, they are resident while any chunk using them is
+		std::vector<uint32_t> images;
+		// Size of the chunk's vertex and index buffers
+		uint64_t geometryBytes = 0;
+	};
+
+	enum class ChunkState : uint32_t {
+		Evicted = 0,
+		// staged by the streaming thread, its bytes are already counted against the budget
+		Loading,
+		Resident,
+	};
+
+	// Residency of a streamed scene, for tuning LoaderSettings::streamingBudget
+	struct StreamingStats {
+		uint64_t budget = 0;
+		// Geometry of loading and resident chunks plus their images (shared images are counted once)
+		uint64_t residentBytes = 0;
+		uint32_t chunkCount = 0;
+		uint32_t residentChunks = 0;
+		uint32_t loadingChunks = 0;
+		uint32_t residentImages = 0;
+		// Chunks the camera wants (nearest first within the budget) that are not resident yet
+		uint32_t missingChunks = 0;
+		// Totals since the scene was loaded
+		uint64_t loadedBytes = 0;
+		uint64_t evictedBytes = 0;
+		uint32_t loads = 0;
+		uint32_t evictions = 0;
+	};
+
+	// Groups meshes into cubic cells of cellSize by the center of their bounds (scene root space)
+	// Meshes with empty bounds (min > max, no instances) are left out, chunks are ordered by cell
+	std::vector<StreamChunk> partitionScene(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax, float cellSize);
+
+	// Decides which chunks are loaded and evicted under a byte budget
+	// Chunks are wanted nearest first as long as they fit the budget. Evictions only happen to make room for a wanted
+	// chunk and take resident chunks that are no longer wanted, least recently wanted first and the farthest among those
+	class ChunkResidency {
+
+	public:
+		void reset(const std::vector<StreamChunk>& chunks, const std::vector<uint64_t>& imageBytes, uint64_t budget);
+
+		// Plans the next batch from the chunks' distances to the camera
+		// Chunks in load are marked Loading and chunks in evict are Evicted right away; loadImages and evictImages are
+		// the images whose first user was loaded or whose last user was evicted. At most uploadLimit bytes are planned
+		// per batch, but always at least one chunk
+		void plan(const std::vector<float>& distances, uint64_t uploadLimit, std::vector<uint32_t>& load, std::vector<uint32_t>& evict,
+			std::vector<uint32_t>& loadImages, std::vector<uint32_t>& evictImages);
+
+		// The batch's uploads are submitted, its chunks are drawable
+		void finishLoads(const std::vector<uint32_t>& chunks);
+
+		// The batch failed, its chunks are evicted again (images only they used were never installed)
+		void cancelLoads(const std::vector<uint32_t>& chunks);
+
+		// Replaces an image's size estimate with its actual size once it is loaded
+		void setImageBytes(uint32_t image, uint64_t bytes);
+
+		ChunkState state(uint32_t chunk) const {
+			return states[chunk];
+		}
+
+		const std::vector<StreamChunk>& chunks() const {
+			return chunkList;
+		}
+
+		const StreamingStats& stats() const {
+			return statistics;
+		}
+
+	private:
+		// Bytes a chunk adds to the resident set (its geometry and the images no other resident chunk holds)
+		uint64_t loadCost(uint32_t chunk) const;
+
+		void release(uint32_t chunk, std::vector<uint32_t>& evictImages);
+
+		void updateCounts();
+
+		std::vector<StreamChunk> chunkList;
+		std::vector<ChunkState> states;
+		// Last plan that wanted the chunk
+		std::vector<uint64_t> lastUsed;
+		std::vector<uint64_t> imageSizes;
+		// Loading and resident chunks using the image
+		std::vector<uint32_t> imageUsers;
+		uint64_t frame = 0;
+		StreamingStats statistics;
+	};
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Simple fixed size worker pool used for load time work (decoding, conversion, ...)
+	class ThreadPool {
+
+	public:
+		explicit ThreadPool(uint32_t threadCount = defaultThreadCount()) {
+			threadCount = std::max(1u, threadCount);
+			for (uint32_t i = 0; i < threadCount; i++) {
+				workers.emplace_back(&ThreadPool::workerLoop, this);
+			}
+		}
+
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				destroying = true;
+			}
+			condition.notify_all();
+			for (auto& worker : workers) {
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		static uint32_t defaultThreadCount() {
+			return std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		uint32_t size() const {
+			return static_cast<uint32_t>(workers.size());
+		}
+
+		void submit(std::function<void()> job) {
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				jobs.push(std::move(job));
+				pending++;
+			}
+			condition.notify_one();
+		}
+
+		// Blocks until every submitted job has finished
+		void wait() {
+			std::unique_lock<std::mutex> lock(queueMutex);
+			finished.wait(lock, [this] { return pending == 0; });
+		}
+
+		// Runs func(i) for i in [0, count) on the workers and the calling thread and waits for completion
+		// Items are handed out one at a time, so uneven item costs still balance out. Helpers that
+		// have not started by the time the caller ran out of items are skipped, so nesting is safe
+		// maxThreads limits the number of threads (including the caller) working on the items
+		// If func throws, the remaining items are skipped and the first exception is rethrown on the caller once all helpers stopped
+		void parallelFor(size_t count, const std::function<void(size_t)>& func, uint32_t maxThreads = UINT32_MAX) {
+			if (count == 0) {
+				return;
+			}
+
+			struct State {
+				std::atomic<size_t> next{ 0 };
+				std::mutex mutex;
+				std::condition_variable idle;
+				uint32_t active = 0;
+				bool closed = false;
+				std::exception_ptr error;
+
+				// Runs items until none are left, an exception stops every thread from taking new ones
+				void run(size_t count, const std::function<void(size_t)>& func) {
+					try {
+						for (size_t i = next++; i < count; i = next++) {
+							func(i);
+						}
+					}
+					catch (...) {
+						next = count;
+						std::lock_guard<std::mutex> lock(mutex);
+						if (!error) {
+							error = std::current_exception();
+						}
+					}
+				}
+			};
+			std::shared_ptr<State> state = std::make_shared<State>();
+			const std::function<void(size_t)>* body = &func;
+
+			size_t helperCount = std::min<size_t>(count - 1, std::min<size_t>(workers.size(), std::max(1u, maxThreads) - 1));
+			for (size_t j = 0; j < helperCount; j++) {
+				submit([state, body, count] {
+					{
+						std::lock_guard<std::mutex> lock(state->mutex);
+						if (state->closed) {
+							return;
+						}
+						state->active++;
+					}
+					state->run(count, *body);
+					std::lock_guard<std::mutex> lock(state->mutex);
+					if (--state->active == 0) {
+						state->idle.notify_all();
+					}
+				});
+			}
+
+			state->run(count, func);
+
+			// Helpers still running use func, so this has to wait for them even if the caller's items failed
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->closed = true;
+			state->idle.wait(lock, [&state] { return state->active == 0; });
+			if (state->error) {
+				std::rethrow_exception(state->error);
+			}
+		}
+
+	private:
+		void workerLoop() {
+			while (true) {
+				std::function<void()> job;
+				{
+					std::unique_lock<std::mutex> lock(queueMutex);
+					condition.wait(lock, [this] { return destroying || !jobs.empty(); });
+					if (destroying && jobs.empty()) {
+						return;
+					}
+					job = std::move(jobs.front());
+					jobs.pop();
+				}
+
+				job();
+
+				{
+					std::lock_guard<std::mutex> lock(queueMutex);
+					pending--;
+					if (pending == 0) {
+						finished.notify_all();
+					}
+				}
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::queue<std::function<void()>> jobs;
+		std::mutex queueMutex;
+		std::condition_variable condition;
+		std::condition_variable finished;
+		size_t pending = 0;
+		bool destroying = false;
+	};
+
+}
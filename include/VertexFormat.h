@@ -0,0 +1,96 @@
+#pragma once
+
+#include "VulkanGlobals.h"
+#include "VulkanInitializers.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Vertex layouts the loader can produce
+	enum class VertexFormat : uint32_t {
+		// Vertex, 60 bytes of plain floats
+		Full = 0,
+		// PackedVertex, 20 bytes
+		Packed,
+	};
+
+	// Quantized vertex, decoded in the vertex shader (see shaders/mesh_basic_packed.vert)
+	struct PackedVertex {
+		// unorm16 position relative to the mesh bounds, w is the tangent's bitangent sign (0 = -1, 65535 = +1)
+		uint16_t position[4];
+		// octahedral encoded unit vectors (snorm16)
+		int16_t normal[2];
+		int16_t tangent[2];
+		// half floats
+		uint16_t uv[2];
+	};
+
+	inline uint32_t vertexStride(VertexFormat format) {
+		return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
+
+	// Vertex input attributes matching the vertex format, locations are shared by all vertex shaders
+	// 0 = position, 1 = normal, 2 = uv, 3 = color (full format only), 4 = tangent
+	inline std::vector<VkVertexInputAttributeDescription> vertexInputAttributes(VertexFormat format, uint32_t binding) {
+		if (format == VertexFormat::Packed) {
+			return {
+				vkbase::initializers::vertexInputAttributeDescription(binding, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position)),
+				vkbase::initializers::vertexInputAttributeDescription(binding, 1, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)),
+				vkbase::initializers::vertexInputAttributeDescription(binding, 2, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)),
+				vkbase::initializers::vertexInputAttributeDescription(binding, 4, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, tangent)),
+			};
+		}
+		return {
+			vkbase::initializers::vertexInputAttributeDescription(binding, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)),
+			vkbase::initializers::vertexInputAttributeDescription(binding, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)),
+			vkbase::initializers::vertexInputAttributeDescription(binding, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)),
+			vkbase::initializers::vertexInputAttributeDescription(binding, 3, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)),
+			vkbase::initializers::vertexInputAttributeDescription(binding, 4, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, tangent)),
+		};
+	}
+
+	// Vertex shader (SPIR-V) written for the format's attributes
+	inline const char* vertexShaderPath(VertexFormat format) {
+		return format == VertexFormat::Packed ? "../shaders/mesh_basic_packed.vspv" : "../shaders/mesh_basic.vspv";
+	}
+
+	inline int16_t packSnorm16(float value) {
+		return static_cast<int16_t>(std::round(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+	}
+
+	// Octahedral encoding of a unit vector (Meyer et al. 2010)
+	inline void packOctahedral(const glm::vec3& vector, int16_t* result) {
+		float length = std::abs(vector.x) + std::abs(vector.y) + std::abs(vector.z);
+		glm::vec2 encoded(0.0f);
+		if (length > 0.0f) {
+			encoded = glm::vec2(vector.x, vector.y) / length;
+			if (vector.z < 0.0f) {
+				encoded = glm::vec2((1.0f - std::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f));
+			}
+		}
+		result[0] = packSnorm16(encoded.x);
+		result[1] = packSnorm16(encoded.y);
+	}
+
+	// positionOffset and positionScale map the mesh bounds to [0, 1], the inverse is applied by the instance matrix
+	inline PackedVertex packVertex(const Vertex& vertex, const glm::vec3& positionOffset, float positionScale) {
+		PackedVertex packed{};
+		for (int k = 0; k < 3; k++) {
+			float normalized = (vertex.position[k] - positionOffset[k]) / positionScale;
+			packed.position[k] = static_cast<uint16_t>(std::round(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f));
+		}
+		packed.position[3] = vertex.tangent.w < 0.0f ? 0 : 65535;
+		packOctahedral(vertex.normal, packed.normal);
+		packOctahedral(glm::vec3(vertex.tangent), packed.tangent);
+		packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+		packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+		return packed;
+	}
+
+}
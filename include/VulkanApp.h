@@ -4,6 +4,11 @@
 #include "VulkanGlobals.h"
 
 #include "GLTFModel.h"
+#include "PipelineRegistry.h"
+#include "CommandRecorder.h"
+
+#include <chrono>
+#include <mutex>
 
 
 class VulkanApp : public VulkanRenderer {
@@ -14,6 +19,11 @@ public:
 
     ~VulkanApp( );
 
+	// Reads the command line switches, call before prepare
+	//   --hot-reload        reload the model when its files change (keeps CPU copies of the geometry)
+	//   --benchmark-decode  measure the model's decode time for 1..N threads (VKTINY_BENCHMARK builds)
+	void parseArguments(int argc, char** argv);
+
 	void loadAssets();
 
     void render( ) override;
@@ -22,8 +32,16 @@ public:
 
 	void preparePipelines() override;
 
+	// (Re)creates the pipelines of the given materials
+	void preparePipelines(const std::vector<uint32_t>& materialIndices);
+
 	void buildCommandBuffers() override;
 
+#ifdef VKTINY_BENCHMARK
+	// Records the current frame's scene with 1..N threads and prints the time of each thread count
+	void benchmarkRecording(const VkCommandBufferInheritanceInfo& inheritanceInfo, const vkbase::CommandRecorder::RecordRange& recordRange);
+#endif
+
 	void renderLoop() override;
 
 	void createPipelineLayout();
@@ -34,6 +52,22 @@ public:
 
 	void createDescriptorSets();
 
+	void writeMaterialDescriptors(vkbase::Material& material);
+
+	// True if one of the material's textures samples one of the images
+	bool samplesImage(const vkbase::Material& material, const std::vector<uint32_t>& images) const;
+
+	// Updates pipelines and descriptor sets after a hot reload of the model
+	void applyModelChanges(const vkbase::ReloadChanges& changes);
+
+	// Hands pipelines that finished compiling in the background to their materials
+	void pollPipelines();
+
+	void reportPipelineBuild();
+
+	// Rewrites the descriptor sets of materials sampling streamed in or evicted images and reports the residency
+	void updateStreamedDescriptors(const std::vector<uint32_t>& images);
+
 	//void createApplicationInfoWindow();
 
 	void draw();
@@ -51,14 +85,51 @@ private:
 
 	VkPipelineLayout pipelineLayout;
 	VkPipeline pipeline = VK_NULL_HANDLE;
-	VkDescriptorPool descriptorPool;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 
 	VmaAllocationInfo uniform_allocation_info = {};
+	// The uniform buffer holds one slice per frame in flight, bound with a dynamic offset
+	VkDeviceSize uniform_slice_size = 0;
 	uboVS transform_matrices;
 
 	float deltaTime = 0.0f;
 	float lastFrame = 0.0f;
 
+	// Owns the material pipelines, materials with identical state share one
+	std::unique_ptr<vkbase::PipelineRegistry> pipelineRegistry;
+	std::vector<VkPipelineShaderStageCreateInfo> meshShaderStages;
+	// (material, registry state) of materials whose pipeline is still compiling, their draws are skipped until then
+	std::vector<std::pair<uint32_t, uint32_t>> pendingPipelines;
+	std::chrono::high_resolution_clock::time_point pipelineBuildStart;
+	double pipelineBuildCreationMs = 0.0;
+
+	// Records the scene's secondary command buffers on worker threads, with pools per thread and frame in flight
+	std::unique_ptr<vkbase::CommandRecorder> sceneRecorder;
+
+	// Settings of the model load, adjusted by parseArguments
+	vkbase::LoaderSettings loaderSettings;
 	GLTFKtxModel* model;
+	// Background load of the model, nothing but the handle is touched until modelReady
+	std::shared_ptr<vkbase::ModelLoad> modelLoad;
+	bool modelReady = false;
+	// Source files of the model, a change starts a hot reload
+	vkbase::FileWatcher modelWatcher;
+	bool reloadRequested = false;
+	// Time of the last streaming residency report
+	float lastStreamingReport = 0.0f;
+	// Incremented by every descriptor set write, scene command buffers recorded with the old contents must not be reused
+	uint64_t descriptorGeneration = 0;
+#ifdef VKTINY_BENCHMARK
+	// Command buffer recording time since the last report
+	double recordMs = 0.0;
+	uint32_t recordedFrames = 0;
+	// Command buffers recorded since the last report, primary ones plus the scene buffers that could not be reused
+	uint32_t recordings = 0;
+	uint32_t sceneRecordings = 0;
+	// Recording time of every thread, summed over the scene recordings
+	std::vector<double> threadRecordMs;
+	bool recordingBenchmarked = false;
+	float lastRecordReport = 0.0f;
+#endif
 	//GLTFPngModel* model;
 };
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "VulkanInitializers.h"
 #include "VulkanInitializers.h"
 
+#include <cstring>
+
 
 namespace vkbase {
 
@@ -21,6 +23,14 @@ namespace vkbase {
 
 		VkCommandPool command_pool;
 
+		// VK_EXT_extended_dynamic_state is enabled, pipelines can leave the cull mode to the command buffer
+		bool extendedDynamicState = false;
+#ifdef VK_EXT_extended_dynamic_state
+		PFN_vkCmdSetCullModeEXT cmdSetCullMode = nullptr;
+#endif
+		// VK_EXT_graphics_pipeline_library is enabled, pipelines can be linked from separately compiled parts
+		bool graphicsPipelineLibrary = false;
+
         VulkanDevice(VkPhysicalDevice physicalDevice){
             this->physicalDevice = physicalDevice;
         }
@@ -117,15 +127,60 @@ namespace vkbase {
             deviceFeatures.samplerAnisotropy = VK_TRUE;
 			deviceFeatures.fillModeNonSolid = VK_TRUE;
 
+            std::vector<const char*> enabledExtensions = deviceExtensions;
+            void* enabledFeatureChain = nullptr;
+
+            VkPhysicalDeviceProperties deviceProperties;
+            vkGetPhysicalDeviceProperties( physicalDevice, &deviceProperties );
+            const bool queryFeatures2 = deviceProperties.apiVersion >= VK_API_VERSION_1_1;
+
+#ifdef VK_EXT_extended_dynamic_state
+            // Optional, materials that only differ in their culling then share a pipeline
+            VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {};
+            extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+            bool enableExtendedDynamicState = false;
+            if ( queryFeatures2 && hasDeviceExtension( physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME ) ) {
+                VkPhysicalDeviceFeatures2 features2 = {};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+                features2.pNext = &extendedDynamicStateFeatures;
+                vkGetPhysicalDeviceFeatures2( physicalDevice, &features2 );
+                if ( extendedDynamicStateFeatures.extendedDynamicState ) {
+                    enabledExtensions.push_back( VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME );
+                    extendedDynamicStateFeatures.pNext = enabledFeatureChain;
+                    enabledFeatureChain = &extendedDynamicStateFeatures;
+                    enableExtendedDynamicState = true;
+                }
+            }
+#endif
+
+#ifdef VK_EXT_graphics_pipeline_library
+            // Optional, material variants are then linked from shared vertex input, shader and output libraries
+            VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures = {};
+            pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+            if ( queryFeatures2 && hasDeviceExtension( physicalDevice, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME ) && hasDeviceExtension( physicalDevice, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME ) ) {
+                VkPhysicalDeviceFeatures2 features2 = {};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+                features2.pNext = &pipelineLibraryFeatures;
+                vkGetPhysicalDeviceFeatures2( physicalDevice, &features2 );
+                if ( pipelineLibraryFeatures.graphicsPipelineLibrary ) {
+                    enabledExtensions.push_back( VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME );
+                    enabledExtensions.push_back( VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME );
+                    pipelineLibraryFeatures.pNext = enabledFeatureChain;
+                    enabledFeatureChain = &pipelineLibraryFeatures;
+                    graphicsPipelineLibrary = true;
+                }
+            }
+#endif
+
             VkDeviceCreateInfo createInfo = {};
             createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-            createInfo.pNext = nullptr;
+            createInfo.pNext = enabledFeatureChain;
             createInfo.pQueueCreateInfos = queueCreateInfos.data( );
             createInfo.queueCreateInfoCount = static_cast< uint32_t >(queueCreateInfos.size( ));
             createInfo.pEnabledFeatures = &deviceFeatures;
 
-            createInfo.enabledExtensionCount = static_cast< uint32_t >(deviceExtensions.size( ));
-            createInfo.ppEnabledExtensionNames = deviceExtensions.data( );
+            createInfo.enabledExtensionCount = static_cast< uint32_t >(enabledExtensions.size( ));
+            createInfo.ppEnabledExtensionNames = enabledExtensions.data( );
 
             if ( enableValidationLayers ) {
                 createInfo.enabledLayerCount = static_cast< uint32_t >(validationLayers.size( ));
@@ -138,6 +193,13 @@ namespace vkbase {
                 throw std::runtime_error( "failed to create logical vkdevice" );
             }
 
+#ifdef VK_EXT_extended_dynamic_state
+            if ( enableExtendedDynamicState ) {
+                cmdSetCullMode = ( PFN_vkCmdSetCullModeEXT ) vkGetDeviceProcAddr( logicalDevice, "vkCmdSetCullModeEXT" );
+                extendedDynamicState = cmdSetCullMode != nullptr;
+            }
+#endif
+
             vkGetDeviceQueue( logicalDevice, indices.graphicsFamily, 0, &graphicsQueue );
             vkGetDeviceQueue( logicalDevice, indices.presentFamily, 0, &presentQueue );
 
@@ -189,6 +251,22 @@ namespace vkbase {
             return requiredExtensions.empty( );
         }
 
+        bool hasDeviceExtension( VkPhysicalDevice device, const char* name ) {
+
+            uint32_t extensionsCount;
+            vkEnumerateDeviceExtensionProperties( device, nullptr, &extensionsCount, nullptr );
+
+            std::vector<VkExtensionProperties> availableExtensions( extensionsCount );
+            vkEnumerateDeviceExtensionProperties( device, nullptr, &extensionsCount, availableExtensions.data( ) );
+
+            for ( const auto& extension : availableExtensions ) {
+                if ( strcmp( extension.extensionName, name ) == 0 ) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
 
 		void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true)
 		{
@@ -22,6 +22,10 @@ struct Vertex {
     glm::vec4 tangent;
 };
 
+#define VERTEX_BUFFER_BIND_ID 0
+// Per instance model matrices (mat4, one per drawn node)
+#define INSTANCE_BUFFER_BIND_ID 1
+
 
 extern vkbase::VulkanAllocator* global_allocator;
 extern vkbase::VulkanDevice* global_device;
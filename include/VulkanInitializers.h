@@ -46,6 +46,12 @@ namespace vkbase {
 			return cmdBufferBeginInfo;
 		}
 
+		inline VkCommandBufferInheritanceInfo commandBufferInheritanceInfo() {
+			VkCommandBufferInheritanceInfo cmdBufferInheritanceInfo{};
+			cmdBufferInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			return cmdBufferInheritanceInfo;
+		}
+
 		inline VkRenderPassCreateInfo renderPassCreateInfo() {
 			VkRenderPassCreateInfo renderPassCreateInfo = {};
 			renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -7,6 +7,14 @@
 #include "../include/VulkanAllocator.h"
 #include "../include/VulkanFramebuffer.h"
 
+#include <chrono>
+
+#ifndef VKTINY_FRAMES_IN_FLIGHT
+#define VKTINY_FRAMES_IN_FLIGHT 2
+#endif
+
+const unsigned int MAX_FRAMES_IN_FLIGHT = 3;
+
 
 class VulkanRenderer {
 
@@ -15,8 +23,13 @@ public:
     VulkanRenderer( );
     virtual ~VulkanRenderer( );
 
-	void prepareFrame();
+	// Waits until the frame in flight's resources are free again and acquires the next swapchain image
+	// Returns false if the swapchain had to be recreated, the frame is skipped then
+	bool prepareFrame();
+	// Submits the frame's command buffer, presents the image and moves on to the next frame in flight
 	void submitFrame();
+	// Blocks until the GPU finished every submitted frame, e.g. before descriptor sets they use are rewritten
+	void waitForFrames();
 
 public:
     void initVulkan( );
@@ -36,6 +49,7 @@ private:
     void createCommandBuffers( );
     void destoryCommandBuffers( );
     void createSyncObjects( );
+    void destroySyncObjects( );
     void createPipelineCache( );
     void recreateSwapchain( );
     void cleanupSwapchain( );
@@ -64,17 +78,29 @@ private:
 protected:
 
 	struct {
-		// Swap chain image presentation
-		VkSemaphore presentComplete;
-		// Command buffer submission and execution
-		VkSemaphore renderComplete;
+		// Swap chain image presentation, one per frame in flight
+		std::vector<VkSemaphore> presentComplete;
+		// Command buffer submission and execution, one per swapchain image since presentation holds on to it
+		std::vector<VkSemaphore> renderComplete;
 	} semaphores;
 
-	// Contains command buffers and semaphores to be presented to the queue
-	VkSubmitInfo submitInfo;
-
 	VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
+	// Writes the GPU timestamps of the frame, around everything recorded into its command buffer
+	void beginFrameTimer(VkCommandBuffer commandBuffer);
+	void endFrameTimer(VkCommandBuffer commandBuffer);
+
+	// Frame pacing since the last reset, blocked is the time the CPU waited for the GPU (frame fences and image acquisition)
+	// CPU work overlapped with GPU work by cpu + gpu - frame, where cpu is frame - blocked
+	struct FrameTelemetry {
+		uint32_t frames = 0;
+		double frameMs = 0.0;
+		double blockedMs = 0.0;
+		// From timestamps, only for frames whose results were read back
+		uint32_t gpuFrames = 0;
+		double gpuMs = 0.0;
+	} frame_telemetry;
+
     vkbase::VulkanInstance* vulkan_instance;
     vkbase::VulkanSurface* vulkan_surface;
 
@@ -84,22 +110,39 @@ protected:
     VkImageView depth_image_view;
     VkRenderPass render_pass;
     VkPipelineCache pipeline_cache;
+    // Whether the pipeline cache started with the data of an earlier run
+    bool pipeline_cache_loaded = false;
 
     std::vector<VkImageView> image_views;
     std::vector<VkFramebuffer> framebuffers;
 
     VkCommandPool commandPool;
 
-	// Command buffers used for rendering
+	// Frames the CPU may record ahead of the GPU (1 to MAX_FRAMES_IN_FLIGHT, VKTINY_FRAMES_IN_FLIGHT)
+	uint32_t frames_in_flight;
+	// Frame in flight whose resources are recorded next
+	uint32_t current_frame = 0;
+
+	// Command buffers used for rendering, one per frame in flight
     std::vector<VkCommandBuffer> draw_cmd_buffers;
+	// Key of the scene's secondary command buffers last recorded for every frame in flight (0 if none)
+	// They are executed by the frame's primary buffer and re-recorded only when the key changes
+	std::vector<uint64_t> scene_recording_keys;
 
+	// Signaled once the GPU finished a frame in flight, its command buffer and uniform slice can be reused then
     std::vector<VkFence> in_flight_fences;
 
+	// Begin and end timestamps of every frame in flight
+	VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+	std::vector<bool> timestamps_written;
+	std::chrono::high_resolution_clock::time_point last_frame_start;
+
     // List of shader modules created (stored for cleanup)
     std::vector<VkShaderModule> shader_modules;
 
     VkDebugUtilsMessengerEXT debug_messenger;
 
+    // Acquired swapchain image
     uint32_t current_buffer = 0;
 
 	vkbase::vkDeviceInfo::Infos vk_device_info;
@@ -5,6 +5,8 @@ layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec3 inColor;
 layout (location = 4) in vec4 inTangent;
+// per instance model matrix
+layout (location = 5) in mat4 inInstanceMatrix;
 
 layout (set = 0, binding = 0) uniform UniformBufferObject {
     mat4 model;
@@ -28,11 +30,12 @@ void main() {
     outColor = inColor;
     outUV = inUV;
     outTangent = inTangent;
-    outNormal = mat3(ubo.model) * inNormal;
+    mat4 model = ubo.model * inInstanceMatrix;
+    outNormal = mat3(model) * inNormal;
 
-    vec4 pos = ubo.model * vec4(inPosition, 1.0);
+    vec4 pos = model * vec4(inPosition, 1.0);
     outLightVec = ubo.lightPos - pos.xyz;
     outViewVec = ubo.viewPos - pos.xyz;
 
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * pos;
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#version 450
+
+// Vertex input of vkbase::PackedVertex (see include/VertexFormat.h)
+layout (location = 0) in vec4 inPosition;
+layout (location = 1) in vec2 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 4) in vec2 inTangent;
+// per instance model matrix, includes the dequantization of the positions
+layout (location = 5) in mat4 inInstanceMatrix;
+
+layout (set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec3 lightPos;
+    vec3 viewPos;
+} ubo;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+layout (location = 5) out vec4 outTangent;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
+
+
+void main() {
+    mat4 model = ubo.model * inInstanceMatrix;
+
+    outNormal = mat3(model) * decodeOctahedral(inNormal);
+    outColor = vec3(1.0);
+    outUV = inUV;
+    outTangent = vec4(decodeOctahedral(inTangent), inPosition.w * 2.0 - 1.0);
+
+    vec4 pos = model * vec4(inPosition.xyz, 1.0);
+    outLightVec = ubo.lightPos - pos.xyz;
+    outViewVec = ubo.viewPos - pos.xyz;
+
+    gl_Position = ubo.proj * ubo.view * pos;
+}
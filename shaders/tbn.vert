@@ -5,6 +5,8 @@ layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec3 inColor;
 layout (location = 4) in vec3 inTangent;
+// per instance model matrix
+layout (location = 5) in mat4 inInstanceMatrix;
 
 layout (set = 0, binding = 0) uniform UniformBufferObject {
     mat4 model;
@@ -23,10 +25,11 @@ layout (location = 3) out vec3 outTangentFragPos;
 
 void main() {
 
-    vec3 outFragPos = vec3(ubo.model * vec4(inPosition, 1.0));
+    mat4 model = ubo.model * inInstanceMatrix;
+    vec3 outFragPos = vec3(model * vec4(inPosition, 1.0));
     outUV = inUV;
 
-    mat3 normalMatrix = transpose(inverse(mat3(ubo.model)));
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
     vec3 T = normalize(normalMatrix * inTangent);
     vec3 N = normalize(normalMatrix * inNormal);
     T = normalize(T - dot(T, N) * N);
@@ -37,5 +40,5 @@ void main() {
     outTangentViewPos  = TBN * ubo.viewPos;
     outTangentFragPos  = TBN * outFragPos;
 
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * vec4(outFragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include "../include/AccessorDecoder.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+#ifdef VKTINY_BENCHMARK
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#endif
+
+// SIMD kernels are compiled with per function target attributes, the executable itself keeps the baseline instruction set
+#if defined(__x86_64__) || defined(_M_X64)
+#define VKTINY_DECODE_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VKTINY_TARGET(isa)
+#else
+#define VKTINY_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+
+namespace {
+
+	// Integer components are converted as max(value * scale, minimum)
+	struct Conversion {
+		float scale;
+		float minimum;
+	};
+
+	// Float and half kernels take the conversion only to share the signature, they leave it unnamed
+	typedef void (*DecodeKernel)(const vkbase::AccessorSource& source, const Conversion& conversion, unsigned char* output, size_t outputStride);
+
+	// Componentwise fallback, also the reference for the SIMD kernels
+	template<typename T>
+	void decodeIntegerScalar(const vkbase::AccessorSource& source, const Conversion& conversion, unsigned char* output, size_t outputStride) {
+		for (size_t i = 0; i < source.count; i++) {
+			const unsigned char* element = source.data + i * source.stride;
+			float values[4];
+			for (uint32_t c = 0; c < source.componentCount; c++) {
+				T value;
+				memcpy(&value, element + c * sizeof(T), sizeof(T));
+				values[c] = std::max(float(value) * conversion.scale, conversion.minimum);
+			}
+			memcpy(output + i * outputStride, values, source.componentCount * sizeof(float));
+		}
+	}
+
+	void decodeFloatScalar(const vkbase::AccessorSource& source, const Conversion&, unsigned char* output, size_t outputStride) {
+		for (size_t i = 0; i < source.count; i++) {
+			memcpy(output + i * outputStride, source.data + i * source.stride, source.componentCount * sizeof(float));
+		}
+	}
+
+	void decodeHalfScalar(const vkbase::AccessorSource& source, const Conversion&, unsigned char* output, size_t outputStride) {
+		for (size_t i = 0; i < source.count; i++) {
+			const unsigned char* element = source.data + i * source.stride;
+			float values[4];
+			for (uint32_t c = 0; c < source.componentCount; c++) {
+				uint16_t value;
+				memcpy(&value, element + c * sizeof(uint16_t), sizeof(uint16_t));
+				values[c] = glm::unpackHalf1x16(value);
+			}
+			memcpy(output + i * outputStride, values, source.componentCount * sizeof(float));
+		}
+	}
+
+#ifdef VKTINY_DECODE_SIMD
+
+	// Number of leading elements that can be read with a load of loadSize bytes without reading past the accessor
+	size_t wideLoadCount(const vkbase::AccessorSource& source, size_t elementSize, size_t loadSize) {
+		if (elementSize == loadSize) {
+			return source.count;
+		}
+		return (source.stride >= loadSize && source.count > 0) ? source.count - 1 : 0;
+	}
+
+	// Stores the first componentCount lanes, the rest of the destination vertex stays untouched
+	inline void storeComponents(unsigned char* output, __m128 value, uint32_t componentCount) {
+		float* destination = reinterpret_cast<float*>(output);
+		switch (componentCount) {
+		case 4:
+			_mm_storeu_ps(destination, value);
+			break;
+		case 3:
+			_mm_storel_pi(reinterpret_cast<__m64*>(destination), value);
+			_mm_store_ss(destination + 2, _mm_movehl_ps(value, value));
+			break;
+		case 2:
+			_mm_storel_pi(reinterpret_cast<__m64*>(destination), value);
+			break;
+		default:
+			_mm_store_ss(destination, value);
+			break;
+		}
+	}
+
+	// Low bytes of an element (4 components), 8 bit elements need 4 bytes and 16 bit elements 8 bytes
+	inline __m128i loadElement(const unsigned char* element, size_t componentSize) {
+		if (componentSize == 1) {
+			int32_t value;
+			memcpy(&value, element, sizeof(value));
+			return _mm_cvtsi32_si128(value);
+		}
+		return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(element));
+	}
+
+	VKTINY_TARGET("sse4.1") inline __m128i widen(__m128i value, int8_t) { return _mm_cvtepi8_epi32(value); }
+	VKTINY_TARGET("sse4.1") inline __m128i widen(__m128i value, uint8_t) { return _mm_cvtepu8_epi32(value); }
+	VKTINY_TARGET("sse4.1") inline __m128i widen(__m128i value, int16_t) { return _mm_cvtepi16_epi32(value); }
+	VKTINY_TARGET("sse4.1") inline __m128i widen(__m128i value, uint16_t) { return _mm_cvtepu16_epi32(value); }
+
+	VKTINY_TARGET("avx2") inline __m256i widen2(__m128i value, int8_t) { return _mm256_cvtepi8_epi32(value); }
+	VKTINY_TARGET("avx2") inline __m256i widen2(__m128i value, uint8_t) { return _mm256_cvtepu8_epi32(value); }
+	VKTINY_TARGET("avx2") inline __m256i widen2(__m128i value, int16_t) { return _mm256_cvtepi16_epi32(value); }
+	VKTINY_TARGET("avx2") inline __m256i widen2(__m128i value, uint16_t) { return _mm256_cvtepu16_epi32(value); }
+
+	// Elements that might end less than a full load before the end of the accessor are copied to a zeroed buffer first
+	inline const unsigned char* elementData(const vkbase::AccessorSource& source, size_t index, size_t wideCount, size_t elementSize, unsigned char* tail) {
+		const unsigned char* element = source.data + index * source.stride;
+		if (index < wideCount) {
+			return element;
+		}
+		memset(tail, 0, 16);
+		memcpy(tail, element, elementSize);
+		return tail;
+	}
+
+	// One element per 128 bit register
+	template<typename T>
+	VKTINY_TARGET("sse4.1") void decodeIntegerSse41(const vkbase::AccessorSource& source, const Conversion& conversion, unsigned char* output, size_t outputStride) {
+		const size_t elementSize = source.componentCount * sizeof(T);
+		const size_t wideCount = wideLoadCount(source, elementSize, sizeof(T) * 4);
+		const __m128 scale = _mm_set1_ps(conversion.scale);
+		const __m128 minimum = _mm_set1_ps(conversion.minimum);
+		unsigned char tail[16];
+		for (size_t i = 0; i < source.count; i++) {
+			const unsigned char* element = elementData(source, i, wideCount, elementSize, tail);
+			__m128 value = _mm_cvtepi32_ps(widen(loadElement(element, sizeof(T)), T()));
+			storeComponents(output + i * outputStride, _mm_max_ps(_mm_mul_ps(value, scale), minimum), source.componentCount);
+		}
+	}
+
+	void decodeFloatSse41(const vkbase::AccessorSource& source, const Conversion&, unsigned char* output, size_t outputStride) {
+		const size_t elementSize = source.componentCount * sizeof(float);
+		const size_t wideCount = wideLoadCount(source, elementSize, 16);
+		unsigned char tail[16];
+		for (size_t i = 0; i < source.count; i++) {
+			const unsigned char* element = elementData(source, i, wideCount, elementSize, tail);
+			storeComponents(output + i * outputStride, _mm_loadu_ps(reinterpret_cast<const float*>(element)), source.componentCount);
+		}
+	}
+
+	// Two elements per 256 bit register
+	template<typename T>
+	VKTINY_TARGET("avx2") void decodeIntegerAvx2(const vkbase::AccessorSource& source, const Conversion& conversion, unsigned char* output, size_t outputStride) {
+		const size_t elementSize = source.componentCount * sizeof(T);
+		const size_t wideCount = wideLoadCount(source, elementSize, sizeof(T) * 4);
+		const __m256 scale = _mm256_set1_ps(conversion.scale);
+		const __m256 minimum = _mm256_set1_ps(conversion.minimum);
+		unsigned char tail[16];
+		unsigned char nextTail[16];
+		for (size_t i = 0; i < source.count; i += 2) {
+			const unsigned char* element = elementData(source, i, wideCount, elementSize, tail);
+			const unsigned char* next = i + 1 < source.count ? elementData(source, i + 1, wideCount, elementSize, nextTail) : element;
+			__m128i first = loadElement(element, sizeof(T));
+			__m128i second = loadElement(next, sizeof(T));
+			__m128i packed = sizeof(T) == 1 ? _mm_unpacklo_epi32(first, second) : _mm_unpacklo_epi64(first, second);
+			__m256 value = _mm256_max_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(widen2(packed, T())), scale), minimum);
+			storeComponents(output + i * outputStride, _mm256_castps256_ps128(value), source.componentCount);
+			if (i + 1 < source.count) {
+				storeComponents(output + (i + 1) * outputStride, _mm256_extractf128_ps(value, 1), source.componentCount);
+			}
+		}
+	}
+
+	VKTINY_TARGET("avx2,f16c") void decodeHalfAvx2(const vkbase::AccessorSource& source, const Conversion&, unsigned char* output, size_t outputStride) {
+		const size_t elementSize = source.componentCount * sizeof(uint16_t);
+		const size_t wideCount = wideLoadCount(source, elementSize, 8);
+		unsigned char tail[16];
+		unsigned char nextTail[16];
+		for (size_t i = 0; i < source.count; i += 2) {
+			const unsigned char* element = elementData(source, i, wideCount, elementSize, tail);
+			const unsigned char* next = i + 1 < source.count ? elementData(source, i + 1, wideCount, elementSize, nextTail) : element;
+			__m128i packed = _mm_unpacklo_epi64(loadElement(element, 2), loadElement(next, 2));
+			__m256 value = _mm256_cvtph_ps(packed);
+			storeComponents(output + i * outputStride, _mm256_castps256_ps128(value), source.componentCount);
+			if (i + 1 < source.count) {
+				storeComponents(output + (i + 1) * outputStride, _mm256_extractf128_ps(value, 1), source.componentCount);
+			}
+		}
+	}
+
+	vkbase::DecodeIsa detectDecodeIsa() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool f16c = (info[2] & (1 << 29)) != 0;
+		// the OS has to save the AVX registers
+		bool avxState = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		bool avx2 = avxState && (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		bool sse41 = __builtin_cpu_supports("sse4.1");
+		bool f16c = __builtin_cpu_supports("f16c");
+		bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+		if (avx2 && f16c) {
+			return vkbase::DecodeIsa::AVX2;
+		}
+		return sse41 ? vkbase::DecodeIsa::SSE41 : vkbase::DecodeIsa::Scalar;
+	}
+
+#endif
+
+	// Kernels per component type and instruction set (Scalar, SSE41, AVX2)
+	struct KernelEntry {
+		int componentType;
+		uint32_t componentSize;
+		// full range of the type, used to map normalized integers to [-1, 1] or [0, 1]
+		float normalizedRange;
+		bool isSigned;
+		DecodeKernel kernels[static_cast<size_t>(vkbase::DecodeIsa::Count)];
+	};
+
+#ifdef VKTINY_DECODE_SIMD
+#define VKTINY_KERNELS(scalar, sse41, avx2) { scalar, sse41, avx2 }
+#else
+#define VKTINY_KERNELS(scalar, sse41, avx2) { scalar, scalar, scalar }
+#endif
+
+	// Component types use the GL enums like glTF (5120 BYTE, 5121 UNSIGNED_BYTE, 5122 SHORT, 5123 UNSIGNED_SHORT, 5126 FLOAT)
+	const KernelEntry kernelTable[] = {
+		{ 5126, 4, 1.0f, true, VKTINY_KERNELS(decodeFloatScalar, decodeFloatSse41, decodeFloatSse41) },
+		{ vkbase::COMPONENT_TYPE_HALF_FLOAT, 2, 1.0f, true, VKTINY_KERNELS(decodeHalfScalar, decodeHalfScalar, decodeHalfAvx2) },
+		{ 5120, 1, 127.0f, true, VKTINY_KERNELS(decodeIntegerScalar<int8_t>, decodeIntegerSse41<int8_t>, decodeIntegerAvx2<int8_t>) },
+		{ 5121, 1, 255.0f, false, VKTINY_KERNELS(decodeIntegerScalar<uint8_t>, decodeIntegerSse41<uint8_t>, decodeIntegerAvx2<uint8_t>) },
+		{ 5122, 2, 32767.0f, true, VKTINY_KERNELS(decodeIntegerScalar<int16_t>, decodeIntegerSse41<int16_t>, decodeIntegerAvx2<int16_t>) },
+		{ 5123, 2, 65535.0f, false, VKTINY_KERNELS(decodeIntegerScalar<uint16_t>, decodeIntegerSse41<uint16_t>, decodeIntegerAvx2<uint16_t>) },
+	};
+
+	const KernelEntry* findKernels(int componentType) {
+		for (const KernelEntry& entry : kernelTable) {
+			if (entry.componentType == componentType) {
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+}
+
+
+namespace vkbase {
+
+	DecodeIsa bestDecodeIsa() {
+#ifdef VKTINY_DECODE_SIMD
+		static const DecodeIsa isa = detectDecodeIsa();
+		return isa;
+#else
+		return DecodeIsa::Scalar;
+#endif
+	}
+
+	const char* decodeIsaName(DecodeIsa isa) {
+		switch (isa) {
+		case DecodeIsa::SSE41:
+			return "SSE4.1";
+		case DecodeIsa::AVX2:
+			return "AVX2";
+		default:
+			return "scalar";
+		}
+	}
+
+	bool decodeAccessor(const AccessorSource& source, float* destination, size_t destinationStride, DecodeIsa isa) {
+		const KernelEntry* entry = findKernels(source.componentType);
+		if (!entry || source.componentCount == 0 || source.componentCount > 4) {
+			return false;
+		}
+
+		AccessorSource strided = source;
+		if (strided.stride == 0) {
+			strided.stride = entry->componentSize * source.componentCount;
+		}
+
+		// Integers that are not normalized keep their value (KHR_mesh_quantization positions, the node transform scales them)
+		Conversion conversion = { 1.0f, -FLT_MAX };
+		if (source.normalized && entry->normalizedRange != 1.0f) {
+			conversion.scale = 1.0f / entry->normalizedRange;
+			conversion.minimum = entry->isSigned ? -1.0f : 0.0f;
+		}
+
+		// Never run kernels the CPU does not support
+		isa = std::min(isa, bestDecodeIsa());
+		entry->kernels[static_cast<size_t>(isa)](strided, conversion, reinterpret_cast<unsigned char*>(destination), destinationStride);
+		return true;
+	}
+
+#ifdef VKTINY_BENCHMARK
+	void benchmarkAccessorDecoding() {
+
+		// Interleaved source (stride of a typical quantized vertex) decoded into a Vertex sized destination
+		const size_t count = 1 << 20;
+		const size_t sourceStride = 20;
+		const size_t destinationStride = 60;
+		std::vector<unsigned char> sourceData(count * sourceStride + 16);
+		uint32_t random = 1;
+		for (unsigned char& byte : sourceData) {
+			random = random * 1664525u + 1013904223u;
+			byte = static_cast<unsigned char>(random >> 24);
+		}
+		// Keep the half floats finite, NaN payloads are not compared bit exact
+		for (size_t i = 1; i < sourceData.size(); i += 2) {
+			sourceData[i] &= 0x7b;
+		}
+
+		std::vector<unsigned char> reference(count * destinationStride);
+		std::vector<unsigned char> result(count * destinationStride);
+
+		printf("accessor decoding benchmark: %zu elements, best instruction set %s\n", count, decodeIsaName(bestDecodeIsa()));
+		for (const KernelEntry& entry : kernelTable) {
+			for (uint32_t componentCount = 2; componentCount <= 4; componentCount++) {
+				if (entry.componentSize * componentCount > sourceStride) {
+					continue;
+				}
+				AccessorSource source{ sourceData.data(), count, sourceStride, entry.componentType, componentCount, entry.normalizedRange != 1.0f };
+				decodeAccessor(source, reinterpret_cast<float*>(reference.data()), destinationStride, DecodeIsa::Scalar);
+
+				printf("  type %4d x%u:", entry.componentType, componentCount);
+				for (uint32_t isa = 0; isa <= static_cast<uint32_t>(bestDecodeIsa()); isa++) {
+					double bestMs = 0.0;
+					for (int run = 0; run < 5; run++) {
+						auto start = std::chrono::high_resolution_clock::now();
+						decodeAccessor(source, reinterpret_cast<float*>(result.data()), destinationStride, static_cast<DecodeIsa>(isa));
+						double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+						bestMs = (run == 0) ? ms : std::min(bestMs, ms);
+					}
+					bool identical = memcmp(result.data(), reference.data(), result.size()) == 0;
+					printf(" %s %.3f ms%s", decodeIsaName(static_cast<DecodeIsa>(isa)), bestMs, identical ? "" : " MISMATCH");
+				}
+				printf("\n");
+			}
+		}
+	}
+#endif
+
+}
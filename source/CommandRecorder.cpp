@@ -0,0 +1,120 @@
+#include "../include/CommandRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+
+namespace vkbase {
+
+	CommandRecorder::CommandRecorder(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t threadCount)
+		: device(device), threads(std::max(1u, threadCount)), frames(framesInFlight) {
+
+		if (threads > 1) {
+			workers = std::make_unique<ThreadPool>(threads - 1);
+		}
+
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndex;
+		// Buffers are short lived, they are reset with their pool every time the frame is recorded
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		for (Frame& frame : frames) {
+			frame.pools.resize(threads, VK_NULL_HANDLE);
+			frame.commandBuffers.resize(threads, VK_NULL_HANDLE);
+			for (uint32_t i = 0; i < threads; i++) {
+				if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.pools[i]) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create recording command pool");
+				}
+
+				VkCommandBufferAllocateInfo allocInfo = {};
+				allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocInfo.commandPool = frame.pools[i];
+				allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				allocInfo.commandBufferCount = 1;
+				if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffers[i]) != VK_SUCCESS) {
+					throw std::runtime_error("failed to allocate recording command buffers");
+				}
+			}
+		}
+	}
+
+	CommandRecorder::~CommandRecorder() {
+		workers.reset();
+		for (Frame& frame : frames) {
+			// Destroying a pool frees its buffers
+			for (VkCommandPool pool : frame.pools) {
+				vkDestroyCommandPool(device, pool, nullptr);
+			}
+		}
+	}
+
+	const std::vector<VkCommandBuffer>& CommandRecorder::record(uint32_t frameIndex, const VkCommandBufferInheritanceInfo& inheritance, size_t itemCount,
+		const RecordRange& recordRange, uint32_t maxThreads) {
+
+		Frame& frame = frames[frameIndex];
+
+		// Even ranges, the draws are sorted by state so their cost per item is about the same
+		size_t rangeCount = std::max<size_t>(1, (itemCount + std::max<size_t>(1, minItemsPerThread) - 1) / std::max<size_t>(1, minItemsPerThread));
+		rangeCount = std::min<size_t>(rangeCount, std::min(threads, std::max(1u, maxThreads)));
+
+		std::vector<VkResult> results(rangeCount, VK_SUCCESS);
+		std::vector<std::exception_ptr> errors(rangeCount);
+		lastRangeMs.assign(rangeCount, 0.0);
+
+		auto recordOne = [&](size_t range) {
+			auto start = std::chrono::high_resolution_clock::now();
+			size_t first = itemCount * range / rangeCount;
+			size_t last = itemCount * (range + 1) / rangeCount;
+
+			VkResult result = vkResetCommandPool(device, frame.pools[range], 0);
+
+			VkCommandBufferBeginInfo beginInfo = {};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &inheritance;
+			if (result == VK_SUCCESS) {
+				result = vkBeginCommandBuffer(frame.commandBuffers[range], &beginInfo);
+			}
+			if (result == VK_SUCCESS) {
+				// An exception must not escape a worker, it is kept for the calling thread like the Vulkan errors
+				try {
+					recordRange(frame.commandBuffers[range], first, last - first);
+				}
+				catch (...) {
+					errors[range] = std::current_exception();
+				}
+				if (!errors[range]) {
+					result = vkEndCommandBuffer(frame.commandBuffers[range]);
+				}
+			}
+
+			results[range] = result;
+			lastRangeMs[range] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		};
+
+		if (workers && rangeCount > 1) {
+			workers->parallelFor(rangeCount, recordOne);
+		}
+		else {
+			for (size_t range = 0; range < rangeCount; range++) {
+				recordOne(range);
+			}
+		}
+
+		frame.recorded.clear();
+		for (size_t range = 0; range < rangeCount; range++) {
+			if (errors[range]) {
+				std::rethrow_exception(errors[range]);
+			}
+			if (results[range] != VK_SUCCESS) {
+				throw std::runtime_error("failed to record secondary command buffer");
+			}
+			frame.recorded.push_back(frame.commandBuffers[range]);
+		}
+		return frame.recorded;
+	}
+
+}
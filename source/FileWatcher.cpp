@@ -0,0 +1,142 @@
+#include "../include/FileWatcher.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+	// Splits a path into its directory and file name, "." for paths without a directory
+	void splitPath(const std::string& path, std::string& directory, std::string& name) {
+		std::size_t found = path.find_last_of("/\\");
+		if (found == std::string::npos) {
+			directory = ".";
+			name = path;
+		}
+		else {
+			directory = path.substr(0, found);
+			name = path.substr(found + 1);
+		}
+	}
+
+}
+
+
+namespace vkbase {
+
+	FileWatcher::FileWatcher() {
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	FileWatcher::~FileWatcher() {
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			close(inotifyFd);
+		}
+#endif
+	}
+
+	bool FileWatcher::fileState(const std::string& filename, FileState& state) {
+		struct stat fileStat;
+		if (stat(filename.c_str(), &fileStat) != 0) {
+			return false;
+		}
+		state.size = static_cast<uint64_t>(fileStat.st_size);
+#ifdef __linux__
+		state.modifiedTime = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+#else
+		state.modifiedTime = static_cast<int64_t>(fileStat.st_mtime);
+#endif
+		return true;
+	}
+
+	bool FileWatcher::watch(const std::vector<std::string>& watchedFiles) {
+		files.clear();
+		for (const std::string& file : watchedFiles) {
+			FileState state;
+			fileState(file, state);
+			files[file] = state;
+		}
+
+#ifdef __linux__
+		if (inotifyFd < 0) {
+			return !files.empty();
+		}
+
+		for (const auto& directory : directories) {
+			inotify_rm_watch(inotifyFd, directory.first);
+		}
+		directories.clear();
+
+		bool watching = false;
+		for (const auto& file : files) {
+			std::string directory, name;
+			splitPath(file.first, directory, name);
+
+			// Adding a directory twice returns its existing watch descriptor
+			int wd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (wd >= 0) {
+				directories[wd] = directory;
+				watching = true;
+			}
+		}
+		return watching;
+#else
+		return !files.empty();
+#endif
+	}
+
+	std::vector<std::string> FileWatcher::poll() {
+		std::vector<std::string> changed;
+
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			alignas(inotify_event) char buffer[4096];
+			for (;;) {
+				ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+				if (length <= 0) {
+					break;
+				}
+				for (ssize_t offset = 0; offset < length;) {
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+					offset += sizeof(inotify_event) + event->len;
+
+					auto directory = directories.find(event->wd);
+					if (directory == directories.end() || event->len == 0) {
+						continue;
+					}
+					std::string file = directory->second + '/' + event->name;
+					if (!files.count(file) && directory->second == ".") {
+						file = event->name;
+					}
+					if (files.count(file) && std::find(changed.begin(), changed.end(), file) == changed.end()) {
+						changed.push_back(file);
+					}
+				}
+			}
+			for (const std::string& file : changed) {
+				fileState(file, files[file]);
+			}
+			return changed;
+		}
+#endif
+
+		for (auto& file : files) {
+			FileState state;
+			if (fileState(file.first, state) && (state.size != file.second.size || state.modifiedTime != file.second.modifiedTime)) {
+				file.second = state;
+				changed.push_back(file.first);
+			}
+		}
+		return changed;
+	}
+
+}
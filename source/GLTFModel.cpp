@@ -16,7 +16,14 @@
 #define STBI_MSC_SECURE_CRT
 
 #include "../include/GLTFModel.h"
+#include "../include/Hash.h"
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
 
 
 
@@ -38,6 +45,39 @@ bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::s
 	return true;
 }
 
+// CPU only model a hot reload decodes the new scene into, it never creates Vulkan objects
+class GLTFSceneParser : public GLTFBase {
+
+public:
+	GLTFSceneParser(const vkbase::LoaderSettings& settings) : GLTFBase("", VK_NULL_HANDLE, settings) {
+		// Changed images are staged by the reloaded model itself
+		loader.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	}
+
+	VkDescriptorImageInfo getTextureDescriptor(const size_t index) override {
+		return {};
+	}
+
+protected:
+	int loadImages(tinygltf::Model& model) override {
+		return 0;
+	}
+};
+
+// Mesh processing (optimization, clusters, levels of detail) needs indexed triangle lists with valid indices
+static bool isTriangleList(const vkbase::PrimitiveDecodeInfo& info, const uint32_t* indexBuffer)
+{
+	if (info.primitive->mode != TINYGLTF_MODE_TRIANGLES || info.indexCount % 3 != 0) {
+		return false;
+	}
+	for (uint32_t i = 0; i < info.indexCount; i++) {
+		if (indexBuffer[i] >= info.vertexCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
 
 int GLTFBase::loadTextures(tinygltf::Model& model) {
 	textures.resize(model.textures.size());
@@ -49,107 +89,82 @@ int GLTFBase::loadTextures(tinygltf::Model& model) {
 
 
 void GLTFBase::createVertexBuffers(void) {
-
-	VkDeviceSize vertexBufferSize = vertices.size() * sizeof(Vertex);
-	VmaAllocationInfo stagingVertexBufferAllocInfo = {};
-
-	std::unique_ptr<vkbase::Buffer> staging_buffer = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
-	global_allocator->createBuffer(staging_buffer.get(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &stagingVertexBufferAllocInfo, vertexBufferSize);
-
-	memcpy(stagingVertexBufferAllocInfo.pMappedData, vertices.data(), vertices.size() * sizeof(vertices[0]));
-
-	vertexBuffer = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
-	global_allocator->createBuffer(vertexBuffer.get(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, nullptr, vertexBufferSize);
-
-	VkBufferCopy vbCopyRegion = {};
-	vbCopyRegion.srcOffset = 0;
-	vbCopyRegion.dstOffset = 0;
-	vbCopyRegion.size = vertexBufferSize;
-
-	VkCommandBufferAllocateInfo cmdBufferInfo = {};
-	cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmdBufferInfo.commandBufferCount = 1;
-	cmdBufferInfo.commandPool = global_device->command_pool;
-
-	VkCommandBuffer tmpCommandBuffer;
-	if (vkAllocateCommandBuffers(global_device->logicalDevice, &cmdBufferInfo, &tmpCommandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate temp command buffer");
+	if (settings.vertexFormat == vkbase::VertexFormat::Packed) {
+		vertexBuffer = stageBuffer(packedVertices.data(), packedVertices.size() * sizeof(vkbase::PackedVertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 	}
+	else {
+		vertexBuffer = stageBuffer(vertices.data(), vertices.size() * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	}
+}
 
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	//begin recording
-	vkBeginCommandBuffer(tmpCommandBuffer, &beginInfo);
-	vkCmdCopyBuffer(tmpCommandBuffer, staging_buffer->buffer, vertexBuffer->buffer, 1, &vbCopyRegion);
-	vkEndCommandBuffer(tmpCommandBuffer);
 
-	//now submit
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &tmpCommandBuffer;
+void GLTFBase::createIndexBuffers(void) {
 
-	vkQueueSubmit(copyQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(copyQueue);
+	//TODO: is this needed?
+	bufferIndices.count = static_cast<uint32_t>(indices.size() + indices16.size());
 
-	vkFreeCommandBuffers(global_device->logicalDevice, global_device->command_pool, 1, &tmpCommandBuffer);
+	if (!indices.empty()) {
+		indexBuffer = stageBuffer(indices.data(), indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	}
+	if (!indices16.empty()) {
+		indexBuffer16 = stageBuffer(indices16.data(), indices16.size() * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	}
 }
 
 
-void GLTFBase::createIndexBuffers(void) {
-
-	VkDeviceSize indexBufferSize = indices.size() * sizeof(uint32_t);
-	VmaAllocationInfo stagingIndexBufferAllocInfo = {};
+std::unique_ptr<vkbase::Buffer> GLTFBase::stageBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage) {
 
-	//TODO: is this needed?
-	bufferIndices.count = static_cast<uint32_t>(indices.size());
+	VmaAllocationInfo stagingBufferAllocInfo = {};
 
-	std::unique_ptr<vkbase::Buffer> staging_buffer = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
-	global_allocator->createBuffer(staging_buffer.get(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &stagingIndexBufferAllocInfo, indexBufferSize);
-	memcpy(stagingIndexBufferAllocInfo.pMappedData, indices.data(), indices.size() * sizeof(indices[0]));
+	vkbase::BufferUpload upload;
+	upload.staging = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
+	global_allocator->createBuffer(upload.staging.get(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &stagingBufferAllocInfo, size);
 
-	indexBuffer = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
-	global_allocator->createBuffer(indexBuffer.get(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, nullptr, indexBufferSize);
+	memcpy(stagingBufferAllocInfo.pMappedData, data, size);
 
-	//copy via command buffer
-	VkBufferCopy vbCopyRegion = {};
-	vbCopyRegion.srcOffset = 0;
-	vbCopyRegion.dstOffset = 0;
-	vbCopyRegion.size = indexBufferSize;
+	std::unique_ptr<vkbase::Buffer> buffer = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
+	global_allocator->createBuffer(buffer.get(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VMA_MEMORY_USAGE_GPU_ONLY, nullptr, size);
 
-	VkCommandBufferAllocateInfo cmdBufferInfo = {};
-	cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	cmdBufferInfo.commandBufferCount = 1;
-	cmdBufferInfo.commandPool = global_device->command_pool;
+	upload.destination = buffer->buffer;
+	upload.size = size;
+	pendingUploads.push_back(std::move(upload));
 
-	VkCommandBuffer tmpCommandBuffer;
-	if (vkAllocateCommandBuffers(global_device->logicalDevice, &cmdBufferInfo, &tmpCommandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate temp command buffer");
-	}
+	return buffer;
+}
 
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+void GLTFBase::recordUploads(VkCommandBuffer cmd) {
 
-	//begin recording
-	vkBeginCommandBuffer(tmpCommandBuffer, &beginInfo);
-	vkCmdCopyBuffer(tmpCommandBuffer, staging_buffer->buffer, indexBuffer->buffer, 1, &vbCopyRegion);
-	vkEndCommandBuffer(tmpCommandBuffer);
+	for (const vkbase::BufferUpload& upload : pendingUploads) {
+		if (!upload.regions.empty()) {
+			vkCmdCopyBuffer(cmd, upload.staging->buffer, upload.destination, static_cast<uint32_t>(upload.regions.size()), upload.regions.data());
+			continue;
+		}
+		VkBufferCopy copyRegion = {};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = 0;
+		copyRegion.size = upload.size;
+		vkCmdCopyBuffer(cmd, upload.staging->buffer, upload.destination, 1, &copyRegion);
+	}
 
-	//now submit
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &tmpCommandBuffer;
+	// Draws submitted after the upload read the copied vertices and indices
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-	vkQueueSubmit(copyQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(copyQueue);
+	recordImageUploads(cmd);
+	if (placeholderImage) {
+		placeholderImage->recordUpload(cmd);
+	}
+}
 
-	vkFreeCommandBuffers(global_device->logicalDevice, global_device->command_pool, 1, &tmpCommandBuffer);
+void GLTFBase::finishUploads(void) {
+	pendingUploads.clear();
+	finishImageUploads();
+	if (placeholderImage) {
+		placeholderImage->finishUpload();
+	}
 }
 
 int GLTFBase::loadMaterials(tinygltf::Model& model) {
@@ -180,319 +195,2505 @@ int GLTFBase::loadMaterials(tinygltf::Model& model) {
 	return 0;
 }
 
-void GLTFBase::drawNode(VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout, vkbase::Node node) {
+void GLTFBase::collectInstances(std::vector<std::vector<glm::mat4>>& transforms) {
 
-	if (!node.visible) {
-		return;
+	nodes.updateWorldMatrices();
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		if (nodes.mesh(i) > -1 && nodes.visible(i)) {
+			transforms[nodes.mesh(i)].push_back(nodes.worldMatrix(i));
+		}
 	}
+}
+
+void GLTFBase::updateInstances(uint32_t frame) {
+
+	std::vector<std::vector<glm::mat4>> transforms(meshes.size());
+	collectInstances(transforms);
+
+	// Instances of the same mesh are stored next to each other, so each primitive is a single instanced draw per level of detail
+	instanceTransforms.clear();
+	meshInstances.assign(meshes.size(), {});
+	std::vector<float> levelErrors;
+	std::vector<uint32_t> instanceLevels;
+	for (size_t i = 0; i < meshes.size(); i++) {
+		meshInstances[i].firstInstance = static_cast<uint32_t>(instanceTransforms.size());
+		meshInstances[i].instanceCount = static_cast<uint32_t>(transforms[i].size());
+
+		// A level's error is the largest error of any primitive at that level
+		uint32_t levelCount = 1;
+		for (const vkbase::Primitive& primitive : meshes[i].primitives) {
+			levelCount = std::max(levelCount, primitive.lodCount + 1);
+		}
+		levelErrors.assign(levelCount, 0.0f);
+		for (const vkbase::Primitive& primitive : meshes[i].primitives) {
+			for (uint32_t level = 1; level < levelErrors.size(); level++) {
+				levelErrors[level] = std::max(levelErrors[level], primitiveLod(primitive, level).error);
+			}
+		}
 
-	if (node.mesh.primitives.size() > 0) {
-		// Pass the node's matrix via push constants
-		// Traverse the node hierarchy to the top-most parent to get the final matrix of the current node
-		glm::mat4 nodeMatrix = node.matrix;
-		vkbase::Node* currentParent = node.parent;
-		while (currentParent) {
-			nodeMatrix = currentParent->matrix * nodeMatrix;
-			currentParent = currentParent->parent;
+		instanceLevels.resize(transforms[i].size());
+		meshInstances[i].nearestDistance = std::numeric_limits<float>::max();
+		meshInstances[i].farthestDistance = 0.0f;
+		for (size_t j = 0; j < transforms[i].size(); j++) {
+			instanceLevels[j] = selectLod(meshes[i], levelErrors, transforms[i][j]);
+			meshInstances[i].levelCounts[instanceLevels[j]]++;
+
+			glm::vec3 center = glm::vec3(lodView.sceneMatrix * transforms[i][j] * glm::vec4(glm::vec3(meshes[i].boundingSphere), 1.0f));
+			float distance = glm::length(center - lodView.cameraPosition);
+			meshInstances[i].nearestDistance = std::min(meshInstances[i].nearestDistance, distance);
+			meshInstances[i].farthestDistance = std::max(meshInstances[i].farthestDistance, distance);
 		}
-		// Pass the final matrix to the vertex shader using push constants
-		//vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
-		for (vkbase::Primitive& primitive : node.mesh.primitives) {
-			if (primitive.indexCount > 0) {
-				vkbase::Material& material = materials[primitive.materialIndex];
-				// POI: Bind the pipeline for the node's material
-				vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
-				vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &material.descriptorSet, 0, nullptr);
-				vkCmdDrawIndexed(cmdBuffer, primitive.indexCount, 1, primitive.firstIndex, 0, 0);
+
+		// Packed positions are dequantized by the instance matrix
+		glm::mat4 dequantize = glm::scale(glm::translate(glm::mat4(1.0f), meshes[i].positionOffset), glm::vec3(meshes[i].positionScale));
+		for (uint32_t level = 0; level < levelErrors.size(); level++) {
+			for (size_t j = 0; j < transforms[i].size(); j++) {
+				if (instanceLevels[j] == level) {
+					instanceTransforms.push_back(transforms[i][j] * dequantize);
+				}
 			}
 		}
 	}
-	for (auto& child : node.children) {
-		drawNode(cmdBuffer, pipelineLayout, child);
+
+	if (instanceTransforms.empty()) {
+		return;
+	}
+
+	if (instanceBuffers.size() <= frame) {
+		instanceBuffers.resize(frame + 1);
+	}
+	InstanceBuffer& instances = instanceBuffers[frame];
+	if (!instances.buffer || instances.capacity < instanceTransforms.size()) {
+		instances.buffer = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
+		global_allocator->createBuffer(instances.buffer.get(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &instances.allocInfo, instanceTransforms.size() * sizeof(glm::mat4));
+		instances.capacity = instanceTransforms.size();
+	}
+	memcpy(instances.allocInfo.pMappedData, instanceTransforms.data(), instanceTransforms.size() * sizeof(glm::mat4));
+}
+
+uint32_t GLTFBase::selectLod(const vkbase::Mesh& mesh, const std::vector<float>& levelErrors, const glm::mat4& transform) const {
+
+	if (lodView.projectionScale <= 0.0f || levelErrors.size() < 2) {
+		return 0;
+	}
+
+	// Errors scale with the largest axis of the instance, the distance is measured to the bounding sphere
+	glm::mat4 world = lodView.sceneMatrix * transform;
+	float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+	glm::vec3 center = glm::vec3(world * glm::vec4(glm::vec3(mesh.boundingSphere), 1.0f));
+	float distance = glm::length(center - lodView.cameraPosition) - mesh.boundingSphere.w * scale;
+	if (distance <= 0.0f) {
+		return 0;
+	}
+
+	uint32_t level = 0;
+	while (level + 1 < levelErrors.size() && levelErrors[level + 1] * scale / distance * lodView.projectionScale <= lodView.errorThreshold) {
+		level++;
+	}
+	return level;
+}
+
+vkbase::PrimitiveLod GLTFBase::primitiveLod(const vkbase::Primitive& primitive, uint32_t level) const {
+	return primitiveLod(primitive, level, lods);
+}
+
+vkbase::PrimitiveLod GLTFBase::primitiveLod(const vkbase::Primitive& primitive, uint32_t level, const std::vector<vkbase::PrimitiveLod>& lodTable) const {
+	if (level == 0 || primitive.lodCount == 0) {
+		return { primitive.firstIndex, primitive.indexCount, 0.0f };
+	}
+	return lodTable[primitive.firstLod + std::min(level, primitive.lodCount) - 1];
+}
+
+uint64_t GLTFBase::prepareBind(uint32_t frame) {
+
+	updateInstances(frame);
+	if (instanceTransforms.empty()) {
+		renderQueue.clear();
+		return 0;
+	}
+	if (drawListDirty) {
+		compileDrawList();
 	}
 
+	// Opaque draws go front to back grouped by state, blended ones back to front
+	renderQueue.clear();
+	for (uint32_t i = 0; i < drawPackets.size(); i++) {
+		const vkbase::DrawPacket& packet = drawPackets[i];
+		const vkbase::MeshInstances& instances = meshInstances[packet.mesh];
+		// Packets of materials whose pipeline is still compiling are left out until it is ready
+		if (instances.instanceCount == 0 || packet.pipeline == VK_NULL_HANDLE) {
+			continue;
+		}
+		float depth = packet.pass == vkbase::RenderPass::Blended ? instances.farthestDistance : instances.nearestDistance;
+		renderQueue.push(vkbase::drawSortKey(packet.pass, packet.pipelineId, packet.material, depth), i);
+	}
+	renderQueue.sort();
+
+	// Transforms only change the instance buffer's contents, the draws depend on the order and the instance ranges
+	uint64_t key = vkbase::hashValue(drawListVersion);
+	key = vkbase::hashCombine(key, vkbase::hashValue(instanceBuffers[frame].buffer->buffer));
+	key = vkbase::hashCombine(key, vkbase::hashValue(dynamicCullMode));
+	for (size_t i = 0; i < renderQueue.size(); i++) {
+		const vkbase::MeshInstances& instances = meshInstances[drawPackets[renderQueue.item(i)].mesh];
+		key = vkbase::hashCombine(key, vkbase::hashValue(renderQueue.item(i)));
+		key = vkbase::hashCombine(key, vkbase::hashValue(instances.firstInstance));
+		key = vkbase::hashCombine(key, vkbase::hashBytes(instances.levelCounts, sizeof(instances.levelCounts)));
+	}
+	return key;
 }
 
-void GLTFBase::bind(VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout) {
+vkbase::RenderQueueStats GLTFBase::recordBind(VkCommandBuffer cmdBuffer, VkPipelineLayout pipelineLayout, uint32_t frame, size_t first, size_t count) const {
+
+	vkbase::RenderQueueStats stats;
+	size_t last = std::min(first + count, renderQueue.size());
+	if (first >= last) {
+		return stats;
+	}
 
 	VkDeviceSize offsets[1] = { 0 };
-	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &(vertexBuffer->buffer), offsets);
-	vkCmdBindIndexBuffer(cmdBuffer, (indexBuffer->buffer), 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindVertexBuffers(cmdBuffer, INSTANCE_BUFFER_BIND_ID, 1, &(instanceBuffers[frame].buffer->buffer), offsets);
+
+	// State is only rebound when it differs from the previous packet
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+	VkCullModeFlags boundCullMode = VK_CULL_MODE_FLAG_BITS_MAX_ENUM;
+	for (size_t i = first; i < last; i++) {
+		const vkbase::DrawPacket& packet = drawPackets[renderQueue.item(i)];
+		const vkbase::MeshInstances& instances = meshInstances[packet.mesh];
+		stats.packets++;
+		if (packet.vertexBuffer != boundVertexBuffer) {
+			vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &packet.vertexBuffer, offsets);
+			boundVertexBuffer = packet.vertexBuffer;
+			stats.vertexBufferBinds++;
+		}
+		if (packet.indexBuffer != boundIndexBuffer || packet.indexType != boundIndexType) {
+			vkCmdBindIndexBuffer(cmdBuffer, packet.indexBuffer, 0, packet.indexType);
+			boundIndexBuffer = packet.indexBuffer;
+			boundIndexType = packet.indexType;
+			stats.indexBufferBinds++;
+		}
+		// POI: Bind the pipeline for the primitive's material
+		if (packet.pipeline != boundPipeline) {
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+			boundPipeline = packet.pipeline;
+			stats.pipelineBinds++;
+		}
+		if (packet.descriptorSet != boundDescriptorSet) {
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &packet.descriptorSet, 0, nullptr);
+			boundDescriptorSet = packet.descriptorSet;
+			stats.descriptorSetBinds++;
+		}
+#ifdef VK_EXT_extended_dynamic_state
+		if (dynamicCullMode && packet.cullMode != boundCullMode) {
+			global_device->cmdSetCullMode(cmdBuffer, packet.cullMode);
+			boundCullMode = packet.cullMode;
+		}
+#endif
+
+		// Consecutive levels that map to the same index range (coarser than the primitive's last level) share a draw
+		const vkbase::PrimitiveLod* levels = &drawLevels[packet.firstLevel];
+		const vkbase::PrimitiveLod* range = nullptr;
+		uint32_t firstInstance = instances.firstInstance;
+		uint32_t instanceCount = 0;
+		uint32_t nextInstance = instances.firstInstance;
+		for (uint32_t level = 0; level < vkbase::MAX_LOD_LEVELS; level++) {
+			if (instances.levelCounts[level] == 0) {
+				continue;
+			}
+			const vkbase::PrimitiveLod* levelRange = &levels[std::min(level, packet.levelCount - 1)];
+			if (instanceCount > 0 && levelRange->firstIndex == range->firstIndex && levelRange->indexCount == range->indexCount) {
+				instanceCount += instances.levelCounts[level];
+			}
+			else {
+				if (instanceCount > 0) {
+					vkCmdDrawIndexed(cmdBuffer, range->indexCount, instanceCount, range->firstIndex, packet.vertexOffset, firstInstance);
+					stats.draws++;
+				}
+				range = levelRange;
+				firstInstance = nextInstance;
+				instanceCount = instances.levelCounts[level];
+			}
+			nextInstance += instances.levelCounts[level];
+		}
+		if (instanceCount > 0) {
+			vkCmdDrawIndexed(cmdBuffer, range->indexCount, instanceCount, range->firstIndex, packet.vertexOffset, firstInstance);
+			stats.draws++;
+		}
+	}
+
+	stats.pipelineBindsAvoided = stats.packets - stats.pipelineBinds;
+	stats.descriptorSetBindsAvoided = stats.packets - stats.descriptorSetBinds;
+	return stats;
+}
+
+void GLTFBase::compileDrawList(void) {
+
+	drawPackets.clear();
+	drawLevels.clear();
+
+	// Streamed models draw the meshes of every resident chunk from the chunk's own buffers
+	if (streamCache) {
+		const std::vector<vkbase::StreamChunk>& chunks = streamResidency.chunks();
+		for (uint32_t i = 0; i < chunks.size(); i++) {
+			vkbase::ChunkGeometry& chunk = chunkGeometry[i];
+			if (streamResidency.state(i) != vkbase::ChunkState::Resident || !chunk.vertexBuffer) {
+				continue;
+			}
+			for (size_t j = 0; j < chunk.meshes.size(); j++) {
+				compileMeshDraws(chunk.meshes[j], chunks[i].meshes[j], chunk.lods, chunk.vertexBuffer.get(), chunk.indexBuffer.get(), chunk.indexBuffer16.get());
+			}
+		}
+	}
+	else {
+		// One instanced draw per primitive of every mesh, covering all nodes that reference the mesh
+		for (uint32_t i = 0; i < meshes.size(); i++) {
+			compileMeshDraws(meshes[i], i, lods, vertexBuffer.get(), indexBuffer.get(), indexBuffer16.get());
+		}
+	}
 
-	for (vkbase::Node& node : nodes) {
-		drawNode(cmdBuffer, pipelineLayout, node);
+	// Pipelines are numbered in order of first use for the sort keys
+	std::unordered_map<VkPipeline, uint32_t> pipelineIds;
+	for (vkbase::DrawPacket& packet : drawPackets) {
+		packet.pipelineId = pipelineIds.emplace(packet.pipeline, static_cast<uint32_t>(pipelineIds.size())).first->second;
 	}
+
+	drawListDirty = false;
+	drawListVersion++;
 }
 
-int GLTFBase::loadNode(const tinygltf::Node& inputNode, const tinygltf::Model& input, vkbase::Node* parent, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer) {
+void GLTFBase::compileMeshDraws(const vkbase::Mesh& mesh, uint32_t meshIndex, const std::vector<vkbase::PrimitiveLod>& lodTable,
+	vkbase::Buffer* vertexPool, vkbase::Buffer* pool, vkbase::Buffer* pool16) {
 
-	vkbase::Node node{};
-	node.name = inputNode.name;
+	for (const vkbase::Primitive& primitive : mesh.primitives) {
+		if (primitive.indexCount == 0) {
+			continue;
+		}
+		const vkbase::Material& material = materials[primitive.materialIndex];
+		vkbase::DrawPacket packet{};
+		packet.pipeline = material.pipeline;
+		packet.descriptorSet = material.descriptorSet;
+		packet.vertexBuffer = vertexPool->buffer;
+		packet.indexBuffer = (primitive.indexType == VK_INDEX_TYPE_UINT16 ? pool16 : pool)->buffer;
+		packet.indexType = primitive.indexType;
+		packet.vertexOffset = primitive.vertexOffset;
+		packet.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+		packet.mesh = meshIndex;
+		packet.pass = material.alphaMode == "BLEND" ? vkbase::RenderPass::Blended : material.alphaMode == "MASK" ? vkbase::RenderPass::Masked : vkbase::RenderPass::Opaque;
+		packet.material = static_cast<uint32_t>(primitive.materialIndex);
+		packet.firstLevel = static_cast<uint32_t>(drawLevels.size());
+		packet.levelCount = std::min(primitive.lodCount + 1, vkbase::MAX_LOD_LEVELS);
+		for (uint32_t level = 0; level < packet.levelCount; level++) {
+			drawLevels.push_back(primitiveLod(primitive, level, lodTable));
+		}
+		drawPackets.push_back(packet);
+	}
+}
 
-	// Get the local node matrix
-	// It's either made up from translation, rotation, scale or a 4x4 matrix
-	node.matrix = glm::mat4(1.0f);
+int GLTFBase::loadScene(const tinygltf::Model& input) {
+
+	primitiveDecodes.clear();
+	nodes.clear();
+	vertexTotal = 0;
+	indexTotal = 0;
+	indexTotal16 = 0;
+	meshes.assign(input.meshes.size(), vkbase::Mesh());
+
+	// First pass builds the node hierarchy and assigns every primitive its vertex and index range
+	const tinygltf::Scene& scene = input.scenes[0];
+	for (size_t i = 0; i < scene.nodes.size(); i++) {
+		const tinygltf::Node& node = input.nodes[scene.nodes[i]];
+		if (loadNode(node, input, -1) != 0) {
+			return -1;
+		}
+	}
+
+#ifdef VKTINY_BENCHMARK
+	if (settings.benchmarkDecode) {
+		benchmarkDecode(input);
+	}
+#endif
 
-	if (inputNode.translation.size() == 3) {
-		node.matrix = glm::translate(node.matrix, glm::vec3(glm::make_vec3(inputNode.translation.data())));
+	// Second pass fills the preallocated vertex and index buffers
+	if (decodePrimitives(input, settings.threadCount) != 0) {
+		return -1;
 	}
 
-	if (inputNode.rotation.size() == 4) {
-		glm::quat q = glm::make_quat(inputNode.rotation.data());
-		node.matrix *= glm::mat4(q);
+	if (settings.vertexFormat == vkbase::VertexFormat::Packed) {
+		packVertices(settings.threadCount);
 	}
 
-	if (inputNode.scale.size() == 3) {
-		node.matrix = glm::scale(node.matrix, glm::vec3(glm::make_vec3(inputNode.scale.data())));
+	if (settings.optimizeMeshes) {
+		for (size_t i = 0; i < optimizationStats.size(); i++) {
+			const vkbase::PrimitiveOptimizationStats& stats = optimizationStats[i];
+			if (stats.optimized) {
+				printf("primitive %zu: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", i, stats.before.acmr, stats.after.acmr, stats.before.atvr, stats.after.atvr);
+			}
+		}
 	}
 
+	return 0;
+}
+
+int GLTFBase::loadNode(const tinygltf::Node& inputNode, const tinygltf::Model& input, int32_t parent) {
+
+	uint32_t node = nodes.addNode(parent, inputNode.name);
+
+	// The local transform is either made up from translation, rotation, scale or a 4x4 matrix
 	if (inputNode.matrix.size() == 16) {
-		node.matrix = glm::make_mat4x4(inputNode.matrix.data());
+		nodes.setMatrix(node, glm::make_mat4x4(inputNode.matrix.data()));
+	}
+	else {
+		if (inputNode.translation.size() == 3) {
+			nodes.setTranslation(node, glm::vec3(glm::make_vec3(inputNode.translation.data())));
+		}
+		if (inputNode.rotation.size() == 4) {
+			nodes.setRotation(node, glm::quat(glm::make_quat(inputNode.rotation.data())));
+		}
+		if (inputNode.scale.size() == 3) {
+			nodes.setScale(node, glm::vec3(glm::make_vec3(inputNode.scale.data())));
+		}
 	}
 
-	//load nodes children
-	if (inputNode.children.size() > 0) {
-		for (size_t i = 0; i < inputNode.children.size(); i++) {
-			loadNode(input.nodes[inputNode.children[i]], input, &node, indexBuffer, vertexBuffer);
+	// Children follow their parent in the node arrays
+	for (size_t i = 0; i < inputNode.children.size(); i++) {
+		if (loadNode(input.nodes[inputNode.children[i]], input, static_cast<int32_t>(node)) != 0) {
+			return -1;
 		}
 	}
 
-	// If the node contains mesh data, we load vertices and indices from the buffers
-	// In glTF this is done via accessors and buffer views
+	// If the node contains mesh data, reserve the vertex and index ranges of its primitives
+	// The data itself is decoded later on (in parallel) by decodePrimitives
+	// A mesh is only reserved for the first node using it, later nodes become instances of the same ranges
 	if (inputNode.mesh > -1) {
-		const tinygltf::Mesh mesh = input.meshes[inputNode.mesh];
-
-		for (size_t i = 0; i < mesh.primitives.size(); i++) {
-			const tinygltf::Primitive& gltfPrimitive = mesh.primitives[i];
-
-			uint32_t firstIndex = static_cast<uint32_t>(indexBuffer.size());
-			uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-			uint32_t indexCount = 0;
-			{
-				const float* positionBuffer = nullptr;
-				const float* normalsBuffer = nullptr;
-				const float* texCoordsBuffer = nullptr;
-				const float* tangentsBuffer = nullptr;
-				size_t vertexCount = 0;
-
-				// Get buffer data for vertex positions
-				if (gltfPrimitive.attributes.find("POSITION") != gltfPrimitive.attributes.end()) {
-					const tinygltf::Accessor& accessor = input.accessors[gltfPrimitive.attributes.find("POSITION")->second];
-					const tinygltf::BufferView& view = input.bufferViews[accessor.bufferView];
-					positionBuffer = reinterpret_cast<const float*> (&(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-					vertexCount = accessor.count;
-				}
-				// Get buffer data for vertex normals
-				if (gltfPrimitive.attributes.find("NORMAL") != gltfPrimitive.attributes.end()) {
-					const tinygltf::Accessor& accessor = input.accessors[gltfPrimitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView& view = input.bufferViews[accessor.bufferView];
-					normalsBuffer = reinterpret_cast<const float*>(&(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
-				// Get buffer data for vertex texture coordinates
-				// glTF supports multiple sets, we only load the first one
-				if (gltfPrimitive.attributes.find("TEXCOORD_0") != gltfPrimitive.attributes.end()) {
-					const tinygltf::Accessor& accessor = input.accessors[gltfPrimitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView& view = input.bufferViews[accessor.bufferView];
-					texCoordsBuffer = reinterpret_cast<const float*>(&(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
-				// POI: This sample uses normal mapping, so we also need to load the tangents from the glTF file
-				if (gltfPrimitive.attributes.find("TANGENT") != gltfPrimitive.attributes.end()) {
-					const tinygltf::Accessor& accessor = input.accessors[gltfPrimitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView& view = input.bufferViews[accessor.bufferView];
-					tangentsBuffer = reinterpret_cast<const float*>(&(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-				}
-
-				// Append data to model's vertex buffer
-				for (size_t j = 0; j < vertexCount; j++) {
-					Vertex vertex{};
-					vertex.position = glm::vec4(glm::make_vec3(&positionBuffer[j * 3]), 1.0f);
-					vertex.normal = glm::normalize(glm::vec3(normalsBuffer ? glm::make_vec3(&normalsBuffer[j * 3]) : glm::vec3(0.0f)));
-					vertex.uv = texCoordsBuffer ? glm::make_vec2(&texCoordsBuffer[j * 2]) : glm::vec3(0.0f);
-					vertex.color = glm::vec3(1.0f);
-					vertex.tangent = tangentsBuffer ? glm::make_vec4(&tangentsBuffer[j * 4]) : glm::vec4(0.0f);
-					vertexBuffer.push_back(vertex);
-				}
-			}
+		const tinygltf::Mesh& mesh = input.meshes[inputNode.mesh];
+		vkbase::Mesh& sharedMesh = meshes[inputNode.mesh];
+		nodes.setMesh(node, inputNode.mesh);
 
-			//indices
-			{
-				const tinygltf::Accessor& accessor = input.accessors[gltfPrimitive.indices];
-				const tinygltf::BufferView& bufferView = input.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer& buffer = input.buffers[bufferView.buffer];
+		if (sharedMesh.primitives.empty()) {
+			for (size_t i = 0; i < mesh.primitives.size(); i++) {
+				const tinygltf::Primitive& gltfPrimitive = mesh.primitives[i];
 
-				indexCount += static_cast<uint32_t>(accessor.count);
+				vkbase::PrimitiveDecodeInfo info{};
+				info.primitive = &gltfPrimitive;
+				info.meshIndex = static_cast<uint32_t>(inputNode.mesh);
+				info.primitiveIndex = static_cast<uint32_t>(i);
+				info.firstVertex = vertexTotal;
 
-				// glTF supports different component types of indices
-				switch (accessor.componentType) {
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-					uint32_t* buf = new uint32_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-					uint16_t* buf = new uint16_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-					break;
+				if (gltfPrimitive.attributes.find("POSITION") != gltfPrimitive.attributes.end()) {
+					info.vertexCount = static_cast<uint32_t>(input.accessors[gltfPrimitive.attributes.find("POSITION")->second].count);
 				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-					uint8_t* buf = new uint8_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-					break;
+				info.indexCount = static_cast<uint32_t>(input.accessors[gltfPrimitive.indices].count);
+
+				// Indices are stored relative to the primitive, so 16 bits are enough for most primitives
+				if (info.vertexCount < 0x10000) {
+					info.indexType = VK_INDEX_TYPE_UINT16;
+					info.firstIndex = indexTotal16;
+					indexTotal16 += info.indexCount;
 				}
-				default:
-					std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-					return -1;
+				else {
+					info.indexType = VK_INDEX_TYPE_UINT32;
+					info.firstIndex = indexTotal;
+					indexTotal += info.indexCount;
 				}
+				vertexTotal += info.vertexCount;
+				primitiveDecodes.push_back(info);
+
+				vkbase::Primitive primitive{};
+				primitive.firstIndex = info.firstIndex;
+				primitive.indexCount = info.indexCount;
+				primitive.materialIndex = gltfPrimitive.material;
+				primitive.vertexOffset = static_cast<int32_t>(info.firstVertex);
+				primitive.indexType = info.indexType;
+				sharedMesh.primitives.push_back(primitive);
 			}
-
-			vkbase::Primitive primitive{};
-			primitive.firstIndex = firstIndex;
-			primitive.indexCount = indexCount;
-			primitive.materialIndex = gltfPrimitive.material;
-			node.mesh.primitives.push_back(primitive);
 		}
 	}
 
-	if (parent) {
-		parent->children.push_back(node);
+	return 0;
+}
+
+int GLTFBase::decodePrimitives(const tinygltf::Model& input, uint32_t threadCount) {
+
+	vertices.resize(vertexTotal);
+	indices.resize(indexTotal);
+	indices16.resize(indexTotal16);
+
+	optimizationStats.assign(primitiveDecodes.size(), {});
+	std::vector<std::vector<vkbase::meshopt::Meshlet>> primitiveClusters(primitiveDecodes.size());
+	std::vector<std::vector<vkbase::PrimitiveLod>> primitiveLods(primitiveDecodes.size());
+	std::vector<std::vector<uint32_t>> lodIndices(primitiveDecodes.size());
+
+	// Every primitive writes to its own disjoint slice, so no synchronization is needed
+	std::atomic<int> result(0);
+	std::atomic<size_t> decoded(0);
+	vkbase::ThreadPool pool(threadCount);
+	pool.parallelFor(primitiveDecodes.size(), [&](size_t i) {
+		if (loadCancelled()) {
+			result = -1;
+			return;
+		}
+		const vkbase::PrimitiveDecodeInfo& info = primitiveDecodes[i];
+
+		// 16 bit primitives are decoded into a temporary 32 bit buffer and narrowed afterwards
+		std::vector<uint32_t> wideIndices;
+		uint32_t* indexBuffer = indices.data() + info.firstIndex;
+		if (info.indexType == VK_INDEX_TYPE_UINT16) {
+			wideIndices.resize(info.indexCount);
+			indexBuffer = wideIndices.data();
+		}
+
+		if (decodePrimitive(input, info, vertices.data() + info.firstVertex, indexBuffer) != 0) {
+			result = -1;
+			return;
+		}
+		if (settings.generateTangents) {
+			generatePrimitiveTangents(info, vertices.data() + info.firstVertex, indexBuffer);
+		}
+		if (settings.optimizeMeshes) {
+			optimizePrimitive(info, vertices.data() + info.firstVertex, indexBuffer, optimizationStats[i]);
+		}
+		if (settings.lodCount > 0) {
+			primitiveLods[i] = buildPrimitiveLods(info, vertices.data() + info.firstVertex, indexBuffer, lodIndices[i]);
+		}
+		// Clusters follow the final triangle order
+		if (settings.buildClusters) {
+			primitiveClusters[i] = buildPrimitiveClusters(info, vertices.data() + info.firstVertex, indexBuffer);
+		}
+		if (info.indexType == VK_INDEX_TYPE_UINT16) {
+			std::copy(wideIndices.begin(), wideIndices.end(), indices16.begin() + info.firstIndex);
+		}
+		reportLoadProgress(0.2f + 0.6f * static_cast<float>(++decoded) / static_cast<float>(primitiveDecodes.size()));
+	}, threadCount);
+
+	// Concatenate the cluster tables in decode order
+	clusters.clear();
+	for (size_t i = 0; i < primitiveDecodes.size(); i++) {
+		const vkbase::PrimitiveDecodeInfo& info = primitiveDecodes[i];
+		vkbase::Primitive& primitive = meshes[info.meshIndex].primitives[info.primitiveIndex];
+		primitive.firstCluster = static_cast<uint32_t>(clusters.size());
+		primitive.clusterCount = static_cast<uint32_t>(primitiveClusters[i].size());
+		for (vkbase::meshopt::Meshlet cluster : primitiveClusters[i]) {
+			cluster.firstIndex += info.firstIndex;
+			clusters.push_back(cluster);
+		}
 	}
-	else {
-		nodes.push_back(node);
+
+	// Simplified levels are appended behind all full resolution primitives of their index pool
+	lods.clear();
+	for (size_t i = 0; i < primitiveDecodes.size(); i++) {
+		const vkbase::PrimitiveDecodeInfo& info = primitiveDecodes[i];
+		vkbase::Primitive& primitive = meshes[info.meshIndex].primitives[info.primitiveIndex];
+		primitive.firstLod = static_cast<uint32_t>(lods.size());
+		primitive.lodCount = static_cast<uint32_t>(primitiveLods[i].size());
+
+		uint32_t poolOffset;
+		if (info.indexType == VK_INDEX_TYPE_UINT16) {
+			poolOffset = static_cast<uint32_t>(indices16.size());
+			indices16.insert(indices16.end(), lodIndices[i].begin(), lodIndices[i].end());
+		}
+		else {
+			poolOffset = static_cast<uint32_t>(indices.size());
+			indices.insert(indices.end(), lodIndices[i].begin(), lodIndices[i].end());
+		}
+		for (vkbase::PrimitiveLod lod : primitiveLods[i]) {
+			lod.firstIndex += poolOffset;
+			lods.push_back(lod);
+		}
 	}
 
-	return 0;
+	computeMeshBounds();
+
+	return result;
 }
 
+int GLTFBase::decodePrimitive(const tinygltf::Model& input, const vkbase::PrimitiveDecodeInfo& info, Vertex* vertexBuffer, uint32_t* indexBuffer) {
 
-GLTFKtxModel::GLTFKtxModel(const std::string& filepath, VkQueue copyQueue) : GLTFBase(filepath, copyQueue) {
+	const tinygltf::Primitive& gltfPrimitive = *info.primitive;
 
-	this->copyQueue = copyQueue;
-	tinygltf::Model glTFInput;
+	{
+		// Attributes are decoded straight into the primitive's slice of the vertex buffer, missing ones keep these defaults
+		for (size_t j = 0; j < info.vertexCount; j++) {
+			vertexBuffer[j] = Vertex{};
+			vertexBuffer[j].color = glm::vec3(1.0f);
+		}
 
-	loader.SetImageLoader(loadImageDataFunc, nullptr);
+		// glTF supports multiple texture coordinate sets, we only load the first one
+		// POI: This sample uses normal mapping, so we also need to load the tangents from the glTF file
+		struct AttributeTarget {
+			const char* name;
+			float* destination;
+			uint32_t componentCount;
+		};
+		const AttributeTarget attributes[] = {
+			{ "POSITION", &vertexBuffer[0].position.x, 3 },
+			{ "NORMAL", &vertexBuffer[0].normal.x, 3 },
+			{ "TEXCOORD_0", &vertexBuffer[0].uv.x, 2 },
+			{ "TANGENT", &vertexBuffer[0].tangent.x, 4 },
+		};
+
+		// Accessors may be interleaved (byteStride), normalized integers or quantized (KHR_mesh_quantization)
+		for (const AttributeTarget& attribute : attributes) {
+			auto found = gltfPrimitive.attributes.find(attribute.name);
+			if (found == gltfPrimitive.attributes.end()) {
+				continue;
+			}
+			const tinygltf::Accessor& accessor = input.accessors[found->second];
+			if (accessor.bufferView < 0) {
+				std::cerr << "Attribute " << attribute.name << " without buffer view not supported!" << std::endl;
+				return -1;
+			}
+			const tinygltf::BufferView& view = input.bufferViews[accessor.bufferView];
+
+			vkbase::AccessorSource source{};
+			source.data = bufferData(input, view.buffer) + accessor.byteOffset + view.byteOffset;
+			source.count = std::min<size_t>(accessor.count, info.vertexCount);
+			source.stride = static_cast<size_t>(std::max(accessor.ByteStride(view), 0));
+			source.componentType = accessor.componentType;
+			source.componentCount = std::min<uint32_t>(tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type)), attribute.componentCount);
+			source.normalized = accessor.normalized;
+			if (!vkbase::decodeAccessor(source, attribute.destination, sizeof(Vertex))) {
+				std::cerr << "Attribute " << attribute.name << " component type " << accessor.componentType << " not supported!" << std::endl;
+				return -1;
+			}
+		}
 
-	bool fileloaded = loader.LoadASCIIFromFile(&glTFInput, &error, &warning, filepath);
+		// Quantized normals are not unit length
+		if (gltfPrimitive.attributes.find("NORMAL") != gltfPrimitive.attributes.end()) {
+			for (size_t j = 0; j < info.vertexCount; j++) {
+				vertexBuffer[j].normal = glm::normalize(vertexBuffer[j].normal);
+			}
+		}
+	}
 
-	if (!warning.empty()) {
-		printf("Warning: %s\n", warning.c_str());
+	//indices
+	{
+		const tinygltf::Accessor& accessor = input.accessors[gltfPrimitive.indices];
+		const tinygltf::BufferView& bufferView = input.bufferViews[accessor.bufferView];
+		const unsigned char* data = bufferData(input, bufferView.buffer) + accessor.byteOffset + bufferView.byteOffset;
+		// glTF supports different component types of indices
+		switch (accessor.componentType) {
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+			for (size_t index = 0; index < accessor.count; index++) {
+				uint32_t value;
+				memcpy(&value, data + index * sizeof(uint32_t), sizeof(uint32_t));
+				indexBuffer[index] = value;
+			}
+			break;
+		}
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+			for (size_t index = 0; index < accessor.count; index++) {
+				uint16_t value;
+				memcpy(&value, data + index * sizeof(uint16_t), sizeof(uint16_t));
+				indexBuffer[index] = value;
+			}
+			break;
+		}
+		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+			for (size_t index = 0; index < accessor.count; index++) {
+				indexBuffer[index] = data[index];
+			}
+			break;
+		}
+		default:
+			std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
+			return -1;
+		}
 	}
 
-	if (!error.empty()) {
-		printf("Error: %s\n", error.c_str());
+	return 0;
+}
+
+void GLTFBase::generatePrimitiveTangents(const vkbase::PrimitiveDecodeInfo& info, Vertex* vertexBuffer, const uint32_t* indexBuffer) {
+
+	const std::map<std::string, int>& attributes = info.primitive->attributes;
+	if (attributes.find("TANGENT") != attributes.end() || attributes.find("NORMAL") == attributes.end() || attributes.find("TEXCOORD_0") == attributes.end()) {
+		return;
+	}
+	if (!isTriangleList(info, indexBuffer)) {
+		return;
 	}
 
+	vkbase::meshopt::generateTangents(indexBuffer, info.indexCount, &vertexBuffer[0].position.x, &vertexBuffer[0].normal.x, &vertexBuffer[0].uv.x, sizeof(Vertex),
+		info.vertexCount, &vertexBuffer[0].tangent.x);
+}
 
-	std::size_t found = filepath.find_last_of("/\\");
-	path = filepath.substr(0, found);
+void GLTFBase::packVertices(uint32_t threadCount) {
 
-	if (fileloaded) {
-		loadImages(glTFInput);
-		loadMaterials(glTFInput);
-		loadTextures(glTFInput);
-		tinygltf::Scene& scene = glTFInput.scenes[0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			tinygltf::Node& node = glTFInput.nodes[scene.nodes[i]];
-			loadNode(node, glTFInput, nullptr, indices, vertices);
+	// Bounds of every mesh over the vertices of all of its primitives
+	std::vector<glm::vec3> boundsMin(meshes.size(), glm::vec3(std::numeric_limits<float>::max()));
+	std::vector<glm::vec3> boundsMax(meshes.size(), glm::vec3(-std::numeric_limits<float>::max()));
+	for (const vkbase::PrimitiveDecodeInfo& info : primitiveDecodes) {
+		for (uint32_t j = info.firstVertex; j < info.firstVertex + info.vertexCount; j++) {
+			boundsMin[info.meshIndex] = glm::min(boundsMin[info.meshIndex], vertices[j].position);
+			boundsMax[info.meshIndex] = glm::max(boundsMax[info.meshIndex], vertices[j].position);
 		}
-	
-		createVertexBuffers();
-		createIndexBuffers();
-	
 	}
-	else {
-		std::cerr << "Failed to open glTF File" << std::endl;
+
+	// A uniform scale keeps the instance matrix free of shear, so normals can still use mat3(model)
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (boundsMin[i].x > boundsMax[i].x) {
+			continue;
+		}
+		glm::vec3 extent = boundsMax[i] - boundsMin[i];
+		float scale = std::max(extent.x, std::max(extent.y, extent.z));
+		meshes[i].positionOffset = boundsMin[i];
+		meshes[i].positionScale = scale > 0.0f ? scale : 1.0f;
 	}
 
+	packedVertices.resize(vertices.size());
+	vkbase::ThreadPool pool(threadCount);
+	pool.parallelFor(primitiveDecodes.size(), [&](size_t i) {
+		const vkbase::PrimitiveDecodeInfo& info = primitiveDecodes[i];
+		const vkbase::Mesh& mesh = meshes[info.meshIndex];
+		for (uint32_t j = info.firstVertex; j < info.firstVertex + info.vertexCount; j++) {
+			packedVertices[j] = vkbase::packVertex(vertices[j], mesh.positionOffset, mesh.positionScale);
+		}
+	}, threadCount);
+
+	// The full vertices are not needed anymore
+	vertices.clear();
+	vertices.shrink_to_fit();
 }
 
+void GLTFBase::optimizePrimitive(const vkbase::PrimitiveDecodeInfo& info, Vertex* vertexBuffer, uint32_t* indexBuffer, vkbase::PrimitiveOptimizationStats& stats) {
 
-VkDescriptorImageInfo GLTFKtxModel::getTextureDescriptor(const size_t index) {
-	return images[index].descriptor;
-}
+	// Only indexed triangle lists with valid indices can be reordered
+	if (!isTriangleList(info, indexBuffer)) {
+		return;
+	}
 
+	stats.before = vkbase::meshopt::analyzeVertexCache(indexBuffer, info.indexCount, info.vertexCount);
 
-GLTFKtxModel::~GLTFKtxModel() {
-	for (auto& mat : materials) {
-		vkDestroyPipeline(global_device->logicalDevice, mat.pipeline, nullptr);
+	// Exports that are already cache friendly can end up slightly worse, those keep their triangle order
+	std::vector<uint32_t> originalIndices(indexBuffer, indexBuffer + info.indexCount);
+	vkbase::meshopt::optimizeVertexCache(indexBuffer, info.indexCount, info.vertexCount);
+	vkbase::meshopt::optimizeOverdraw(indexBuffer, info.indexCount, &vertexBuffer[0].position.x, sizeof(Vertex), info.vertexCount);
+	if (vkbase::meshopt::analyzeVertexCache(indexBuffer, info.indexCount, info.vertexCount).acmr > stats.before.acmr) {
+		std::copy(originalIndices.begin(), originalIndices.end(), indexBuffer);
 	}
+	vkbase::meshopt::optimizeVertexFetch(vertexBuffer, sizeof(Vertex), indexBuffer, info.indexCount, info.vertexCount);
+
+	stats.after = vkbase::meshopt::analyzeVertexCache(indexBuffer, info.indexCount, info.vertexCount);
+	stats.optimized = true;
 }
 
+std::vector<vkbase::meshopt::Meshlet> GLTFBase::buildPrimitiveClusters(const vkbase::PrimitiveDecodeInfo& info, const Vertex* vertexBuffer, const uint32_t* indexBuffer) {
 
-int GLTFKtxModel::loadImages(tinygltf::Model& model) {
-	
-	images.resize(model.images.size());
-	for (size_t i = 0; i < model.images.size(); i++) {
-		tinygltf::Image& image = model.images[i];
-		std::string complete_path = path + '/' + image.uri;
-		images[i].loadTextureFromFile(complete_path, VK_FORMAT_R8G8B8A8_UNORM, copyQueue);
+	if (!isTriangleList(info, indexBuffer)) {
+		return {};
 	}
-	return 0;
+
+	return vkbase::meshopt::buildMeshlets(indexBuffer, info.indexCount, &vertexBuffer[0].position.x, sizeof(Vertex), info.vertexCount);
 }
 
-GLTFPngModel::GLTFPngModel(const std::string& filepath, VkQueue copyQueue) : GLTFBase(filepath, copyQueue) {
+std::vector<vkbase::PrimitiveLod> GLTFBase::buildPrimitiveLods(const vkbase::PrimitiveDecodeInfo& info, const Vertex* vertexBuffer, const uint32_t* indexBuffer, std::vector<uint32_t>& lodIndices) {
 
-	this->copyQueue = copyQueue;
-	tinygltf::Model glTFInput;
+	std::vector<vkbase::PrimitiveLod> levels;
+	if (!isTriangleList(info, indexBuffer)) {
+		return levels;
+	}
 
-	bool fileloaded = loader.LoadASCIIFromFile(&glTFInput, &error, &warning, filepath);
+	const float* positions = &vertexBuffer[0].position.x;
+	const float scale = vkbase::meshopt::simplifyScale(positions, sizeof(Vertex), info.vertexCount);
+	const uint32_t lodCount = std::min(settings.lodCount, vkbase::MAX_LOD_LEVELS - 1);
+
+	std::vector<uint32_t> source(indexBuffer, indexBuffer + info.indexCount);
+	std::vector<uint32_t> simplified(info.indexCount);
+	float error = 0.0f;
+	for (uint32_t level = 1; level <= lodCount; level++) {
+		size_t targetIndexCount = source.size() / 6 * 3;
+		float levelError = 0.0f;
+		size_t indexCount = vkbase::meshopt::simplify(simplified.data(), source.data(), source.size(), positions, sizeof(Vertex), info.vertexCount, targetIndexCount, settings.lodTargetError, &levelError);
+
+		// Levels that barely reduce the triangle count are not worth a draw of their own
+		if (indexCount == 0 || indexCount > source.size() * 9 / 10) {
+			break;
+		}
+		source.assign(simplified.begin(), simplified.begin() + indexCount);
+		if (settings.optimizeMeshes) {
+			vkbase::meshopt::optimizeVertexCache(source.data(), source.size(), info.vertexCount);
+		}
 
-	if (!warning.empty()) {
-		printf("Warning: %s\n", warning.c_str());
+		// Errors of successive simplifications add up
+		error += levelError * scale;
+
+		vkbase::PrimitiveLod lod{};
+		lod.firstIndex = static_cast<uint32_t>(lodIndices.size());
+		lod.indexCount = static_cast<uint32_t>(source.size());
+		lod.error = error;
+		levels.push_back(lod);
+		lodIndices.insert(lodIndices.end(), source.begin(), source.end());
 	}
 
-	if (!error.empty()) {
-		printf("Error: %s\n", error.c_str());
+	return levels;
+}
+
+void GLTFBase::computeMeshBounds(void) {
+	std::vector<glm::vec3> boundsMin(meshes.size(), glm::vec3(std::numeric_limits<float>::max()));
+	std::vector<glm::vec3> boundsMax(meshes.size(), glm::vec3(-std::numeric_limits<float>::max()));
+	for (const vkbase::PrimitiveDecodeInfo& info : primitiveDecodes) {
+		for (uint32_t j = info.firstVertex; j < info.firstVertex + info.vertexCount; j++) {
+			boundsMin[info.meshIndex] = glm::min(boundsMin[info.meshIndex], vertices[j].position);
+			boundsMax[info.meshIndex] = glm::max(boundsMax[info.meshIndex], vertices[j].position);
+		}
 	}
 
-	std::size_t found = filepath.find_last_of("/\\");
-	path = filepath.substr(0, found);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (boundsMin[i].x > boundsMax[i].x) {
+			continue;
+		}
+		glm::vec3 center = (boundsMin[i] + boundsMax[i]) * 0.5f;
+		meshes[i].boundingSphere = glm::vec4(center, glm::length(boundsMax[i] - center));
+	}
+}
 
-	if (fileloaded) {
-		loadImages(glTFInput);
-		loadMaterials(glTFInput);
-		loadTextures(glTFInput);
-		tinygltf::Scene& scene = glTFInput.scenes[0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			tinygltf::Node& node = glTFInput.nodes[scene.nodes[i]];
-			loadNode(node, glTFInput, nullptr, indices, vertices);
+#ifdef VKTINY_BENCHMARK
+void GLTFBase::benchmarkDecode(const tinygltf::Model& input) {
+
+	vkbase::benchmarkAccessorDecoding();
+
+	// Reference output of the single threaded path, every other thread count has to match it exactly
+	decodePrimitives(input, 1);
+	std::vector<Vertex> referenceVertices = vertices;
+	std::vector<uint32_t> referenceIndices = indices;
+	std::vector<uint16_t> referenceIndices16 = indices16;
+
+	const uint32_t maxThreads = vkbase::ThreadPool::defaultThreadCount();
+	double singleThreadMs = 0.0;
+
+	std::cout << "decode benchmark: " << primitiveDecodes.size() << " primitives, " << vertexTotal << " vertices, " << indexTotal16 << " 16 bit and " << indexTotal << " 32 bit indices" << std::endl;
+	for (uint32_t threads = 1; threads <= maxThreads; threads++) {
+		const int runs = 5;
+		double bestMs = 0.0;
+		for (int run = 0; run < runs; run++) {
+			vertices.clear();
+			indices.clear();
+			indices16.clear();
+			auto start = std::chrono::high_resolution_clock::now();
+			decodePrimitives(input, threads);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			bestMs = (run == 0) ? ms : std::min(bestMs, ms);
+		}
+		if (threads == 1) {
+			singleThreadMs = bestMs;
 		}
 
-		createVertexBuffers();
-		createIndexBuffers();
+		bool identical = vertices.size() == referenceVertices.size() && indices.size() == referenceIndices.size() &&
+			memcmp(vertices.data(), referenceVertices.data(), vertices.size() * sizeof(Vertex)) == 0 &&
+			memcmp(indices.data(), referenceIndices.data(), indices.size() * sizeof(uint32_t)) == 0 &&
+			indices16 == referenceIndices16;
 
+		printf("  %2u thread(s): %8.3f ms (%.2fx) %s\n", threads, bestMs, singleThreadMs / bestMs, identical ? "identical" : "MISMATCH");
 	}
-	else {
-		std::cerr << "Failed to open glTF File" << std::endl;
-	}
-
 }
+#endif
 
-GLTFPngModel::~GLTFPngModel() {
-	for (auto& mat : materials) {
-		vkDestroyPipeline(global_device->logicalDevice, mat.pipeline, nullptr);
+
+int GLTFBase::loadFromFile(const std::string& filepath) {
+
+	if (prepareFromFile(filepath) != 0) {
+		return -1;
 	}
-}
 
+	// All buffers and images go up in a single submission
+	VkCommandBuffer uploadCmd = global_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	recordUploads(uploadCmd);
+	global_device->flushCommandBuffer(uploadCmd, copyQueue);
+	finishUploads();
 
-VkDescriptorImageInfo GLTFPngModel::getTextureDescriptor(const size_t index) {
-	return images[index].descriptor;
+	return 0;
 }
 
-int GLTFPngModel::loadImages(tinygltf::Model& model) {
-	images.resize(model.images.size());
-	for (size_t i = 0; i < model.images.size(); i++) {
-		tinygltf::Image& image = model.images[i];
-		std::string complete_path = path + '/' + image.uri;
-		images[i].createImage(image, VK_FORMAT_R8G8B8A8_UNORM, copyQueue);
+int GLTFBase::prepareFromFile(const std::string& filepath) {
+
+	std::size_t found = filepath.find_last_of("/\\");
+	path = filepath.substr(0, found);
+	sourcePath = filepath;
+
+	// Streamed scenes always come from their cache
+	if ((settings.sceneCache || settings.streaming) && loadFromCache(filepath)) {
+		reportLoadProgress(1.0f);
+		return 0;
+	}
+
+	tinygltf::Model glTFInput;
+
+	if (decodeFile(filepath, glTFInput) != 0) {
+		return -1;
+	}
+
+	// The first load of a streamed scene decodes it as a whole to build the cache it is streamed from
+	if (settings.streaming) {
+		writeCache(filepath, glTFInput);
+		if (loadFromCache(filepath)) {
+			std::vector<Vertex>().swap(vertices);
+			std::vector<vkbase::PackedVertex>().swap(packedVertices);
+			std::vector<uint32_t>().swap(indices);
+			std::vector<uint16_t>().swap(indices16);
+			mappedBuffers.clear();
+			mappedBufferSizes.clear();
+			binaryFile.close();
+			reportLoadProgress(1.0f);
+			return 0;
+		}
+		std::cerr << "No scene cache for " << filepath << ", loading it without streaming" << std::endl;
+		settings.streaming = false;
+	}
+
+	loadImages(glTFInput);
+	if (loadCancelled()) {
+		return -1;
+	}
+
+	if (settings.sceneCache) {
+		writeCache(filepath, glTFInput);
+	}
+
+	createVertexBuffers();
+	createIndexBuffers();
+
+	// Nothing references the GLB payload anymore
+	mappedBuffers.clear();
+	mappedBufferSizes.clear();
+	binaryFile.close();
+
+	reportLoadProgress(1.0f);
+	return 0;
+}
+
+int GLTFBase::decodeFile(const std::string& filepath, tinygltf::Model& glTFInput) {
+
+	bool fileloaded = isBinaryFile(filepath) ? loadBinaryFile(filepath, glTFInput) : loadTextFile(filepath, glTFInput);
+
+	if (!warning.empty()) {
+		printf("Warning: %s\n", warning.c_str());
+	}
+
+	if (!error.empty()) {
+		printf("Error: %s\n", error.c_str());
+	}
+
+	if (!fileloaded) {
+		std::cerr << "Failed to open glTF File" << std::endl;
+		return -1;
+	}
+
+	if (decodeCompressedViews(glTFInput, settings.threadCount) != 0) {
+		return -1;
+	}
+	reportLoadProgress(0.2f);
+	if (loadCancelled()) {
+		return -1;
+	}
+
+	loadMaterials(glTFInput);
+	loadTextures(glTFInput);
+	if (loadScene(glTFInput) != 0) {
+		return -1;
+	}
+
+	if (settings.hotReload) {
+		std::vector<std::string> files = { filepath };
+		for (const tinygltf::Buffer& buffer : glTFInput.buffers) {
+			if (!buffer.uri.empty() && buffer.uri.compare(0, 5, "data:") != 0) {
+				files.push_back(path + '/' + buffer.uri);
+			}
+		}
+		recordSources(files, glTFInput);
+	}
+
+	reportLoadProgress(0.8f);
+	return 0;
+}
+
+void GLTFBase::recordSources(const std::vector<std::string>& files, const tinygltf::Model& input) {
+	sources = files;
+	imageVersions.resize(input.images.size());
+	for (size_t i = 0; i < input.images.size(); i++) {
+		const tinygltf::Image& image = input.images[i];
+		if (image.bufferView < 0 && !image.uri.empty() && image.uri.compare(0, 5, "data:") != 0) {
+			sources.push_back(path + '/' + image.uri);
+		}
+		imageVersions[i] = imageVersion(input, image);
+	}
+}
+
+uint64_t GLTFBase::imageVersion(const tinygltf::Model& input, const tinygltf::Image& image) const {
+	if (image.bufferView >= 0 && static_cast<size_t>(image.bufferView) < input.bufferViews.size()) {
+		const tinygltf::BufferView& view = input.bufferViews[image.bufferView];
+		const unsigned char* data = bufferData(input, view.buffer);
+		return data ? vkbase::hashBytes(data + view.byteOffset, view.byteLength) : 0;
+	}
+
+	uint64_t version = vkbase::hashBytes(image.uri.data(), image.uri.size());
+	vkbase::FileWatcher::FileState state;
+	if (!image.uri.empty() && vkbase::FileWatcher::fileState(path + '/' + image.uri, state)) {
+		uint64_t stamp[2] = { state.size, static_cast<uint64_t>(state.modifiedTime) };
+		version = vkbase::hashBytes(stamp, sizeof(stamp), version);
+	}
+	return version;
+}
+
+std::shared_ptr<vkbase::ModelLoad> GLTFBase::loadAsync(const std::string& filepath) {
+
+	abortLoad();
+
+	std::shared_ptr<vkbase::ModelLoad> load = std::make_shared<vkbase::ModelLoad>();
+	asyncLoad = load;
+
+	loadThread = std::thread([this, load, filepath]() {
+		int result = -1;
+		try {
+			result = prepareFromFile(filepath);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Failed to load " << filepath << ": " << e.what() << std::endl;
+		}
+
+		if (load->cancelRequested) {
+			load->state = vkbase::LoadState::Cancelled;
+		}
+		else {
+			load->state = result == 0 ? vkbase::LoadState::Staged : vkbase::LoadState::Failed;
+		}
+	});
+
+	return load;
+}
+
+vkbase::LoadState GLTFBase::pollLoad(void) {
+
+	// The loaded model stays drawable during a reload
+	if (!asyncLoad || reloading) {
+		return vkbase::LoadState::Resident;
+	}
+
+	vkbase::LoadState state = asyncLoad->state;
+
+	if (state == vkbase::LoadState::Staged) {
+		loadThread.join();
+		if (asyncLoad->cancelRequested) {
+			finishUploads();
+			asyncLoad->state = vkbase::LoadState::Cancelled;
+			return vkbase::LoadState::Cancelled;
+		}
+
+		// The loader thread never touches a queue, the render thread submits the staged copies with a fence
+		uploadCommandBuffer = global_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		recordUploads(uploadCommandBuffer);
+		vkEndCommandBuffer(uploadCommandBuffer);
+
+		VkFenceCreateInfo fenceInfo = vkbase::initializers::fenceCreateInfo();
+		if (vkCreateFence(global_device->logicalDevice, &fenceInfo, nullptr, &uploadFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload fence");
+		}
+
+		VkSubmitInfo submitInfo = vkbase::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &uploadCommandBuffer;
+		if (vkQueueSubmit(copyQueue, 1, &submitInfo, uploadFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit model upload");
+		}
+
+		asyncLoad->state = vkbase::LoadState::Uploading;
+		return vkbase::LoadState::Uploading;
+	}
+
+	if (state == vkbase::LoadState::Uploading) {
+		if (vkGetFenceStatus(global_device->logicalDevice, uploadFence) != VK_SUCCESS) {
+			return state;
+		}
+
+		vkDestroyFence(global_device->logicalDevice, uploadFence, nullptr);
+		vkFreeCommandBuffers(global_device->logicalDevice, global_device->command_pool, 1, &uploadCommandBuffer);
+		uploadFence = VK_NULL_HANDLE;
+		uploadCommandBuffer = VK_NULL_HANDLE;
+		finishUploads();
+		drawListDirty = true;
+
+		asyncLoad->state = vkbase::LoadState::Resident;
+		return vkbase::LoadState::Resident;
+	}
+
+	if ((state == vkbase::LoadState::Failed || state == vkbase::LoadState::Cancelled) && loadThread.joinable()) {
+		loadThread.join();
+		finishUploads();
+	}
+
+	return state;
+}
+
+void GLTFBase::abortLoad(void) {
+
+	// A streaming batch may still be staging chunks
+	if (streamThread.joinable()) {
+		streamBatch->cancel();
+		streamThread.join();
+	}
+	streamBatch.reset();
+	streamLoads.clear();
+
+	if (asyncLoad) {
+		asyncLoad->cancel();
+		if (loadThread.joinable()) {
+			loadThread.join();
+		}
+	}
+
+	if (uploadFence != VK_NULL_HANDLE) {
+		vkWaitForFences(global_device->logicalDevice, 1, &uploadFence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(global_device->logicalDevice, uploadFence, nullptr);
+		vkFreeCommandBuffers(global_device->logicalDevice, global_device->command_pool, 1, &uploadCommandBuffer);
+		uploadFence = VK_NULL_HANDLE;
+		uploadCommandBuffer = VK_NULL_HANDLE;
+		if (asyncLoad) {
+			asyncLoad->state = vkbase::LoadState::Resident;
+		}
+	}
+	else if (asyncLoad && !asyncLoad->finished()) {
+		asyncLoad->state = vkbase::LoadState::Cancelled;
+	}
+	if (evictionFence != VK_NULL_HANDLE) {
+		vkWaitForFences(global_device->logicalDevice, 1, &evictionFence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(global_device->logicalDevice, evictionFence, nullptr);
+		evictionFence = VK_NULL_HANDLE;
+	}
+	evictedBuffers.clear();
+	evictedImages.clear();
+
+	finishUploads();
+	discardReload();
+	retiredBuffers.clear();
+	retiredImages.clear();
+	reloading = false;
+}
+
+bool GLTFBase::loadCancelled(void) const {
+	return asyncLoad && asyncLoad->cancelRequested;
+}
+
+void GLTFBase::reportLoadProgress(float progress) {
+	if (asyncLoad) {
+		asyncLoad->progress = progress;
+	}
+}
+
+GLTFBase::~GLTFBase() {
+	abortLoad();
+}
+
+std::shared_ptr<vkbase::ModelLoad> GLTFBase::reloadAsync(void) {
+
+	if (!settings.hotReload || settings.streaming || sourcePath.empty() || (asyncLoad && !asyncLoad->finished())) {
+		return nullptr;
+	}
+	if (loadThread.joinable()) {
+		loadThread.join();
+	}
+
+	std::shared_ptr<vkbase::ModelLoad> load = std::make_shared<vkbase::ModelLoad>();
+	asyncLoad = load;
+	reloading = true;
+
+	// The new scene is decoded into a CPU only model, progress and cancellation go through the same handle
+	vkbase::LoaderSettings reloadSettings = settings;
+	reloadSettings.benchmarkDecode = false;
+	reloadModel = std::make_unique<GLTFSceneParser>(reloadSettings);
+	reloadModel->path = path;
+	reloadModel->asyncLoad = load;
+
+	loadThread = std::thread([this, load]() {
+		int result = -1;
+		try {
+			tinygltf::Model input;
+			result = reloadModel->decodeFile(sourcePath, input);
+			if (result == 0 && !load->cancelRequested) {
+				result = stageReload(input);
+			}
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Failed to reload " << sourcePath << ": " << e.what() << std::endl;
+		}
+
+		if (load->cancelRequested) {
+			load->state = vkbase::LoadState::Cancelled;
+		}
+		else {
+			load->state = result == 0 ? vkbase::LoadState::Staged : vkbase::LoadState::Failed;
+		}
+	});
+
+	return load;
+}
+
+int GLTFBase::stageReload(tinygltf::Model& input) {
+
+	GLTFBase& next = *reloadModel;
+	vkbase::ReloadChanges& changes = reloadChanges;
+	changes = vkbase::ReloadChanges();
+
+	// Geometry is compared in the vertex format of the settings, buffers keep their size unless the data grew or shrank
+	if (settings.vertexFormat == vkbase::VertexFormat::Packed) {
+		stageReloadBuffer(packedVertices.data(), packedVertices.size() * sizeof(vkbase::PackedVertex), next.packedVertices.data(), next.packedVertices.size() * sizeof(vkbase::PackedVertex),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer.get(), reloadVertexBuffer, changes);
+	}
+	else {
+		stageReloadBuffer(vertices.data(), vertices.size() * sizeof(Vertex), next.vertices.data(), next.vertices.size() * sizeof(Vertex),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer.get(), reloadVertexBuffer, changes);
+	}
+	stageReloadBuffer(indices.data(), indices.size() * sizeof(uint32_t), next.indices.data(), next.indices.size() * sizeof(uint32_t),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer.get(), reloadIndexBuffer, changes);
+	stageReloadBuffer(indices16.data(), indices16.size() * sizeof(uint16_t), next.indices16.data(), next.indices16.size() * sizeof(uint16_t),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer16.get(), reloadIndexBuffer16, changes);
+
+	// Only images whose source changed are loaded again, embedded images read the new GLB payload
+	std::swap(mappedBuffers, next.mappedBuffers);
+	std::swap(mappedBufferSizes, next.mappedBufferSizes);
+	reloadedImageIndices.clear();
+	reloadedImages.clear();
+	for (uint32_t i = 0; i < next.imageVersions.size() && !loadCancelled(); i++) {
+		if (i < imageVersions.size() && imageVersions[i] == next.imageVersions[i]) {
+			continue;
+		}
+		std::unique_ptr<vkbase::BaseTexture> image = stageReloadImage(input, i);
+		if (image) {
+			reloadedImageIndices.push_back(i);
+			reloadedImages.push_back(std::move(image));
+			changes.images.push_back(i);
+		}
+	}
+	std::swap(mappedBuffers, next.mappedBuffers);
+	std::swap(mappedBufferSizes, next.mappedBufferSizes);
+	reloadImageCount = next.imageVersions.size();
+
+	// Only the glTF state of the materials is compared here, their pipelines and descriptor sets belong to the render thread
+	if (next.materials.size() != materials.size()) {
+		changes.materialsResized = true;
+	}
+	else {
+		auto imageIndex = [](const std::vector<vkbase::TextureIndices>& textures, uint32_t texture) {
+			return texture < textures.size() ? textures[texture].imageIndex : -1;
+		};
+		for (uint32_t i = 0; i < materials.size(); i++) {
+			const vkbase::Material& material = materials[i];
+			const vkbase::Material& nextMaterial = next.materials[i];
+			if (nextMaterial.alphaMode != material.alphaMode || nextMaterial.alphaCutOff != material.alphaCutOff || nextMaterial.doubleSided != material.doubleSided) {
+				changes.pipelineMaterials.push_back(i);
+			}
+			if (nextMaterial.baseColorTextureIndex != material.baseColorTextureIndex || nextMaterial.normalTextureIndex != material.normalTextureIndex ||
+				imageIndex(next.textures, nextMaterial.baseColorTextureIndex) != imageIndex(textures, material.baseColorTextureIndex) ||
+				imageIndex(next.textures, nextMaterial.normalTextureIndex) != imageIndex(textures, material.normalTextureIndex)) {
+				changes.textureMaterials.push_back(i);
+			}
+		}
+	}
+
+	return loadCancelled() ? -1 : 0;
+}
+
+void GLTFBase::stageReloadBuffer(const void* previous, VkDeviceSize previousSize, const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+	vkbase::Buffer* current, vkbase::BufferReload& reload, vkbase::ReloadChanges& changes) {
+
+	reload = vkbase::BufferReload();
+	if (size != previousSize || (size > 0 && !current)) {
+		reload.replace = true;
+		if (size > 0) {
+			reload.buffer = stageBuffer(data, size, usage);
+		}
+		changes.geometryBytes += size;
+	}
+	else if (size > 0) {
+		changes.geometryBytes += stageChangedRanges(previous, data, size, current->buffer);
+	}
+}
+
+VkDeviceSize GLTFBase::stageChangedRanges(const void* previous, const void* data, VkDeviceSize size, VkBuffer destination) {
+
+	// Differences are tracked per page, neighbouring pages are merged into one copy
+	const VkDeviceSize pageSize = 4096;
+	const unsigned char* previousBytes = static_cast<const unsigned char*>(previous);
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	std::vector<VkBufferCopy> regions;
+	VkDeviceSize stagedSize = 0;
+	for (VkDeviceSize offset = 0; offset < size; offset += pageSize) {
+		VkDeviceSize length = std::min(pageSize, size - offset);
+		if (memcmp(previousBytes + offset, bytes + offset, length) == 0) {
+			continue;
+		}
+		if (!regions.empty() && regions.back().dstOffset + regions.back().size == offset) {
+			regions.back().size += length;
+		}
+		else {
+			regions.push_back({ stagedSize, offset, length });
+		}
+		stagedSize += length;
+	}
+	if (regions.empty()) {
+		return 0;
+	}
+
+	VmaAllocationInfo stagingBufferAllocInfo = {};
+
+	vkbase::BufferUpload upload;
+	upload.staging = std::make_unique<vkbase::Buffer>(global_allocator->allocator);
+	global_allocator->createBuffer(upload.staging.get(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &stagingBufferAllocInfo, stagedSize);
+
+	unsigned char* staging = static_cast<unsigned char*>(stagingBufferAllocInfo.pMappedData);
+	for (const VkBufferCopy& region : regions) {
+		memcpy(staging + region.srcOffset, bytes + region.dstOffset, region.size);
+	}
+
+	upload.destination = destination;
+	upload.size = stagedSize;
+	upload.regions = std::move(regions);
+	pendingUploads.push_back(std::move(upload));
+
+	return stagedSize;
+}
+
+bool GLTFBase::pollReload(vkbase::ReloadChanges& changes) {
+
+	if (!asyncLoad || !reloading) {
+		return false;
+	}
+
+	vkbase::LoadState state = asyncLoad->state;
+
+	if (state == vkbase::LoadState::Staged) {
+		loadThread.join();
+		if (asyncLoad->cancelRequested) {
+			discardReload();
+			reloading = false;
+			asyncLoad->state = vkbase::LoadState::Cancelled;
+			return false;
+		}
+
+		uploadCommandBuffer = global_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+		// Frames submitted earlier finish reading the old data before it is overwritten,
+		// which also makes the upload fence cover them before the replaced objects are released
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		recordUploads(uploadCommandBuffer);
+		for (auto& image : reloadedImages) {
+			image->recordUpload(uploadCommandBuffer);
+		}
+		vkEndCommandBuffer(uploadCommandBuffer);
+
+		VkFenceCreateInfo fenceInfo = vkbase::initializers::fenceCreateInfo();
+		if (vkCreateFence(global_device->logicalDevice, &fenceInfo, nullptr, &uploadFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload fence");
+		}
+
+		VkSubmitInfo submitInfo = vkbase::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &uploadCommandBuffer;
+		if (vkQueueSubmit(copyQueue, 1, &submitInfo, uploadFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit model reload");
+		}
+
+		// Frames recorded from now on are submitted after the upload
+		applyReload(changes);
+
+		asyncLoad->state = vkbase::LoadState::Uploading;
+		return true;
+	}
+
+	if (state == vkbase::LoadState::Uploading) {
+		if (vkGetFenceStatus(global_device->logicalDevice, uploadFence) != VK_SUCCESS) {
+			return false;
+		}
+
+		vkDestroyFence(global_device->logicalDevice, uploadFence, nullptr);
+		vkFreeCommandBuffers(global_device->logicalDevice, global_device->command_pool, 1, &uploadCommandBuffer);
+		uploadFence = VK_NULL_HANDLE;
+		uploadCommandBuffer = VK_NULL_HANDLE;
+		finishUploads();
+		retiredBuffers.clear();
+		retiredImages.clear();
+
+		reloading = false;
+		asyncLoad->state = vkbase::LoadState::Resident;
+		return false;
+	}
+
+	if (state == vkbase::LoadState::Failed || state == vkbase::LoadState::Cancelled) {
+		if (loadThread.joinable()) {
+			loadThread.join();
+		}
+		discardReload();
+		reloading = false;
+	}
+
+	return false;
+}
+
+void GLTFBase::applyReload(vkbase::ReloadChanges& changes) {
+
+	GLTFBase& next = *reloadModel;
+
+	// Replaced buffers stay alive until the upload fence signals
+	vkbase::BufferReload* bufferReloads[3] = { &reloadVertexBuffer, &reloadIndexBuffer, &reloadIndexBuffer16 };
+	std::unique_ptr<vkbase::Buffer>* buffers[3] = { &vertexBuffer, &indexBuffer, &indexBuffer16 };
+	for (size_t i = 0; i < 3; i++) {
+		if (bufferReloads[i]->replace) {
+			if (*buffers[i]) {
+				retiredBuffers.push_back(std::move(*buffers[i]));
+			}
+			*buffers[i] = std::move(bufferReloads[i]->buffer);
+		}
+		*bufferReloads[i] = vkbase::BufferReload();
+	}
+
+	installReloadImages(reloadImageCount);
+	reloadedImageIndices.clear();
+
+	// Materials keep their pipelines and descriptor sets, the caller only rebuilds the ones that changed
+	if (!reloadChanges.materialsResized) {
+		for (size_t i = 0; i < materials.size(); i++) {
+			next.materials[i].pipeline = materials[i].pipeline;
+			next.materials[i].descriptorSet = materials[i].descriptorSet;
+		}
+	}
+
+	std::swap(vertices, next.vertices);
+	std::swap(packedVertices, next.packedVertices);
+	std::swap(indices, next.indices);
+	std::swap(indices16, next.indices16);
+	std::swap(meshes, next.meshes);
+	std::swap(nodes, next.nodes);
+	std::swap(clusters, next.clusters);
+	std::swap(lods, next.lods);
+	std::swap(materials, next.materials);
+	std::swap(textures, next.textures);
+	std::swap(sources, next.sources);
+	std::swap(imageVersions, next.imageVersions);
+	bufferIndices.count = next.bufferIndices.count;
+
+	changes = std::move(reloadChanges);
+	reloadChanges = vkbase::ReloadChanges();
+	drawListDirty = true;
+
+	// The old scene goes with the parser
+	reloadModel->asyncLoad.reset();
+	reloadModel.reset();
+}
+
+void GLTFBase::discardReload(void) {
+	if (reloadModel) {
+		reloadModel->asyncLoad.reset();
+		reloadModel.reset();
+	}
+	finishUploads();
+	reloadVertexBuffer = vkbase::BufferReload();
+	reloadIndexBuffer = vkbase::BufferReload();
+	reloadIndexBuffer16 = vkbase::BufferReload();
+	reloadedImageIndices.clear();
+	reloadedImages.clear();
+	reloadChanges = vkbase::ReloadChanges();
+}
+
+bool GLTFBase::isBinaryFile(const std::string& filepath) {
+	std::ifstream file(filepath, std::ios::binary);
+	char magic[4] = {};
+	file.read(magic, sizeof(magic));
+	return file && memcmp(magic, "glTF", sizeof(magic)) == 0;
+}
+
+// EXT_meshopt_compression fallback buffers hold no data of their own, compressed buffer views are decoded into them
+static bool isMeshoptFallbackBuffer(const nlohmann::json& buffer) {
+	auto extensions = buffer.find("extensions");
+	if (extensions == buffer.end()) {
+		return false;
+	}
+	auto meshopt = extensions->find("EXT_meshopt_compression");
+	return meshopt != extensions->end() && meshopt->value("fallback", false);
+}
+
+bool GLTFBase::loadTextFile(const std::string& filepath, tinygltf::Model& model) {
+
+	std::ifstream file(filepath, std::ios::binary);
+	std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (!file && !file.eof()) {
+		error = "failed to read " + filepath;
+		return false;
+	}
+	const std::string baseDir = tinygltf::GetBaseDir(filepath);
+
+	if (text.find("EXT_meshopt_compression") == std::string::npos) {
+		return loader.LoadASCIIFromString(&model, &error, &warning, text.c_str(), static_cast<unsigned int>(text.size()), baseDir);
+	}
+
+	nlohmann::json json = nlohmann::json::parse(text, nullptr, false);
+	if (json.is_discarded()) {
+		error = "failed to parse " + filepath;
+		return false;
+	}
+
+	// Fallback buffers without a uri get a one byte placeholder, decodeCompressedViews allocates them
+	std::vector<size_t> fallbackBuffers;
+	if (json.find("buffers") != json.end()) {
+		nlohmann::json& buffers = json["buffers"];
+		for (size_t i = 0; i < buffers.size(); i++) {
+			if (buffers[i].find("uri") == buffers[i].end() && isMeshoptFallbackBuffer(buffers[i])) {
+				buffers[i]["uri"] = "data:application/octet-stream;base64,AA==";
+				buffers[i]["byteLength"] = 1;
+				fallbackBuffers.push_back(i);
+			}
+		}
+	}
+
+	std::string patchedJson = json.dump();
+	if (!loader.LoadASCIIFromString(&model, &error, &warning, patchedJson.c_str(), static_cast<unsigned int>(patchedJson.size()), baseDir)) {
+		return false;
+	}
+
+	for (size_t index : fallbackBuffers) {
+		model.buffers[index].uri.clear();
+		model.buffers[index].data.clear();
+	}
+	return true;
+}
+
+bool GLTFBase::loadBinaryFile(const std::string& filepath, tinygltf::Model& model) {
+
+	// A GLB file is a 12 byte header followed by a JSON chunk and an optional BIN chunk
+	const uint32_t GLB_MAGIC = 0x46546C67;
+	const uint32_t CHUNK_JSON = 0x4E4F534A;
+	const uint32_t CHUNK_BIN = 0x004E4942;
+
+	if (!binaryFile.open(filepath) || binaryFile.size() < 20) {
+		error = "failed to map " + filepath;
+		return false;
+	}
+	const unsigned char* data = binaryFile.data();
+
+	uint32_t header[3];
+	uint32_t jsonChunk[2];
+	memcpy(header, data, sizeof(header));
+	memcpy(jsonChunk, data + 12, sizeof(jsonChunk));
+	const size_t fileLength = std::min<size_t>(header[2], binaryFile.size());
+	if (header[0] != GLB_MAGIC || header[1] != 2 || jsonChunk[1] != CHUNK_JSON || 20 + size_t(jsonChunk[0]) > fileLength) {
+		error = "invalid GLB header in " + filepath;
+		return false;
+	}
+	const char* jsonData = reinterpret_cast<const char*>(data + 20);
+
+	const unsigned char* binData = nullptr;
+	size_t binSize = 0;
+	size_t binOffset = 20 + size_t(jsonChunk[0]);
+	if (binOffset + 8 <= fileLength) {
+		uint32_t binChunk[2];
+		memcpy(binChunk, data + binOffset, sizeof(binChunk));
+		if (binChunk[1] == CHUNK_BIN && binOffset + 8 + binChunk[0] <= fileLength) {
+			binData = data + binOffset + 8;
+			binSize = binChunk[0];
+		}
+	}
+
+	nlohmann::json json = nlohmann::json::parse(jsonData, jsonData + jsonChunk[0], nullptr, false);
+	if (json.is_discarded()) {
+		error = "failed to parse the JSON chunk of " + filepath;
+		return false;
+	}
+
+	// tinygltf would copy the BIN chunk into Buffer::data (and decode embedded images from it)
+	// Instead the BIN buffer is replaced by a one byte placeholder and accessors read from the mapping
+	// EXT_meshopt_compression fallback buffers are not stored in the file at all, decodeCompressedViews allocates them
+	const std::string placeholderUri = "data:application/octet-stream;base64,AA==";
+	std::vector<size_t> binBuffers;
+	std::vector<size_t> fallbackBuffers;
+	if (json.find("buffers") != json.end()) {
+		nlohmann::json& buffers = json["buffers"];
+		for (size_t i = 0; i < buffers.size(); i++) {
+			if (buffers[i].find("uri") == buffers[i].end()) {
+				(isMeshoptFallbackBuffer(buffers[i]) ? fallbackBuffers : binBuffers).push_back(i);
+				buffers[i]["uri"] = placeholderUri;
+				buffers[i]["byteLength"] = 1;
+			}
+		}
+	}
+	// Images stored in buffer views are decoded by loadImages
+	struct BufferViewImage {
+		size_t index;
+		int bufferView;
+		std::string mimeType;
+	};
+	std::vector<BufferViewImage> bufferViewImages;
+	if (json.find("images") != json.end()) {
+		nlohmann::json& images = json["images"];
+		for (size_t i = 0; i < images.size(); i++) {
+			if (images[i].find("bufferView") != images[i].end()) {
+				bufferViewImages.push_back({ i, images[i]["bufferView"].get<int>(), images[i].value("mimeType", "") });
+				images[i].erase("bufferView");
+				images[i]["uri"] = placeholderUri;
+			}
+		}
+	}
+
+	if (!binBuffers.empty() && !binData) {
+		error = "missing BIN chunk in " + filepath;
+		return false;
+	}
+
+	// Images are placeholders here, a loader of its own keeps the model's image callback for later .gltf loads
+	std::string patchedJson = json.dump();
+	tinygltf::TinyGLTF binaryLoader;
+	binaryLoader.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	if (!binaryLoader.LoadASCIIFromString(&model, &error, &warning, patchedJson.c_str(), static_cast<unsigned int>(patchedJson.size()), path)) {
+		return false;
+	}
+
+	mappedBuffers.assign(model.buffers.size(), nullptr);
+	mappedBufferSizes.assign(model.buffers.size(), 0);
+	for (size_t index : binBuffers) {
+		model.buffers[index].uri.clear();
+		model.buffers[index].data.clear();
+		mappedBuffers[index] = binData;
+		mappedBufferSizes[index] = binSize;
+	}
+
+	// tinygltf only saw the placeholder buffers, views into the BIN chunk are checked against its real length
+	for (size_t i = 0; i < model.bufferViews.size(); i++) {
+		const tinygltf::BufferView& view = model.bufferViews[i];
+		if (view.buffer >= 0 && size_t(view.buffer) < mappedBuffers.size() && mappedBuffers[view.buffer] && view.byteOffset + view.byteLength > binSize) {
+			error = "buffer view " + std::to_string(i) + " exceeds the BIN chunk of " + filepath;
+			return false;
+		}
+	}
+	for (size_t index : fallbackBuffers) {
+		model.buffers[index].uri.clear();
+		model.buffers[index].data.clear();
+	}
+	for (auto& image : bufferViewImages) {
+		model.images[image.index].uri.clear();
+		model.images[image.index].bufferView = image.bufferView;
+		model.images[image.index].mimeType = image.mimeType;
+	}
+
+	return true;
+}
+
+int GLTFBase::decodeCompressedViews(tinygltf::Model& model, uint32_t threadCount) {
+
+	struct CompressedViewDecode {
+		size_t bufferView;
+		vkbase::meshopt::CompressedView source;
+	};
+	std::vector<CompressedViewDecode> decodes;
+
+	// Decoded views are written to the buffer range of the view itself, which is sized for all of them first
+	std::vector<size_t> bufferSizes(model.buffers.size(), 0);
+	for (size_t i = 0; i < model.bufferViews.size(); i++) {
+		const tinygltf::BufferView& view = model.bufferViews[i];
+		auto extension = view.extensions.find("EXT_meshopt_compression");
+		if (extension == view.extensions.end()) {
+			continue;
+		}
+
+		const tinygltf::Value& meshopt = extension->second;
+		auto number = [&](const char* name) {
+			return static_cast<size_t>(meshopt.Get(name).IsNumber() ? meshopt.Get(name).GetNumberAsInt() : 0);
+		};
+		const std::string mode = meshopt.Get("mode").IsString() ? meshopt.Get("mode").Get<std::string>() : "";
+		const std::string filter = meshopt.Get("filter").IsString() ? meshopt.Get("filter").Get<std::string>() : "NONE";
+		const int sourceBuffer = meshopt.Get("buffer").IsNumber() ? static_cast<int>(meshopt.Get("buffer").GetNumberAsInt()) : -1;
+
+		CompressedViewDecode decode{};
+		decode.bufferView = i;
+		decode.source.size = number("byteLength");
+		decode.source.count = number("count");
+		decode.source.stride = number("byteStride");
+		if (mode == "ATTRIBUTES") {
+			decode.source.mode = vkbase::meshopt::CompressionMode::Attributes;
+		} else if (mode == "TRIANGLES") {
+			decode.source.mode = vkbase::meshopt::CompressionMode::Triangles;
+		} else if (mode == "INDICES") {
+			decode.source.mode = vkbase::meshopt::CompressionMode::Indices;
+		} else {
+			std::cerr << "Unknown EXT_meshopt_compression mode " << mode << " in buffer view " << i << std::endl;
+			return -1;
+		}
+		if (filter == "NONE") {
+			decode.source.filter = vkbase::meshopt::CompressionFilter::None;
+		} else if (filter == "OCTAHEDRAL") {
+			decode.source.filter = vkbase::meshopt::CompressionFilter::Octahedral;
+		} else if (filter == "QUATERNION") {
+			decode.source.filter = vkbase::meshopt::CompressionFilter::Quaternion;
+		} else if (filter == "EXPONENTIAL") {
+			decode.source.filter = vkbase::meshopt::CompressionFilter::Exponential;
+		} else {
+			std::cerr << "Unknown EXT_meshopt_compression filter " << filter << " in buffer view " << i << std::endl;
+			return -1;
+		}
+
+		bool valid = sourceBuffer >= 0 && size_t(sourceBuffer) < model.buffers.size() && view.buffer >= 0 && size_t(view.buffer) < model.buffers.size() &&
+			decode.source.count * decode.source.stride <= view.byteLength;
+		valid = valid && number("byteOffset") <= bufferSize(model, sourceBuffer) && decode.source.size <= bufferSize(model, sourceBuffer) - number("byteOffset");
+		// The mapped BIN chunk is read only
+		valid = valid && !(size_t(view.buffer) < mappedBuffers.size() && mappedBuffers[view.buffer]);
+		if (!valid) {
+			std::cerr << "Invalid EXT_meshopt_compression buffer view " << i << std::endl;
+			return -1;
+		}
+
+		decode.source.data = bufferData(model, sourceBuffer) + number("byteOffset");
+		bufferSizes[view.buffer] = std::max(bufferSizes[view.buffer], view.byteOffset + view.byteLength);
+		decodes.push_back(decode);
+	}
+
+	if (decodes.empty()) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < model.buffers.size(); i++) {
+		if (model.buffers[i].data.size() < bufferSizes[i]) {
+			model.buffers[i].data.resize(bufferSizes[i]);
+		}
+	}
+
+	// Views decode into disjoint ranges, the largest ones are handed out first
+	std::sort(decodes.begin(), decodes.end(), [](const CompressedViewDecode& a, const CompressedViewDecode& b) {
+		return a.source.size > b.source.size;
+	});
+
+	std::atomic<int> result(0);
+	vkbase::ThreadPool pool(threadCount);
+	pool.parallelFor(decodes.size(), [&](size_t i) {
+		const tinygltf::BufferView& view = model.bufferViews[decodes[i].bufferView];
+		if (!vkbase::meshopt::decodeView(decodes[i].source, model.buffers[view.buffer].data.data() + view.byteOffset)) {
+			std::cerr << "Failed to decode EXT_meshopt_compression buffer view " << decodes[i].bufferView << std::endl;
+			result = -1;
+		}
+	}, threadCount);
+
+	return result;
+}
+
+const unsigned char* GLTFBase::bufferData(const tinygltf::Model& model, int buffer) const {
+	if (size_t(buffer) < mappedBuffers.size() && mappedBuffers[buffer]) {
+		return mappedBuffers[buffer];
+	}
+	return model.buffers[buffer].data.data();
+}
+
+size_t GLTFBase::bufferSize(const tinygltf::Model& model, int buffer) const {
+	if (size_t(buffer) < mappedBuffers.size() && mappedBuffers[buffer]) {
+		return mappedBufferSizes[buffer];
+	}
+	return model.buffers[buffer].data.size();
+}
+
+uint64_t GLTFBase::settingsHash() const {
+	// Vertex layout changes invalidate existing caches
+	uint64_t hash = vkbase::hashValue(static_cast<uint64_t>(sizeof(Vertex)));
+	hash = vkbase::hashCombine(hash, settings.optimizeMeshes ? 1 : 0);
+	hash = vkbase::hashCombine(hash, static_cast<uint64_t>(settings.vertexFormat));
+	hash = vkbase::hashCombine(hash, settings.buildClusters ? 1 : 0);
+	hash = vkbase::hashCombine(hash, settings.generateTangents ? 1 : 0);
+	hash = vkbase::hashCombine(hash, settings.lodCount);
+	hash = vkbase::hashCombine(hash, vkbase::hashValue(settings.lodTargetError));
+	return hash;
+}
+
+void GLTFBase::writeCache(const std::string& filepath, const tinygltf::Model& input) {
+
+	vkbase::SceneCacheWriter writer;
+
+	// The cache is invalidated by changes to the glTF file and the buffers it references
+	bool sourcesFound = writer.addSource(filepath);
+	for (const tinygltf::Buffer& buffer : input.buffers) {
+		if (!buffer.uri.empty() && buffer.uri.compare(0, 5, "data:") != 0) {
+			sourcesFound = sourcesFound && writer.addSource(path + '/' + buffer.uri);
+		}
+	}
+	// Images embedded in buffer views are only referenced by uri in the cache
+	for (const tinygltf::Image& image : input.images) {
+		sourcesFound = sourcesFound && image.bufferView < 0;
+	}
+	if (!sourcesFound) {
+		return;
+	}
+
+	// The node arrays are already in topological order
+	std::vector<vkbase::SceneCacheNode> cacheNodes(nodes.size());
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		const glm::quat& rotation = nodes.rotation(i);
+		cacheNodes[i].matrix = nodes.matrix(i);
+		cacheNodes[i].rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+		cacheNodes[i].translation = nodes.translation(i);
+		cacheNodes[i].parent = nodes.parent(i);
+		cacheNodes[i].scale = nodes.scale(i);
+		cacheNodes[i].mesh = nodes.mesh(i);
+		cacheNodes[i].name = writer.addString(nodes.name(i));
+	}
+
+	std::vector<vkbase::SceneCacheMesh> cacheMeshes(meshes.size());
+	std::vector<vkbase::Primitive> cachePrimitives;
+	for (size_t i = 0; i < meshes.size(); i++) {
+		cacheMeshes[i].firstPrimitive = static_cast<uint32_t>(cachePrimitives.size());
+		cacheMeshes[i].primitiveCount = static_cast<uint32_t>(meshes[i].primitives.size());
+		cacheMeshes[i].positionOffsetScale = glm::vec4(meshes[i].positionOffset, meshes[i].positionScale);
+		cacheMeshes[i].boundingSphere = meshes[i].boundingSphere;
+		cachePrimitives.insert(cachePrimitives.end(), meshes[i].primitives.begin(), meshes[i].primitives.end());
+	}
+
+	std::vector<vkbase::SceneCacheMaterial> cacheMaterials(materials.size());
+	for (size_t i = 0; i < materials.size(); i++) {
+		cacheMaterials[i].baseColorFactor = materials[i].baseColorFactor;
+		cacheMaterials[i].baseColorTextureIndex = materials[i].baseColorTextureIndex;
+		cacheMaterials[i].normalTextureIndex = materials[i].normalTextureIndex;
+		cacheMaterials[i].alphaCutOff = materials[i].alphaCutOff;
+		cacheMaterials[i].doubleSided = materials[i].doubleSided ? 1 : 0;
+		cacheMaterials[i].alphaMode = writer.addString(materials[i].alphaMode);
+	}
+
+	std::vector<vkbase::SceneCacheString> cacheImages;
+	for (const tinygltf::Image& image : input.images) {
+		cacheImages.push_back(writer.addString(image.uri));
+	}
+
+	if (settings.vertexFormat == vkbase::VertexFormat::Packed) {
+		writer.setSection(vkbase::SceneCacheSection::Vertices, packedVertices);
+	}
+	else {
+		writer.setSection(vkbase::SceneCacheSection::Vertices, vertices);
+	}
+	writer.setSection(vkbase::SceneCacheSection::Indices, indices);
+	writer.setSection(vkbase::SceneCacheSection::Indices16, indices16);
+	writer.setSection(vkbase::SceneCacheSection::Nodes, cacheNodes);
+	writer.setSection(vkbase::SceneCacheSection::Meshes, cacheMeshes);
+	writer.setSection(vkbase::SceneCacheSection::Primitives, cachePrimitives);
+	writer.setSection(vkbase::SceneCacheSection::Clusters, clusters);
+	writer.setSection(vkbase::SceneCacheSection::Lods, lods);
+	writer.setSection(vkbase::SceneCacheSection::Materials, cacheMaterials);
+	writer.setSection(vkbase::SceneCacheSection::Textures, textures);
+	writer.setSection(vkbase::SceneCacheSection::Images, cacheImages);
+
+	if (!writer.write(vkbase::SceneCache::cachePath(filepath), settingsHash())) {
+		std::cerr << "Failed to write scene cache for " << filepath << std::endl;
+	}
+}
+
+bool GLTFBase::loadFromCache(const std::string& filepath) {
+
+	std::unique_ptr<vkbase::SceneCache> cache = std::make_unique<vkbase::SceneCache>();
+	if (!cache->open(vkbase::SceneCache::cachePath(filepath), settingsHash())) {
+		return false;
+	}
+
+	size_t vertexCount, indexCount, indexCount16, nodeCount, meshCount, primitiveCount, clusterCount, lodCount, materialCount, textureCount, imageCount;
+	// Vertices are stored in the format of the settings (part of the settings hash)
+	size_t vertexDataSize;
+	const unsigned char* cacheVertices = cache->sectionData(vkbase::SceneCacheSection::Vertices, vertexDataSize);
+	vertexCount = vertexDataSize / vkbase::vertexStride(settings.vertexFormat);
+	const uint32_t* cacheIndices = cache->section<uint32_t>(vkbase::SceneCacheSection::Indices, indexCount);
+	const uint16_t* cacheIndices16 = cache->section<uint16_t>(vkbase::SceneCacheSection::Indices16, indexCount16);
+	const vkbase::SceneCacheNode* cacheNodes = cache->section<vkbase::SceneCacheNode>(vkbase::SceneCacheSection::Nodes, nodeCount);
+	const vkbase::SceneCacheMesh* cacheMeshes = cache->section<vkbase::SceneCacheMesh>(vkbase::SceneCacheSection::Meshes, meshCount);
+	const vkbase::Primitive* cachePrimitives = cache->section<vkbase::Primitive>(vkbase::SceneCacheSection::Primitives, primitiveCount);
+	const vkbase::meshopt::Meshlet* cacheClusters = cache->section<vkbase::meshopt::Meshlet>(vkbase::SceneCacheSection::Clusters, clusterCount);
+	const vkbase::PrimitiveLod* cacheLods = cache->section<vkbase::PrimitiveLod>(vkbase::SceneCacheSection::Lods, lodCount);
+	const vkbase::SceneCacheMaterial* cacheMaterials = cache->section<vkbase::SceneCacheMaterial>(vkbase::SceneCacheSection::Materials, materialCount);
+	const vkbase::TextureIndices* cacheTextures = cache->section<vkbase::TextureIndices>(vkbase::SceneCacheSection::Textures, textureCount);
+	const vkbase::SceneCacheString* cacheImages = cache->section<vkbase::SceneCacheString>(vkbase::SceneCacheSection::Images, imageCount);
+
+	if (!cacheVertices || !cacheIndices || !cacheIndices16) {
+		return false;
+	}
+
+	// Mesh primitive ranges, shared by all nodes that instance the mesh
+	meshes.resize(meshCount);
+	for (size_t i = 0; i < meshCount; i++) {
+		if (cacheMeshes[i].firstPrimitive + cacheMeshes[i].primitiveCount > primitiveCount) {
+			return false;
+		}
+		meshes[i].primitives.assign(cachePrimitives + cacheMeshes[i].firstPrimitive, cachePrimitives + cacheMeshes[i].firstPrimitive + cacheMeshes[i].primitiveCount);
+		for (const vkbase::Primitive& primitive : meshes[i].primitives) {
+			if (primitive.firstCluster + primitive.clusterCount > clusterCount || primitive.firstLod + primitive.lodCount > lodCount) {
+				return false;
+			}
+		}
+		meshes[i].positionOffset = glm::vec3(cacheMeshes[i].positionOffsetScale);
+		meshes[i].positionScale = cacheMeshes[i].positionOffsetScale.w;
+		meshes[i].boundingSphere = cacheMeshes[i].boundingSphere;
+	}
+
+	// Draws read the index pools and the vertex section without further checks, so a stale or damaged cache that still
+	// matches its hash has to be caught here; the file is decoded from its source instead
+	std::vector<int32_t> vertexOffsets;
+	for (const vkbase::Mesh& mesh : meshes) {
+		for (const vkbase::Primitive& primitive : mesh.primitives) {
+			if (primitive.vertexOffset < 0 || static_cast<size_t>(primitive.vertexOffset) > vertexCount) {
+				return false;
+			}
+			vertexOffsets.push_back(primitive.vertexOffset);
+		}
+	}
+	std::sort(vertexOffsets.begin(), vertexOffsets.end());
+	vertexOffsets.erase(std::unique(vertexOffsets.begin(), vertexOffsets.end()), vertexOffsets.end());
+	for (const vkbase::Mesh& mesh : meshes) {
+		for (const vkbase::Primitive& primitive : mesh.primitives) {
+			// Primitives own contiguous vertex ranges, each one ends where the next one starts
+			auto next = std::upper_bound(vertexOffsets.begin(), vertexOffsets.end(), primitive.vertexOffset);
+			uint64_t rangeVertexCount = (next == vertexOffsets.end() ? vertexCount : static_cast<size_t>(*next)) - primitive.vertexOffset;
+
+			// The full index range and every level have to lie in the primitive's pool and stay inside its vertex range
+			const bool wide = primitive.indexType != VK_INDEX_TYPE_UINT16;
+			const size_t poolCount = wide ? indexCount : indexCount16;
+			auto validRange = [&](uint32_t first, uint32_t count) {
+				if (static_cast<uint64_t>(first) + count > poolCount) {
+					return false;
+				}
+				for (uint32_t j = first; j < first + count; j++) {
+					if ((wide ? cacheIndices[j] : cacheIndices16[j]) >= rangeVertexCount) {
+						return false;
+					}
+				}
+				return true;
+			};
+			if (!validRange(primitive.firstIndex, primitive.indexCount)) {
+				return false;
+			}
+			for (uint32_t level = 0; level < primitive.lodCount; level++) {
+				const vkbase::PrimitiveLod& lod = cacheLods[primitive.firstLod + level];
+				if (!validRange(lod.firstIndex, lod.indexCount)) {
+					return false;
+				}
+			}
+		}
+	}
+	for (size_t i = 0; i < nodeCount; i++) {
+		// Parents precede their children
+		if (cacheNodes[i].parent < -1 || cacheNodes[i].parent >= static_cast<int32_t>(i) || cacheNodes[i].mesh < -1 || cacheNodes[i].mesh >= static_cast<int64_t>(meshCount)) {
+			return false;
+		}
+	}
+
+	// Images are still loaded from their own files, only the uris come from the cache
+	tinygltf::Model imageInput;
+	imageInput.images.resize(imageCount);
+	for (size_t i = 0; i < imageCount; i++) {
+		imageInput.images[i].uri = cache->string(cacheImages[i]);
+	}
+	if (settings.streaming) {
+		streamImages = imageInput;
+	}
+	else {
+		loadImages(imageInput);
+	}
+
+	// A hot reload diffs against the CPU copies, the cache's sources are the glTF file and its buffers
+	if (settings.hotReload && !settings.streaming) {
+		if (settings.vertexFormat == vkbase::VertexFormat::Packed) {
+			const vkbase::PackedVertex* packed = reinterpret_cast<const vkbase::PackedVertex*>(cacheVertices);
+			packedVertices.assign(packed, packed + vertexCount);
+		}
+		else {
+			const Vertex* full = reinterpret_cast<const Vertex*>(cacheVertices);
+			vertices.assign(full, full + vertexCount);
+		}
+		indices.assign(cacheIndices, cacheIndices + indexCount);
+		indices16.assign(cacheIndices16, cacheIndices16 + indexCount16);
+		recordSources(cache->sourcePaths(), imageInput);
+	}
+
+	materials.resize(materialCount);
+	for (size_t i = 0; i < materialCount; i++) {
+		materials[i].baseColorFactor = cacheMaterials[i].baseColorFactor;
+		materials[i].baseColorTextureIndex = cacheMaterials[i].baseColorTextureIndex;
+		materials[i].normalTextureIndex = cacheMaterials[i].normalTextureIndex;
+		materials[i].alphaCutOff = cacheMaterials[i].alphaCutOff;
+		materials[i].doubleSided = cacheMaterials[i].doubleSided != 0;
+		materials[i].alphaMode = cache->string(cacheMaterials[i].alphaMode);
+	}
+
+	textures.assign(cacheTextures, cacheTextures + textureCount);
+	clusters.assign(cacheClusters, cacheClusters + clusterCount);
+	lods.assign(cacheLods, cacheLods + lodCount);
+
+	// Parents precede their children in the cache too (validated above)
+	nodes.clear();
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		const vkbase::SceneCacheNode& cacheNode = cacheNodes[i];
+		uint32_t node = nodes.addNode(cacheNode.parent, cache->string(cacheNode.name));
+		nodes.setTranslation(node, cacheNode.translation);
+		nodes.setRotation(node, glm::quat(cacheNode.rotation.w, cacheNode.rotation.x, cacheNode.rotation.y, cacheNode.rotation.z));
+		nodes.setScale(node, cacheNode.scale);
+		nodes.setMatrix(node, cacheNode.matrix);
+		if (cacheNode.mesh > -1) {
+			nodes.setMesh(node, cacheNode.mesh);
+		}
+	}
+
+	// Streamed geometry stays in the mapped cache until its chunk is loaded
+	if (settings.streaming) {
+		streamCache = std::move(cache);
+		setupStreaming();
+		return true;
+	}
+
+	// Geometry goes straight from the mapped cache into the staging buffers
+	bufferIndices.count = static_cast<uint32_t>(indexCount + indexCount16);
+	vertexBuffer = stageBuffer(cacheVertices, vertexCount * vkbase::vertexStride(settings.vertexFormat), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	if (indexCount > 0) {
+		indexBuffer = stageBuffer(cacheIndices, indexCount * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	}
+	if (indexCount16 > 0) {
+		indexBuffer16 = stageBuffer(cacheIndices16, indexCount16 * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	}
+
+	return true;
+}
+
+
+void GLTFBase::setupStreaming(void) {
+
+	size_t vertexDataSize = 0;
+	streamCache->sectionData(vkbase::SceneCacheSection::Vertices, vertexDataSize);
+	VkDeviceSize stride = vkbase::vertexStride(settings.vertexFormat);
+	int32_t vertexCount = static_cast<int32_t>(vertexDataSize / stride);
+	size_t imageCount = streamImages.images.size();
+
+	// Bounds of every mesh's instances in the scene's root space, from the mesh bounding spheres
+	std::vector<std::vector<glm::mat4>> transforms(meshes.size());
+	collectInstances(transforms);
+	const float infinity = std::numeric_limits<float>::max();
+	std::vector<glm::vec3> boundsMin(meshes.size(), glm::vec3(infinity));
+	std::vector<glm::vec3> boundsMax(meshes.size(), glm::vec3(-infinity));
+	glm::vec3 sceneMin = glm::vec3(infinity);
+	glm::vec3 sceneMax = glm::vec3(-infinity);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const glm::vec4& sphere = meshes[i].boundingSphere;
+		for (const glm::mat4& transform : transforms[i]) {
+			float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+			glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f));
+			boundsMin[i] = glm::min(boundsMin[i], center - glm::vec3(sphere.w * scale));
+			boundsMax[i] = glm::max(boundsMax[i], center + glm::vec3(sphere.w * scale));
+		}
+		if (!transforms[i].empty()) {
+			sceneMin = glm::min(sceneMin, boundsMin[i]);
+			sceneMax = glm::max(sceneMax, boundsMax[i]);
+		}
+	}
+
+	float cellSize = settings.streamingChunkSize;
+	if (cellSize <= 0.0f) {
+		glm::vec3 extent = sceneMax - sceneMin;
+		cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / 8.0f;
+	}
+	std::vector<vkbase::StreamChunk> chunks = vkbase::partitionScene(boundsMin, boundsMax, cellSize);
+
+	// Primitives own contiguous vertex ranges, each one ends where the next one starts
+	std::vector<int32_t> vertexOffsets;
+	for (const vkbase::Mesh& mesh : meshes) {
+		for (const vkbase::Primitive& primitive : mesh.primitives) {
+			vertexOffsets.push_back(primitive.vertexOffset);
+		}
+	}
+	std::sort(vertexOffsets.begin(), vertexOffsets.end());
+	vertexOffsets.erase(std::unique(vertexOffsets.begin(), vertexOffsets.end()), vertexOffsets.end());
+	auto vertexRangeCount = [&](int32_t offset) {
+		auto next = std::upper_bound(vertexOffsets.begin(), vertexOffsets.end(), offset);
+		return static_cast<VkDeviceSize>((next == vertexOffsets.end() ? vertexCount : *next) - offset);
+	};
+
+	// Ranges that follow each other in the cache and in the chunk are copied at once
+	auto appendRange = [](std::vector<VkBufferCopy>& ranges, VkDeviceSize& size, VkDeviceSize srcOffset, VkDeviceSize bytes) {
+		if (!ranges.empty() && ranges.back().srcOffset + ranges.back().size == srcOffset && ranges.back().dstOffset + ranges.back().size == size) {
+			ranges.back().size += bytes;
+		}
+		else {
+			ranges.push_back({ srcOffset, size, bytes });
+		}
+		size += bytes;
+	};
+
+	chunkGeometry.clear();
+	chunkGeometry.resize(chunks.size());
+	for (size_t i = 0; i < chunks.size(); i++) {
+		vkbase::ChunkGeometry& geometry = chunkGeometry[i];
+		std::unordered_map<int32_t, int32_t> chunkVertexOffsets;
+
+		for (uint32_t meshIndex : chunks[i].meshes) {
+			vkbase::Mesh mesh = meshes[meshIndex];
+			for (vkbase::Primitive& primitive : mesh.primitives) {
+				auto vertexOffset = chunkVertexOffsets.find(primitive.vertexOffset);
+				if (vertexOffset == chunkVertexOffsets.end()) {
+					int32_t chunkOffset = static_cast<int32_t>(geometry.vertexBytes / stride);
+					appendRange(geometry.vertexRanges, geometry.vertexBytes, primitive.vertexOffset * stride, vertexRangeCount(primitive.vertexOffset) * stride);
+					vertexOffset = chunkVertexOffsets.emplace(primitive.vertexOffset, chunkOffset).first;
+				}
+				primitive.vertexOffset = vertexOffset->second;
+
+				// The primitive's own range is followed by its levels of detail in the chunk's index pool
+				bool pool16 = primitive.indexType == VK_INDEX_TYPE_UINT16;
+				VkDeviceSize indexSize = pool16 ? sizeof(uint16_t) : sizeof(uint32_t);
+				std::vector<VkBufferCopy>& ranges = pool16 ? geometry.indexRanges16 : geometry.indexRanges;
+				VkDeviceSize& poolBytes = pool16 ? geometry.indexBytes16 : geometry.indexBytes;
+
+				uint32_t firstIndex = static_cast<uint32_t>(poolBytes / indexSize);
+				appendRange(ranges, poolBytes, primitive.firstIndex * indexSize, primitive.indexCount * indexSize);
+				uint32_t firstLod = static_cast<uint32_t>(geometry.lods.size());
+				for (uint32_t level = 0; level < primitive.lodCount; level++) {
+					vkbase::PrimitiveLod lod = lods[primitive.firstLod + level];
+					uint32_t lodFirstIndex = static_cast<uint32_t>(poolBytes / indexSize);
+					appendRange(ranges, poolBytes, lod.firstIndex * indexSize, lod.indexCount * indexSize);
+					lod.firstIndex = lodFirstIndex;
+					geometry.lods.push_back(lod);
+				}
+				primitive.firstIndex = firstIndex;
+				primitive.firstLod = firstLod;
+
+				// The chunk's images are the ones its materials sample
+				if (primitive.materialIndex >= 0 && static_cast<size_t>(primitive.materialIndex) < materials.size()) {
+					const vkbase::Material& material = materials[primitive.materialIndex];
+					for (uint32_t texture : { material.baseColorTextureIndex, material.normalTextureIndex }) {
+						if (texture >= textures.size() || textures[texture].imageIndex < 0 || static_cast<size_t>(textures[texture].imageIndex) >= imageCount) {
+							continue;
+						}
+						uint32_t image = static_cast<uint32_t>(textures[texture].imageIndex);
+						if (std::find(chunks[i].images.begin(), chunks[i].images.end(), image) == chunks[i].images.end()) {
+							chunks[i].images.push_back(image);
+						}
+					}
+				}
+			}
+			geometry.meshes.push_back(mesh);
+		}
+		chunks[i].geometryBytes = geometry.vertexBytes + geometry.indexBytes + geometry.indexBytes16;
+	}
+
+	// Image sizes are estimated from their files until they are loaded
+	std::vector<uint64_t> imageBytes(imageCount, 0);
+	for (size_t i = 0; i < imageCount; i++) {
+		vkbase::FileWatcher::FileState state;
+		if (vkbase::FileWatcher::fileState(path + '/' + streamImages.images[i].uri, state)) {
+			imageBytes[i] = state.size;
+		}
+	}
+	streamResidency.reset(chunks, imageBytes, settings.streamingBudget);
+
+	// Nothing is resident yet, the image table starts out empty and every material samples the placeholder
+	installReloadImages(imageCount);
+	tinygltf::Image placeholder;
+	placeholder.width = 1;
+	placeholder.height = 1;
+	placeholder.component = 4;
+	placeholder.image.assign(4, 255);
+	placeholderImage = std::make_unique<vkbase::PNGTexture>();
+	placeholderImage->stageImage(placeholder, VK_FORMAT_R8G8B8A8_UNORM);
+
+	std::cout << "streaming " << chunks.size() << " chunks (" << cellSize << " units per cell) with a budget of " << (settings.streamingBudget >> 20) << " MB" << std::endl;
+}
+
+void GLTFBase::stageChunk(vkbase::ChunkGeometry& chunk) {
+
+	// The ranges are gathered into one block per buffer, the cache pages they came from are released right away
+	auto gather = [&](vkbase::SceneCacheSection section, const std::vector<VkBufferCopy>& ranges, VkDeviceSize size, VkBufferUsageFlags usage) -> std::unique_ptr<vkbase::Buffer> {
+		if (size == 0) {
+			return nullptr;
+		}
+		size_t sectionSize = 0;
+		const unsigned char* source = streamCache->sectionData(section, sectionSize);
+		std::vector<unsigned char> data(size);
+		for (const VkBufferCopy& range : ranges) {
+			memcpy(data.data() + range.dstOffset, source + range.srcOffset, range.size);
+			streamCache->release(source + range.srcOffset, range.size);
+		}
+		return stageBuffer(data.data(), size, usage);
+	};
+
+	chunk.vertexBuffer = gather(vkbase::SceneCacheSection::Vertices, chunk.vertexRanges, chunk.vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	chunk.indexBuffer = gather(vkbase::SceneCacheSection::Indices, chunk.indexRanges, chunk.indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	chunk.indexBuffer16 = gather(vkbase::SceneCacheSection::Indices16, chunk.indexRanges16, chunk.indexBytes16, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+}
+
+VkDescriptorImageInfo GLTFBase::placeholderDescriptor(void) const {
+	return placeholderImage ? placeholderImage->descriptor : VkDescriptorImageInfo{};
+}
+
+bool GLTFBase::pollStreaming(std::vector<uint32_t>& images) {
+
+	images.clear();
+	if (!streamCache || (asyncLoad && !asyncLoad->resident())) {
+		return false;
+	}
+
+	// Evictions have their own fence and list, the stream thread may be staging into pendingUploads meanwhile
+	if (evictionFence != VK_NULL_HANDLE && vkGetFenceStatus(global_device->logicalDevice, evictionFence) == VK_SUCCESS) {
+		vkDestroyFence(global_device->logicalDevice, evictionFence, nullptr);
+		evictionFence = VK_NULL_HANDLE;
+		evictedBuffers.clear();
+		evictedImages.clear();
+	}
+
+	// The staging memory of the previous batch and the objects it replaced are released once its upload completed
+	if (uploadFence != VK_NULL_HANDLE) {
+		if (vkGetFenceStatus(global_device->logicalDevice, uploadFence) != VK_SUCCESS) {
+			return false;
+		}
+		vkDestroyFence(global_device->logicalDevice, uploadFence, nullptr);
+		vkFreeCommandBuffers(global_device->logicalDevice, global_device->command_pool, 1, &uploadCommandBuffer);
+		uploadFence = VK_NULL_HANDLE;
+		uploadCommandBuffer = VK_NULL_HANDLE;
+		finishUploads();
+		retiredBuffers.clear();
+		retiredImages.clear();
+	}
+
+	size_t imageCount = streamImages.images.size();
+
+	if (streamBatch) {
+		vkbase::LoadState state = streamBatch->state;
+		if (state == vkbase::LoadState::Loading) {
+			return false;
+		}
+		streamThread.join();
+		streamBatch.reset();
+
+		if (state != vkbase::LoadState::Staged) {
+			// Nothing of a failed batch was submitted, its chunks are planned again later on
+			for (uint32_t chunk : streamLoads) {
+				chunkGeometry[chunk].vertexBuffer.reset();
+				chunkGeometry[chunk].indexBuffer.reset();
+				chunkGeometry[chunk].indexBuffer16.reset();
+			}
+			finishUploads();
+			reloadedImageIndices.clear();
+			reloadedImages.clear();
+			streamResidency.cancelLoads(streamLoads);
+			streamLoads.clear();
+			return false;
+		}
+
+		for (size_t i = 0; i < reloadedImageIndices.size(); i++) {
+			streamResidency.setImageBytes(reloadedImageIndices[i], streamImageBytes[i]);
+		}
+		images = reloadedImageIndices;
+		installReloadImages(imageCount);
+		reloadedImageIndices.clear();
+
+		uploadCommandBuffer = global_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+		// As for a reload, the barrier makes the upload fence cover the frames that still drew the evicted chunks
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		// The streamed images are installed already, so their uploads are recorded with the model's images
+		recordUploads(uploadCommandBuffer);
+		vkEndCommandBuffer(uploadCommandBuffer);
+
+		VkFenceCreateInfo fenceInfo = vkbase::initializers::fenceCreateInfo();
+		if (vkCreateFence(global_device->logicalDevice, &fenceInfo, nullptr, &uploadFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload fence");
+		}
+
+		VkSubmitInfo submitInfo = vkbase::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &uploadCommandBuffer;
+		if (vkQueueSubmit(copyQueue, 1, &submitInfo, uploadFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit streamed chunks");
+		}
+
+		// Frames recorded from now on are submitted after the upload
+		streamResidency.finishLoads(streamLoads);
+		streamLoads.clear();
+		drawListDirty = true;
+		return true;
+	}
+
+	// One eviction at a time, the next plan waits until the previous evictions are released
+	if (evictionFence != VK_NULL_HANDLE) {
+		return false;
+	}
+
+	// Distances are measured like selectLod does, from the camera to the chunk's bounding sphere
+	const std::vector<vkbase::StreamChunk>& chunks = streamResidency.chunks();
+	std::vector<float> distances(chunks.size());
+	for (size_t i = 0; i < chunks.size(); i++) {
+		const glm::mat4& world = lodView.sceneMatrix;
+		float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+		glm::vec3 center = glm::vec3(world * glm::vec4(glm::vec3(chunks[i].boundingSphere), 1.0f));
+		distances[i] = std::max(0.0f, glm::length(center - lodView.cameraPosition) - chunks[i].boundingSphere.w * scale);
+	}
+
+	std::vector<uint32_t> evict;
+	std::vector<uint32_t> evictImages;
+	streamResidency.plan(distances, settings.streamingUploadLimit, streamLoads, evict, streamLoadImages, evictImages);
+
+	// Evicted buffers and images stay alive until the frames submitted so far completed
+	drawListDirty = drawListDirty || !evict.empty();
+	for (uint32_t chunk : evict) {
+		std::unique_ptr<vkbase::Buffer>* buffers[3] = { &chunkGeometry[chunk].vertexBuffer, &chunkGeometry[chunk].indexBuffer, &chunkGeometry[chunk].indexBuffer16 };
+		for (std::unique_ptr<vkbase::Buffer>* buffer : buffers) {
+			if (*buffer) {
+				evictedBuffers.push_back(std::move(*buffer));
+			}
+		}
+	}
+	if (!evictImages.empty()) {
+		// An evicted image is swapped for an empty texture, so its descriptors fall back to the placeholder
+		for (uint32_t image : evictImages) {
+			reloadedImageIndices.push_back(image);
+			reloadedImages.push_back(std::make_unique<vkbase::PNGTexture>());
+		}
+		size_t retiredCount = retiredImages.size();
+		installReloadImages(imageCount);
+		reloadedImageIndices.clear();
+		for (size_t i = retiredCount; i < retiredImages.size(); i++) {
+			evictedImages.push_back(std::move(retiredImages[i]));
+		}
+		retiredImages.resize(retiredCount);
+		images = evictImages;
+	}
+	if (!evictedBuffers.empty() || !evictedImages.empty()) {
+		// An empty submission's fence signals after everything submitted to the queue before it, without waiting for a later batch
+		VkFenceCreateInfo fenceInfo = vkbase::initializers::fenceCreateInfo();
+		if (vkCreateFence(global_device->logicalDevice, &fenceInfo, nullptr, &evictionFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create eviction fence");
+		}
+		if (vkQueueSubmit(copyQueue, 0, nullptr, evictionFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit eviction fence");
+		}
+	}
+
+	if (streamLoads.empty()) {
+		return !images.empty();
+	}
+
+	// The chunks and their new images are staged on a thread, the next call after it finished submits them
+	streamImageBytes.clear();
+	std::shared_ptr<vkbase::ModelLoad> batch = std::make_shared<vkbase::ModelLoad>();
+	streamBatch = batch;
+	streamThread = std::thread([this, batch]() {
+		bool staged = true;
+		try {
+			for (uint32_t chunk : streamLoads) {
+				if (batch->cancelRequested) {
+					break;
+				}
+				stageChunk(chunkGeometry[chunk]);
+			}
+			for (uint32_t image : streamLoadImages) {
+				if (batch->cancelRequested) {
+					break;
+				}
+				std::unique_ptr<vkbase::BaseTexture> texture = stageReloadImage(streamImages, image);
+				// Decoded texels are only needed for the staging copy
+				std::vector<unsigned char>().swap(streamImages.images[image].image);
+				if (!texture) {
+					continue;
+				}
+				VmaAllocationInfo allocationInfo = {};
+				vmaGetAllocationInfo(global_allocator->allocator, texture->allocation, &allocationInfo);
+				reloadedImageIndices.push_back(image);
+				reloadedImages.push_back(std::move(texture));
+				streamImageBytes.push_back(allocationInfo.size);
+			}
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Failed to stream chunks: " << e.what() << std::endl;
+			staged = false;
+		}
+
+		if (batch->cancelRequested) {
+			batch->state = vkbase::LoadState::Cancelled;
+		}
+		else {
+			batch->state = staged ? vkbase::LoadState::Staged : vkbase::LoadState::Failed;
+		}
+	});
+
+	return !images.empty();
+}
+
+
+// Swaps the staged images of a reload into images (resized to imageCount), the replaced ones are moved to retired
+template<typename Texture>
+static void installImages(std::vector<Texture>& images, size_t imageCount, const std::vector<uint32_t>& indices,
+	std::vector<std::unique_ptr<vkbase::BaseTexture>>& staged, std::vector<std::unique_ptr<vkbase::BaseTexture>>& retired) {
+
+	if (imageCount != images.size()) {
+		// Textures can't be moved by the vector itself, the resized table takes them over one by one
+		std::vector<Texture> resized(imageCount);
+		for (size_t i = 0; i < images.size(); i++) {
+			if (i < imageCount) {
+				images[i].moveTo(resized[i]);
+			}
+			else {
+				retired.push_back(std::make_unique<Texture>());
+				images[i].moveTo(*retired.back());
+			}
+		}
+		images.swap(resized);
+	}
+
+	for (size_t i = 0; i < indices.size(); i++) {
+		Texture& image = images[indices[i]];
+		retired.push_back(std::make_unique<Texture>());
+		image.moveTo(*retired.back());
+		staged[i]->moveTo(image);
+	}
+	staged.clear();
+}
+
+
+GLTFKtxModel::GLTFKtxModel(const std::string& filepath, VkQueue copyQueue, const vkbase::LoaderSettings& settings) : GLTFKtxModel(copyQueue, settings) {
+
+	loadFromFile(filepath);
+}
+
+GLTFKtxModel::GLTFKtxModel(VkQueue copyQueue, const vkbase::LoaderSettings& settings) : GLTFBase("", copyQueue, settings) {
+
+	this->copyQueue = copyQueue;
+
+	loader.SetImageLoader(loadImageDataFunc, nullptr);
+}
+
+
+VkDescriptorImageInfo GLTFKtxModel::getTextureDescriptor(const size_t index) {
+	// Streamed images that aren't resident sample the placeholder
+	if (images[index].view == VK_NULL_HANDLE && placeholderImage) {
+		return placeholderDescriptor();
+	}
+	return images[index].descriptor;
+}
+
+
+GLTFKtxModel::~GLTFKtxModel() {
+	// The loader thread may still be staging images
+	abortLoad();
+}
+
+
+int GLTFKtxModel::loadImages(tinygltf::Model& model) {
+	
+	images.resize(model.images.size());
+	for (size_t i = 0; i < model.images.size(); i++) {
+		tinygltf::Image& image = model.images[i];
+		std::string complete_path = path + '/' + image.uri;
+		images[i].stageFromFile(complete_path, VK_FORMAT_R8G8B8A8_UNORM);
+	}
+	return 0;
+}
+
+void GLTFKtxModel::recordImageUploads(VkCommandBuffer cmd) {
+	for (auto& image : images) {
+		image.recordUpload(cmd);
+	}
+}
+
+void GLTFKtxModel::finishImageUploads(void) {
+	for (auto& image : images) {
+		image.finishUpload();
+	}
+}
+
+std::unique_ptr<vkbase::BaseTexture> GLTFKtxModel::stageReloadImage(tinygltf::Model& model, uint32_t index) {
+	std::unique_ptr<vkbase::KtxTexture> texture = std::make_unique<vkbase::KtxTexture>();
+	if (!texture->stageFromFile(path + '/' + model.images[index].uri, VK_FORMAT_R8G8B8A8_UNORM)) {
+		return nullptr;
+	}
+	return texture;
+}
+
+void GLTFKtxModel::installReloadImages(size_t imageCount) {
+	installImages(images, imageCount, reloadedImageIndices, reloadedImages, retiredImages);
+}
+
+GLTFPngModel::GLTFPngModel(const std::string& filepath, VkQueue copyQueue, const vkbase::LoaderSettings& settings) : GLTFPngModel(copyQueue, settings) {
+
+	loadFromFile(filepath);
+}
+
+GLTFPngModel::GLTFPngModel(VkQueue copyQueue, const vkbase::LoaderSettings& settings) : GLTFBase("", copyQueue, settings) {
+
+	this->copyQueue = copyQueue;
+}
+
+GLTFPngModel::~GLTFPngModel() {
+	// The loader thread may still be staging images
+	abortLoad();
+}
+
+
+VkDescriptorImageInfo GLTFPngModel::getTextureDescriptor(const size_t index) {
+	// Streamed images that aren't resident sample the placeholder
+	if (images[index].view == VK_NULL_HANDLE && placeholderImage) {
+		return placeholderDescriptor();
+	}
+	return images[index].descriptor;
+}
+
+int GLTFPngModel::loadImages(tinygltf::Model& model) {
+	images.resize(model.images.size());
+	for (size_t i = 0; i < model.images.size(); i++) {
+		stageImage(model, i, images[i]);
 	}
 	return 0;
+}
+
+bool GLTFPngModel::stageImage(tinygltf::Model& model, size_t index, vkbase::PNGTexture& texture) {
+	tinygltf::Image& image = model.images[index];
+	std::string complete_path = path + '/' + image.uri;
+	// Images are not decoded by tinygltf when the scene comes from the cache or a GLB file
+	if (image.image.empty()) {
+		// Streamed images are decoded on the stream thread, the model's error and warning strings are not touched here
+		std::string imageError;
+		std::string imageWarning;
+		bool decoded = false;
+		if (image.bufferView >= 0) {
+			const tinygltf::BufferView& view = model.bufferViews[image.bufferView];
+			decoded = tinygltf::LoadImageData(&image, static_cast<int>(index), &imageError, &imageWarning, 0, 0, bufferData(model, view.buffer) + view.byteOffset, static_cast<int>(view.byteLength), nullptr);
+		}
+		else {
+			std::vector<char> bytes = vkbase::Tools::readFile(complete_path);
+			decoded = tinygltf::LoadImageData(&image, static_cast<int>(index), &imageError, &imageWarning, 0, 0, reinterpret_cast<const unsigned char*>(bytes.data()), static_cast<int>(bytes.size()), nullptr);
+		}
+		if (!imageWarning.empty()) {
+			printf("Warning: %s\n", imageWarning.c_str());
+		}
+		if (!decoded) {
+			std::cerr << "Failed to load image " << (image.bufferView >= 0 ? image.name : complete_path) << ": " << imageError << std::endl;
+			return false;
+		}
+	}
+	texture.stageImage(image, VK_FORMAT_R8G8B8A8_UNORM);
+	return true;
+}
+
+void GLTFPngModel::recordImageUploads(VkCommandBuffer cmd) {
+	for (auto& image : images) {
+		image.recordUpload(cmd);
+	}
+}
+
+void GLTFPngModel::finishImageUploads(void) {
+	for (auto& image : images) {
+		image.finishUpload();
+	}
+}
+
+std::unique_ptr<vkbase::BaseTexture> GLTFPngModel::stageReloadImage(tinygltf::Model& model, uint32_t index) {
+	std::unique_ptr<vkbase::PNGTexture> texture = std::make_unique<vkbase::PNGTexture>();
+	if (!stageImage(model, index, *texture)) {
+		return nullptr;
+	}
+	return texture;
+}
+
+void GLTFPngModel::installReloadImages(size_t imageCount) {
+	installImages(images, imageCount, reloadedImageIndices, reloadedImages, retiredImages);
 }
\ No newline at end of file
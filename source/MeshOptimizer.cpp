@@ -0,0 +1,886 @@
+#include "../include/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+	const uint32_t INVALID_INDEX = ~0u;
+
+	// FIFO cache simulation, a vertex is cached while fewer than cacheSize misses happened since it was loaded
+	struct CacheSimulation {
+		CacheSimulation(size_t vertexCount, uint32_t cacheSize) : cacheTime(vertexCount, 0), cacheSize(cacheSize), timestamp(cacheSize + 1) {}
+
+		// Returns the number of misses of a triangle
+		uint32_t triangle(const uint32_t* triangleIndices) {
+			uint32_t misses = 0;
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t v = triangleIndices[k];
+				if (timestamp - cacheTime[v] > cacheSize) {
+					cacheTime[v] = timestamp++;
+					misses++;
+				}
+			}
+			return misses;
+		}
+
+		void flush() {
+			timestamp += cacheSize + 1;
+		}
+
+		std::vector<uint32_t> cacheTime;
+		uint32_t cacheSize;
+		uint32_t timestamp;
+	};
+
+	// Triangles using each vertex, stored as one flat array with per vertex offsets
+	struct TriangleAdjacency {
+		TriangleAdjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount) : counts(vertexCount, 0), offsets(vertexCount, 0), data(indexCount) {
+			for (size_t i = 0; i < indexCount; i++) {
+				counts[indices[i]]++;
+			}
+			uint32_t offset = 0;
+			for (size_t v = 0; v < vertexCount; v++) {
+				offsets[v] = offset;
+				offset += counts[v];
+			}
+			std::vector<uint32_t> fill(offsets);
+			for (size_t i = 0; i < indexCount; i++) {
+				data[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<uint32_t> counts;
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> data;
+	};
+
+	void position(const float* positions, size_t stride, uint32_t index, float* result) {
+		memcpy(result, reinterpret_cast<const unsigned char*>(positions) + index * stride, 3 * sizeof(float));
+	}
+
+	// Symmetric 4x4 error quadric of a set of planes, error(p) is the weighted sum of squared plane distances
+	struct Quadric {
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double weight;
+
+		void addPlane(const double* normal, double distance, double planeWeight) {
+			a00 += planeWeight * normal[0] * normal[0];
+			a11 += planeWeight * normal[1] * normal[1];
+			a22 += planeWeight * normal[2] * normal[2];
+			a01 += planeWeight * normal[0] * normal[1];
+			a02 += planeWeight * normal[0] * normal[2];
+			a12 += planeWeight * normal[1] * normal[2];
+			b0 += planeWeight * normal[0] * distance;
+			b1 += planeWeight * normal[1] * distance;
+			b2 += planeWeight * normal[2] * distance;
+			c += planeWeight * distance * distance;
+			weight += planeWeight;
+		}
+
+		void add(const Quadric& other) {
+			a00 += other.a00; a11 += other.a11; a22 += other.a22;
+			a01 += other.a01; a02 += other.a02; a12 += other.a12;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+		}
+
+		// Weighted average squared distance of p to the planes
+		double error(const float* p) const {
+			double x = p[0], y = p[1], z = p[2];
+			double result = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return weight > 0.0 ? std::max(result, 0.0) / weight : 0.0;
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double error;
+	};
+
+	void cross(const float* a, const float* b, const float* c, float* result) {
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		result[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		result[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		result[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+}
+
+
+namespace vkbase {
+
+	namespace meshopt {
+
+		VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+			VertexCacheStats stats{};
+			if (indexCount < 3 || vertexCount == 0) {
+				return stats;
+			}
+
+			CacheSimulation cache(vertexCount, cacheSize);
+			std::vector<bool> referenced(vertexCount, false);
+			size_t misses = 0;
+			size_t referencedCount = 0;
+			for (size_t i = 0; i + 2 < indexCount; i += 3) {
+				misses += cache.triangle(indices + i);
+				for (size_t k = 0; k < 3; k++) {
+					if (!referenced[indices[i + k]]) {
+						referenced[indices[i + k]] = true;
+						referencedCount++;
+					}
+				}
+			}
+
+			stats.acmr = float(misses) / float(indexCount / 3);
+			stats.atvr = float(misses) / float(referencedCount);
+			return stats;
+		}
+
+		void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount == 0 || vertexCount == 0) {
+				return;
+			}
+
+			TriangleAdjacency adjacency(indices, triangleCount * 3, vertexCount);
+
+			// live triangle count of every vertex
+			std::vector<uint32_t> live(adjacency.counts);
+			std::vector<uint32_t> cacheTime(vertexCount, 0);
+			std::vector<bool> emitted(triangleCount, false);
+			std::vector<uint32_t> deadEnd;
+			std::vector<uint32_t> candidates;
+			std::vector<uint32_t> result;
+			result.reserve(triangleCount * 3);
+
+			uint32_t timestamp = cacheSize + 1;
+			uint32_t cursor = 0;
+			uint32_t fanningVertex = 0;
+
+			while (fanningVertex != INVALID_INDEX) {
+
+				// Emit all remaining triangles around the fanning vertex
+				candidates.clear();
+				for (uint32_t j = 0; j < adjacency.counts[fanningVertex]; j++) {
+					uint32_t triangle = adjacency.data[adjacency.offsets[fanningVertex] + j];
+					if (emitted[triangle]) {
+						continue;
+					}
+					for (uint32_t k = 0; k < 3; k++) {
+						uint32_t v = indices[triangle * 3 + k];
+						result.push_back(v);
+						deadEnd.push_back(v);
+						candidates.push_back(v);
+						live[v]--;
+						if (timestamp - cacheTime[v] > cacheSize) {
+							cacheTime[v] = timestamp++;
+						}
+					}
+					emitted[triangle] = true;
+				}
+
+				// Next fanning vertex: the candidate that stays in the cache the longest while its remaining triangles are emitted
+				uint32_t best = INVALID_INDEX;
+				int64_t bestPriority = -1;
+				for (uint32_t v : candidates) {
+					if (live[v] == 0) {
+						continue;
+					}
+					int64_t priority = 0;
+					if (int64_t(timestamp) - cacheTime[v] + 2 * int64_t(live[v]) <= cacheSize) {
+						priority = int64_t(timestamp) - cacheTime[v];
+					}
+					if (priority > bestPriority) {
+						bestPriority = priority;
+						best = v;
+					}
+				}
+
+				// Dead end: fall back to recently used vertices, then to the next vertex in input order
+				while (best == INVALID_INDEX && !deadEnd.empty()) {
+					uint32_t v = deadEnd.back();
+					deadEnd.pop_back();
+					if (live[v] > 0) {
+						best = v;
+					}
+				}
+				while (best == INVALID_INDEX && cursor < vertexCount) {
+					if (live[cursor] > 0) {
+						best = cursor;
+					}
+					cursor++;
+				}
+				fanningVertex = best;
+			}
+
+			memcpy(indices, result.data(), result.size() * sizeof(uint32_t));
+		}
+
+		void optimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, float threshold, uint32_t cacheSize) {
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount < 2 || vertexCount == 0) {
+				return;
+			}
+
+			// Hard boundaries: triangles that miss all three vertices usually start a new patch of the mesh
+			std::vector<size_t> hardBoundaries;
+			{
+				CacheSimulation cache(vertexCount, cacheSize);
+				for (size_t i = 0; i < triangleCount; i++) {
+					if (cache.triangle(indices + i * 3) == 3) {
+						hardBoundaries.push_back(i);
+					}
+				}
+				hardBoundaries.push_back(triangleCount);
+			}
+
+			// Soft boundaries: split the hard clusters further as long as the cache efficiency stays within the threshold
+			std::vector<size_t> clusters;
+			{
+				CacheSimulation cache(vertexCount, cacheSize);
+				for (size_t c = 0; c + 1 < hardBoundaries.size(); c++) {
+					size_t start = hardBoundaries[c];
+					size_t end = hardBoundaries[c + 1];
+
+					cache.flush();
+					uint32_t misses = 0;
+					for (size_t i = start; i < end; i++) {
+						misses += cache.triangle(indices + i * 3);
+					}
+					float thresholdAcmr = float(misses) / float(end - start) * threshold;
+
+					cache.flush();
+					size_t clusterStart = start;
+					uint32_t clusterMisses = 0;
+					clusters.push_back(start);
+					for (size_t i = start; i < end; i++) {
+						clusterMisses += cache.triangle(indices + i * 3);
+						if (i + 1 < end && float(clusterMisses) / float(i + 1 - clusterStart) <= thresholdAcmr) {
+							clusters.push_back(i + 1);
+							clusterStart = i + 1;
+							clusterMisses = 0;
+							cache.flush();
+						}
+					}
+				}
+				clusters.push_back(triangleCount);
+			}
+
+			if (clusters.size() <= 2) {
+				return;
+			}
+
+			// Sort key: how far the cluster faces away from the mesh centre, outward facing clusters occlude the most
+			float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+			for (size_t i = 0; i < indexCount; i++) {
+				float p[3];
+				position(positions, positionStride, indices[i], p);
+				for (int k = 0; k < 3; k++) {
+					meshCentroid[k] += p[k] / float(indexCount);
+				}
+			}
+
+			const size_t clusterCount = clusters.size() - 1;
+			std::vector<float> sortKeys(clusterCount);
+			for (size_t c = 0; c < clusterCount; c++) {
+				float centroid[3] = { 0.0f, 0.0f, 0.0f };
+				float normal[3] = { 0.0f, 0.0f, 0.0f };
+				float area = 0.0f;
+				for (size_t i = clusters[c]; i < clusters[c + 1]; i++) {
+					float p0[3], p1[3], p2[3];
+					position(positions, positionStride, indices[i * 3 + 0], p0);
+					position(positions, positionStride, indices[i * 3 + 1], p1);
+					position(positions, positionStride, indices[i * 3 + 2], p2);
+
+					float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+					float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+					float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+					float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+					for (int k = 0; k < 3; k++) {
+						centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * triangleArea;
+						normal[k] += n[k];
+					}
+					area += triangleArea;
+				}
+
+				float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				float key = 0.0f;
+				if (area > 0.0f && normalLength > 0.0f) {
+					for (int k = 0; k < 3; k++) {
+						key += (centroid[k] / area - meshCentroid[k]) * (normal[k] / normalLength);
+					}
+				}
+				sortKeys[c] = key;
+			}
+
+			std::vector<size_t> order(clusterCount);
+			for (size_t c = 0; c < clusterCount; c++) {
+				order[c] = c;
+			}
+			std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			std::vector<uint32_t> result;
+			result.reserve(triangleCount * 3);
+			for (size_t c : order) {
+				result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+			}
+			memcpy(indices, result.data(), result.size() * sizeof(uint32_t));
+		}
+
+		std::vector<Meshlet> buildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles) {
+			std::vector<Meshlet> meshlets;
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount == 0 || vertexCount == 0) {
+				return meshlets;
+			}
+
+			// Id of the last meshlet that used each vertex
+			std::vector<uint32_t> lastMeshlet(vertexCount, INVALID_INDEX);
+			uint32_t meshletId = 0;
+
+			Meshlet meshlet{};
+			auto finish = [&]() {
+				computeMeshletBounds(meshlet, indices + meshlet.firstIndex, positions, positionStride);
+				meshlets.push_back(meshlet);
+				meshletId++;
+			};
+
+			for (size_t i = 0; i < triangleCount; i++) {
+				uint32_t a = indices[i * 3 + 0];
+				uint32_t b = indices[i * 3 + 1];
+				uint32_t c = indices[i * 3 + 2];
+
+				uint32_t newVertices = (lastMeshlet[a] != meshletId ? 1 : 0) +
+					(lastMeshlet[b] != meshletId && b != a ? 1 : 0) +
+					(lastMeshlet[c] != meshletId && c != a && c != b ? 1 : 0);
+
+				if (meshlet.indexCount > 0 && (meshlet.vertexCount + newVertices > maxVertices || meshlet.indexCount / 3 + 1 > maxTriangles)) {
+					finish();
+					meshlet = Meshlet{};
+					meshlet.firstIndex = static_cast<uint32_t>(i * 3);
+					newVertices = 1 + (b != a ? 1 : 0) + (c != a && c != b ? 1 : 0);
+				}
+
+				lastMeshlet[a] = lastMeshlet[b] = lastMeshlet[c] = meshletId;
+				meshlet.vertexCount += newVertices;
+				meshlet.indexCount += 3;
+			}
+			finish();
+
+			return meshlets;
+		}
+
+		void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const float* positions, size_t positionStride) {
+			const uint32_t triangleCount = meshlet.indexCount / 3;
+
+			// Bounding sphere (Ritter): start with the two most distant of a few extreme points, then grow
+			// Meshlets hold at least one triangle, the extreme points start at its first vertex
+			float p0[3], p1[3], p2[3], p[3];
+			position(positions, positionStride, indices[0], p0);
+			memcpy(p1, p0, sizeof(p0));
+			memcpy(p2, p0, sizeof(p0));
+			auto distance2 = [](const float* a, const float* b) {
+				return (a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]);
+			};
+			float farthest = -1.0f;
+			for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+				position(positions, positionStride, indices[i], p);
+				if (distance2(p, p0) > farthest) {
+					farthest = distance2(p, p0);
+					memcpy(p1, p, sizeof(p));
+				}
+			}
+			farthest = -1.0f;
+			for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+				position(positions, positionStride, indices[i], p);
+				if (distance2(p, p1) > farthest) {
+					farthest = distance2(p, p1);
+					memcpy(p2, p, sizeof(p));
+				}
+			}
+
+			float center[3] = { (p1[0] + p2[0]) * 0.5f, (p1[1] + p2[1]) * 0.5f, (p1[2] + p2[2]) * 0.5f };
+			float radius = std::sqrt(distance2(p1, p2)) * 0.5f;
+			for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+				position(positions, positionStride, indices[i], p);
+				float d = std::sqrt(distance2(p, center));
+				if (d > radius) {
+					// move the sphere towards the point so that it touches the old sphere's far side
+					float newRadius = (radius + d) * 0.5f;
+					float k = (newRadius - radius) / d;
+					for (int j = 0; j < 3; j++) {
+						center[j] += (p[j] - center[j]) * k;
+					}
+					radius = newRadius;
+				}
+			}
+			memcpy(meshlet.center, center, sizeof(center));
+			meshlet.radius = radius;
+
+			// Normal cone: axis is the average triangle normal, the cutoff follows from the normal furthest from it
+			std::vector<float> normals;
+			normals.reserve(triangleCount * 3);
+			float axis[3] = { 0.0f, 0.0f, 0.0f };
+			for (uint32_t i = 0; i < triangleCount; i++) {
+				float a[3], b[3], c[3];
+				position(positions, positionStride, indices[i * 3 + 0], a);
+				position(positions, positionStride, indices[i * 3 + 1], b);
+				position(positions, positionStride, indices[i * 3 + 2], c);
+				float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				// degenerate triangles can not be seen from any side
+				if (length == 0.0f) {
+					continue;
+				}
+				for (int j = 0; j < 3; j++) {
+					normals.push_back(n[j] / length);
+					axis[j] += n[j] / length;
+				}
+			}
+
+			memcpy(meshlet.coneApex, center, sizeof(center));
+			meshlet.coneAxis[0] = 0.0f;
+			meshlet.coneAxis[1] = 0.0f;
+			meshlet.coneAxis[2] = 1.0f;
+			meshlet.coneCutoff = 1.0f;
+
+			float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			if (normals.empty() || axisLength == 0.0f) {
+				return;
+			}
+			for (int j = 0; j < 3; j++) {
+				axis[j] /= axisLength;
+			}
+			memcpy(meshlet.coneAxis, axis, sizeof(axis));
+
+			float minDot = 1.0f;
+			for (size_t i = 0; i < normals.size(); i += 3) {
+				minDot = std::min(minDot, normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]);
+			}
+			// wider than ~84 degrees, backface culling would hardly ever succeed
+			if (minDot <= 0.1f) {
+				return;
+			}
+
+			// Apex: move back along the axis until the point is behind every triangle plane
+			float maxT = 0.0f;
+			size_t normalIndex = 0;
+			for (uint32_t i = 0; i < triangleCount; i++) {
+				float a[3], b[3], c[3];
+				position(positions, positionStride, indices[i * 3 + 0], a);
+				position(positions, positionStride, indices[i * 3 + 1], b);
+				position(positions, positionStride, indices[i * 3 + 2], c);
+				float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				if (cross[0] == 0.0f && cross[1] == 0.0f && cross[2] == 0.0f) {
+					continue;
+				}
+				const float* n = &normals[normalIndex];
+				normalIndex += 3;
+				float dc = (center[0] - a[0]) * n[0] + (center[1] - a[1]) * n[1] + (center[2] - a[2]) * n[2];
+				float dn = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+				maxT = std::max(maxT, dc / dn);
+			}
+			for (int j = 0; j < 3; j++) {
+				meshlet.coneApex[j] = center[j] - axis[j] * maxT;
+			}
+			meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+
+		bool meshletBackfacing(const Meshlet& meshlet, const float* cameraPosition) {
+			float view[3] = { meshlet.coneApex[0] - cameraPosition[0], meshlet.coneApex[1] - cameraPosition[1], meshlet.coneApex[2] - cameraPosition[2] };
+			float length = std::sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+			if (length == 0.0f) {
+				return false;
+			}
+			return (view[0] * meshlet.coneAxis[0] + view[1] * meshlet.coneAxis[1] + view[2] * meshlet.coneAxis[2]) / length >= meshlet.coneCutoff;
+		}
+
+		bool meshletOutsideFrustum(const Meshlet& meshlet, const float (*planes)[4], uint32_t planeCount) {
+			for (uint32_t i = 0; i < planeCount; i++) {
+				const float* plane = planes[i];
+				if (plane[0] * meshlet.center[0] + plane[1] * meshlet.center[1] + plane[2] * meshlet.center[2] + plane[3] < -meshlet.radius) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		float simplifyScale(const float* positions, size_t positionStride, size_t vertexCount) {
+			if (vertexCount == 0) {
+				return 0.0f;
+			}
+			float boundsMin[3], boundsMax[3];
+			position(positions, positionStride, 0, boundsMin);
+			memcpy(boundsMax, boundsMin, sizeof(boundsMin));
+			for (size_t i = 1; i < vertexCount; i++) {
+				float p[3];
+				position(positions, positionStride, static_cast<uint32_t>(i), p);
+				for (int k = 0; k < 3; k++) {
+					boundsMin[k] = std::min(boundsMin[k], p[k]);
+					boundsMax[k] = std::max(boundsMax[k], p[k]);
+				}
+			}
+			return std::max(boundsMax[0] - boundsMin[0], std::max(boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]));
+		}
+
+		size_t simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount,
+			size_t targetIndexCount, float targetError, float* resultError) {
+
+			std::vector<uint32_t> result(indices, indices + indexCount - indexCount % 3);
+			double maxError = 0.0;
+
+			// Positions scaled to the unit cube, so errors do not depend on the size of the mesh
+			float scale = simplifyScale(positions, positionStride, vertexCount);
+			std::vector<float> points(vertexCount * 3);
+			float origin[3] = { 0.0f, 0.0f, 0.0f };
+			if (vertexCount > 0) {
+				position(positions, positionStride, 0, origin);
+			}
+			for (size_t i = 0; i < vertexCount; i++) {
+				position(positions, positionStride, static_cast<uint32_t>(i), &points[i * 3]);
+				for (int k = 0; k < 3; k++) {
+					points[i * 3 + k] = scale > 0.0f ? (points[i * 3 + k] - origin[k]) / scale : 0.0f;
+				}
+			}
+
+			// Vertices sharing a position (attribute seams) map to the first vertex with that position
+			std::vector<uint32_t> positionId(vertexCount);
+			std::vector<uint32_t> positionUsers(vertexCount, 0);
+			{
+				struct PositionHash {
+					size_t operator()(const float* p) const {
+						uint32_t bits[3];
+						memcpy(bits, p, sizeof(bits));
+						return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+					}
+				};
+				struct PositionEqual {
+					bool operator()(const float* a, const float* b) const {
+						return memcmp(a, b, 3 * sizeof(float)) == 0;
+					}
+				};
+				std::unordered_map<const float*, uint32_t, PositionHash, PositionEqual> firstVertex;
+				firstVertex.reserve(vertexCount);
+				for (size_t i = 0; i < vertexCount; i++) {
+					positionId[i] = firstVertex.emplace(&points[i * 3], static_cast<uint32_t>(i)).first->second;
+					positionUsers[positionId[i]]++;
+				}
+			}
+
+			// Border edges (one triangle) and non manifold edges (more than two) lock their vertices
+			std::vector<bool> locked(vertexCount, false);
+			{
+				std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+				edgeTriangles.reserve(result.size());
+				for (size_t i = 0; i < result.size(); i += 3) {
+					for (int k = 0; k < 3; k++) {
+						uint32_t a = positionId[result[i + k]];
+						uint32_t b = positionId[result[i + (k + 1) % 3]];
+						edgeTriangles[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+					}
+				}
+				for (size_t i = 0; i < result.size(); i += 3) {
+					for (int k = 0; k < 3; k++) {
+						uint32_t a = result[i + k];
+						uint32_t b = result[i + (k + 1) % 3];
+						uint32_t pa = positionId[a];
+						uint32_t pb = positionId[b];
+						if (edgeTriangles[(uint64_t(std::min(pa, pb)) << 32) | std::max(pa, pb)] != 2) {
+							locked[a] = true;
+							locked[b] = true;
+						}
+					}
+				}
+				for (size_t i = 0; i < vertexCount; i++) {
+					if (positionUsers[positionId[i]] > 1) {
+						locked[i] = true;
+					}
+				}
+			}
+
+			// Area weighted plane quadrics, accumulated per position
+			std::vector<Quadric> quadrics(vertexCount, Quadric{});
+			for (size_t i = 0; i < result.size(); i += 3) {
+				const float* p0 = &points[result[i + 0] * 3];
+				float n[3];
+				cross(p0, &points[result[i + 1] * 3], &points[result[i + 2] * 3], n);
+				double length = std::sqrt(double(n[0]) * n[0] + double(n[1]) * n[1] + double(n[2]) * n[2]);
+				if (length == 0.0) {
+					continue;
+				}
+				double normal[3] = { n[0] / length, n[1] / length, n[2] / length };
+				double distance = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+				for (int k = 0; k < 3; k++) {
+					quadrics[positionId[result[i + k]]].addPlane(normal, distance, length * 0.5);
+				}
+			}
+
+			const double errorLimit = double(targetError) * double(targetError);
+			std::vector<Collapse> collapses;
+			std::vector<bool> touched(vertexCount);
+			std::vector<uint32_t> remap(vertexCount);
+
+			// Each pass collapses the cheapest independent edges, then rebuilds the triangle list
+			while (result.size() > targetIndexCount) {
+				TriangleAdjacency adjacency(result.data(), result.size(), vertexCount);
+
+				collapses.clear();
+				for (size_t i = 0; i < result.size(); i += 3) {
+					for (int k = 0; k < 3; k++) {
+						uint32_t from = result[i + k];
+						uint32_t to = result[i + (k + 1) % 3];
+						for (int direction = 0; direction < 2; direction++) {
+							if (!locked[from]) {
+								Quadric quadric = quadrics[positionId[from]];
+								quadric.add(quadrics[positionId[to]]);
+								collapses.push_back({ from, to, quadric.error(&points[to * 3]) });
+							}
+							std::swap(from, to);
+						}
+					}
+				}
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+					return a.error < b.error || (a.error == b.error && (a.from < b.from || (a.from == b.from && a.to < b.to)));
+				});
+
+				// Every collapse removes about two triangles
+				size_t collapseLimit = std::max<size_t>((result.size() - targetIndexCount) / 6, 1);
+				size_t collapseCount = 0;
+				std::fill(touched.begin(), touched.end(), false);
+				for (size_t i = 0; i < vertexCount; i++) {
+					remap[i] = static_cast<uint32_t>(i);
+				}
+
+				for (const Collapse& collapse : collapses) {
+					if (collapse.error > errorLimit || collapseCount >= collapseLimit) {
+						break;
+					}
+					if (touched[collapse.from] || touched[collapse.to]) {
+						continue;
+					}
+
+					// Reject collapses that cross a seam of the target position or flip a remaining triangle
+					bool valid = true;
+					const float* target = &points[collapse.to * 3];
+					for (uint32_t j = 0; valid && j < adjacency.counts[collapse.from]; j++) {
+						const uint32_t* triangle = &result[adjacency.data[adjacency.offsets[collapse.from] + j] * 3];
+						bool collapsing = false;
+						for (int k = 0; k < 3; k++) {
+							if (triangle[k] == collapse.to) {
+								collapsing = true;
+							}
+							else if (positionId[triangle[k]] == positionId[collapse.to]) {
+								valid = false;
+							}
+						}
+						if (!valid || collapsing) {
+							continue;
+						}
+
+						const float* p[3];
+						const float* moved[3];
+						for (int k = 0; k < 3; k++) {
+							p[k] = &points[triangle[k] * 3];
+							moved[k] = triangle[k] == collapse.from ? target : p[k];
+						}
+						float before[3], after[3];
+						cross(p[0], p[1], p[2], before);
+						cross(moved[0], moved[1], moved[2], after);
+						valid = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] > 0.0f;
+					}
+					if (!valid) {
+						continue;
+					}
+
+					// The one ring of the collapsed vertex changes, none of it may take part in another collapse this pass
+					for (uint32_t j = 0; j < adjacency.counts[collapse.from]; j++) {
+						const uint32_t* triangle = &result[adjacency.data[adjacency.offsets[collapse.from] + j] * 3];
+						touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+					}
+					touched[collapse.to] = true;
+
+					remap[collapse.from] = collapse.to;
+					quadrics[positionId[collapse.to]].add(quadrics[positionId[collapse.from]]);
+					maxError = std::max(maxError, collapse.error);
+					collapseCount++;
+				}
+
+				if (collapseCount == 0) {
+					break;
+				}
+
+				// Drop triangles that lost an edge
+				size_t write = 0;
+				for (size_t i = 0; i < result.size(); i += 3) {
+					uint32_t a = remap[result[i + 0]];
+					uint32_t b = remap[result[i + 1]];
+					uint32_t c = remap[result[i + 2]];
+					if (positionId[a] != positionId[b] && positionId[a] != positionId[c] && positionId[b] != positionId[c]) {
+						result[write++] = a;
+						result[write++] = b;
+						result[write++] = c;
+					}
+				}
+				result.resize(write);
+			}
+
+			if (resultError) {
+				*resultError = static_cast<float>(std::sqrt(maxError));
+			}
+			memcpy(destination, result.data(), result.size() * sizeof(uint32_t));
+			return result.size();
+		}
+
+		void generateTangents(const uint32_t* indices, size_t indexCount, const float* positions, const float* normals, const float* uvs, size_t vertexStride,
+			size_t vertexCount, float* tangents) {
+
+			auto attribute = [vertexStride](const float* base, uint32_t index) {
+				return reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(base) + index * vertexStride);
+			};
+			auto normalize = [](float* v) {
+				float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+				if (length > 0.0f) {
+					v[0] /= length;
+					v[1] /= length;
+					v[2] /= length;
+				}
+				return length;
+			};
+			// v minus its component along the unit vector n
+			auto project = [](const float* v, const float* n, float* result) {
+				float d = v[0] * n[0] + v[1] * n[1] + v[2] * n[2];
+				for (int k = 0; k < 3; k++) {
+					result[k] = v[k] - n[k] * d;
+				}
+			};
+
+			std::vector<float> tangentSums(vertexCount * 3, 0.0f);
+			std::vector<float> bitangentSums(vertexCount * 3, 0.0f);
+
+			for (size_t i = 0; i + 2 < indexCount; i += 3) {
+				const uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+				const float* p[3];
+				const float* uv[3];
+				for (int k = 0; k < 3; k++) {
+					p[k] = attribute(positions, corners[k]);
+					uv[k] = attribute(uvs, corners[k]);
+				}
+
+				float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+				float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+				float du1 = uv[1][0] - uv[0][0], dv1 = uv[1][1] - uv[0][1];
+				float du2 = uv[2][0] - uv[0][0], dv2 = uv[2][1] - uv[0][1];
+
+				// Triangles without a UV area carry no tangent information
+				float determinant = du1 * dv2 - du2 * dv1;
+				if (determinant == 0.0f) {
+					continue;
+				}
+				float sign = determinant > 0.0f ? 1.0f : -1.0f;
+				float faceTangent[3], faceBitangent[3];
+				for (int k = 0; k < 3; k++) {
+					// scaled by |determinant| only, the direction (including mirroring) is kept
+					faceTangent[k] = (e1[k] * dv2 - e2[k] * dv1) * sign;
+					faceBitangent[k] = (e2[k] * du1 - e1[k] * du2) * sign;
+				}
+
+				for (int k = 0; k < 3; k++) {
+					// angle of the triangle at this corner
+					const float* a = p[k];
+					const float* b = p[(k + 1) % 3];
+					const float* c = p[(k + 2) % 3];
+					float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+					float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+					if (normalize(ab) == 0.0f || normalize(ac) == 0.0f) {
+						continue;
+					}
+					float angle = std::acos(std::min(std::max(ab[0] * ac[0] + ab[1] * ac[1] + ab[2] * ac[2], -1.0f), 1.0f));
+
+					float n[3];
+					memcpy(n, attribute(normals, corners[k]), sizeof(n));
+					normalize(n);
+					float t[3], s[3];
+					project(faceTangent, n, t);
+					project(faceBitangent, n, s);
+					normalize(t);
+					normalize(s);
+					for (int j = 0; j < 3; j++) {
+						tangentSums[corners[k] * 3 + j] += t[j] * angle;
+						bitangentSums[corners[k] * 3 + j] += s[j] * angle;
+					}
+				}
+			}
+
+			for (size_t v = 0; v < vertexCount; v++) {
+				float n[3];
+				memcpy(n, attribute(normals, static_cast<uint32_t>(v)), sizeof(n));
+				normalize(n);
+
+				float t[3];
+				project(&tangentSums[v * 3], n, t);
+				if (normalize(t) == 0.0f) {
+					// no UV gradient, any vector perpendicular to the normal keeps the TBN valid
+					float axis[3] = { 0.0f, 0.0f, 0.0f };
+					axis[std::abs(n[0]) < 0.9f ? 0 : 1] = 1.0f;
+					project(axis, n, t);
+					normalize(t);
+				}
+
+				// Handedness: does the accumulated bitangent point along cross(n, t)
+				float c[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+				const float* s = &bitangentSums[v * 3];
+				float w = (c[0] * s[0] + c[1] * s[1] + c[2] * s[2]) < 0.0f ? -1.0f : 1.0f;
+
+				float* tangent = reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(tangents) + v * vertexStride);
+				tangent[0] = t[0];
+				tangent[1] = t[1];
+				tangent[2] = t[2];
+				tangent[3] = w;
+			}
+		}
+
+		void optimizeVertexFetch(void* vertices, size_t vertexSize, uint32_t* indices, size_t indexCount, size_t vertexCount) {
+			if (vertexCount == 0) {
+				return;
+			}
+
+			std::vector<uint32_t> remap(vertexCount, INVALID_INDEX);
+			uint32_t next = 0;
+			for (size_t i = 0; i < indexCount; i++) {
+				if (remap[indices[i]] == INVALID_INDEX) {
+					remap[indices[i]] = next++;
+				}
+				indices[i] = remap[indices[i]];
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				if (remap[v] == INVALID_INDEX) {
+					remap[v] = next++;
+				}
+			}
+
+			unsigned char* data = static_cast<unsigned char*>(vertices);
+			std::vector<unsigned char> original(data, data + vertexCount * vertexSize);
+			for (size_t v = 0; v < vertexCount; v++) {
+				memcpy(data + remap[v] * vertexSize, original.data() + v * vertexSize, vertexSize);
+			}
+		}
+
+	}
+
+}
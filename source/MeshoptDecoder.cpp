@@ -0,0 +1,626 @@
+#include "../include/MeshoptDecoder.h"
+#include "../include/AccessorDecoder.h"
+
+#include <cmath>
+#include <cstring>
+
+// The vertex codec has an SSE4.1 path selected at runtime, see AccessorDecoder.cpp
+#if defined(__x86_64__) || defined(_M_X64)
+#define VKTINY_DECODE_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define VKTINY_TARGET(isa)
+#else
+#define VKTINY_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+
+namespace {
+
+	const unsigned char VERTEX_HEADER = 0xa0;
+	const unsigned char INDEX_HEADER = 0xe0;
+	const unsigned char SEQUENCE_HEADER = 0xd0;
+
+	// Vertex blocks hold at most 256 vertices or 8 KiB, every byte of a vertex is stored as a stream of groups of 16 deltas
+	const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+	const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+	const size_t BYTE_GROUP_SIZE = 16;
+	// Largest group encoding (4 bit codes followed by 16 escaped bytes), the encoder pads the stream so whole groups can be read
+	const size_t BYTE_GROUP_DECODE_LIMIT = 24;
+	// The first vertex is stored (zero padded to at least 32 bytes) at the end of the stream
+	const size_t VERTEX_TAIL_MIN_SIZE = 32;
+
+	size_t vertexBlockSize(size_t vertexSize) {
+		size_t result = (VERTEX_BLOCK_SIZE_BYTES / vertexSize) & ~(BYTE_GROUP_SIZE - 1);
+		return result < VERTEX_BLOCK_MAX_SIZE ? result : VERTEX_BLOCK_MAX_SIZE;
+	}
+
+	unsigned char unzigzag8(unsigned char value) {
+		return static_cast<unsigned char>(-(value & 1) ^ (value >> 1));
+	}
+
+	// 16 codes of 2 or 4 bits (most significant first), codes with all bits set are followed by the full byte
+	template<int bits>
+	const unsigned char* decodeBytesGroupPacked(const unsigned char* data, unsigned char* destination) {
+		const unsigned char escape = (1 << bits) - 1;
+		const unsigned char* escaped = data + bits * BYTE_GROUP_SIZE / 8;
+		for (int i = 0; i < bits * int(BYTE_GROUP_SIZE) / 8; i++) {
+			unsigned char byte = data[i];
+			for (int j = 0; j < 8 / bits; j++) {
+				unsigned char code = byte >> (8 - bits);
+				byte = static_cast<unsigned char>(byte << bits);
+				*destination++ = code == escape ? *escaped : code;
+				escaped += code == escape;
+			}
+		}
+		return escaped;
+	}
+
+	// 16 values of 0, 2, 4 or 8 bits
+	const unsigned char* decodeBytesGroup(const unsigned char* data, unsigned char* destination, int bitsLog2) {
+		switch (bitsLog2) {
+		case 0:
+			memset(destination, 0, BYTE_GROUP_SIZE);
+			return data;
+		case 1:
+			return decodeBytesGroupPacked<2>(data, destination);
+		case 2:
+			return decodeBytesGroupPacked<4>(data, destination);
+		default:
+			memcpy(destination, data, BYTE_GROUP_SIZE);
+			return data + BYTE_GROUP_SIZE;
+		}
+	}
+
+	// Two bits per group select its encoding, the header is followed by the groups
+	const unsigned char* decodeBytes(const unsigned char* data, const unsigned char* end, unsigned char* destination, size_t count) {
+		size_t groupCount = count / BYTE_GROUP_SIZE;
+		const unsigned char* header = data;
+		size_t headerSize = (groupCount + 3) / 4;
+		if (size_t(end - data) < headerSize) {
+			return nullptr;
+		}
+		data += headerSize;
+
+		for (size_t group = 0; group < groupCount; group++) {
+			if (size_t(end - data) < BYTE_GROUP_DECODE_LIMIT) {
+				return nullptr;
+			}
+			int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+			data = decodeBytesGroup(data, destination + group * BYTE_GROUP_SIZE, bitsLog2);
+		}
+		return data;
+	}
+
+	const unsigned char* decodeVertexBlock(const unsigned char* data, const unsigned char* end, unsigned char* vertices, size_t vertexCount, size_t vertexSize,
+		unsigned char* lastVertex) {
+
+		unsigned char deltas[VERTEX_BLOCK_MAX_SIZE];
+		size_t alignedCount = (vertexCount + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+		for (size_t k = 0; k < vertexSize; k++) {
+			data = decodeBytes(data, end, deltas, alignedCount);
+			if (!data) {
+				return nullptr;
+			}
+
+			unsigned char previous = lastVertex[k];
+			unsigned char* output = vertices + k;
+			for (size_t i = 0; i < vertexCount; i++) {
+				previous = static_cast<unsigned char>(previous + unzigzag8(deltas[i]));
+				*output = previous;
+				output += vertexSize;
+			}
+		}
+
+		memcpy(lastVertex, vertices + (vertexCount - 1) * vertexSize, vertexSize);
+		return data;
+	}
+
+#ifdef VKTINY_DECODE_SIMD
+	// Shuffle of the escaped bytes into 8 lanes, indexed by the escape mask of the lanes
+	struct EscapeShuffleTable {
+		unsigned char lanes[256][8];
+		unsigned char counts[256];
+
+		EscapeShuffleTable() {
+			for (int mask = 0; mask < 256; mask++) {
+				unsigned char count = 0;
+				for (int lane = 0; lane < 8; lane++) {
+					lanes[mask][lane] = (mask & (1 << lane)) ? count++ : 0x80;
+				}
+				counts[mask] = count;
+			}
+		}
+	};
+
+	const EscapeShuffleTable& escapeShuffles() {
+		static const EscapeShuffleTable table;
+		return table;
+	}
+
+	VKTINY_TARGET("sse4.1")
+	const unsigned char* decodeBytesGroupSse(const unsigned char* data, unsigned char* destination, int bitsLog2, const EscapeShuffleTable& shuffles) {
+		__m128i codes;
+		__m128i escape;
+		switch (bitsLog2) {
+		case 0:
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_setzero_si128());
+			return data;
+		case 1: {
+			// every byte holds 4 codes, shifted into place per lane
+			int packed;
+			memcpy(&packed, data, sizeof(packed));
+			__m128i bytes = _mm_shuffle_epi8(_mm_cvtsi32_si128(packed), _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3));
+			const __m128i lane0 = _mm_setr_epi8(3, 0, 0, 0, 3, 0, 0, 0, 3, 0, 0, 0, 3, 0, 0, 0);
+			codes = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(_mm_srli_epi16(bytes, 6), lane0), _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_slli_si128(lane0, 1))),
+				_mm_or_si128(_mm_and_si128(_mm_srli_epi16(bytes, 2), _mm_slli_si128(lane0, 2)), _mm_and_si128(bytes, _mm_slli_si128(lane0, 3))));
+			escape = _mm_set1_epi8(3);
+			data += 4;
+			break;
+		}
+		case 2: {
+			__m128i bytes = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), _mm_setr_epi8(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7));
+			const __m128i even = _mm_set1_epi16(0x000f);
+			codes = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(bytes, 4), even), _mm_and_si128(bytes, _mm_slli_si128(even, 1)));
+			escape = _mm_set1_epi8(15);
+			data += 8;
+			break;
+		}
+		default:
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+			return data + BYTE_GROUP_SIZE;
+		}
+
+		// escaped bytes follow the codes in lane order, BYTE_GROUP_DECODE_LIMIT keeps the 16 byte load in bounds
+		__m128i escapes = _mm_cmpeq_epi8(codes, escape);
+		int mask = _mm_movemask_epi8(escapes);
+		unsigned char lowCount = shuffles.counts[mask & 255];
+		__m128i low = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(shuffles.lanes[mask & 255]));
+		__m128i high = _mm_add_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(shuffles.lanes[mask >> 8])), _mm_set1_epi8(static_cast<char>(lowCount)));
+		__m128i escaped = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_unpacklo_epi64(low, high));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_blendv_epi8(codes, escaped, escapes));
+		return data + lowCount + shuffles.counts[mask >> 8];
+	}
+
+	VKTINY_TARGET("sse4.1")
+	const unsigned char* decodeBytesSse(const unsigned char* data, const unsigned char* end, unsigned char* destination, size_t count, const EscapeShuffleTable& shuffles) {
+		size_t groupCount = count / BYTE_GROUP_SIZE;
+		const unsigned char* header = data;
+		size_t headerSize = (groupCount + 3) / 4;
+		if (size_t(end - data) < headerSize) {
+			return nullptr;
+		}
+		data += headerSize;
+
+		for (size_t group = 0; group < groupCount; group++) {
+			if (size_t(end - data) < BYTE_GROUP_DECODE_LIMIT) {
+				return nullptr;
+			}
+			int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+			data = decodeBytesGroupSse(data, destination + group * BYTE_GROUP_SIZE, bitsLog2, shuffles);
+		}
+		return data;
+	}
+
+	// Zigzag decoding and a prefix sum of 16 deltas, continuing from the last value of previous
+	VKTINY_TARGET("sse4.1")
+	inline __m128i accumulateDeltasSse(__m128i deltas, __m128i previous) {
+		__m128i values = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(deltas, 1), _mm_set1_epi8(0x7f)),
+			_mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(deltas, _mm_set1_epi8(1))));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 1));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 2));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 4));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 8));
+		return _mm_add_epi8(values, _mm_shuffle_epi8(previous, _mm_set1_epi8(15)));
+	}
+
+	VKTINY_TARGET("sse4.1")
+	inline void storeVertexBytesSse(unsigned char* destination, __m128i value) {
+		int bytes = _mm_cvtsi128_si32(value);
+		memcpy(destination, &bytes, sizeof(bytes));
+	}
+
+	// All byte streams of a block are decoded first, then 4 streams at a time are accumulated and transposed into vertices
+	VKTINY_TARGET("sse4.1")
+	const unsigned char* decodeVertexBlockSse(const unsigned char* data, const unsigned char* end, unsigned char* vertices, size_t vertexCount, size_t vertexSize,
+		unsigned char* lastVertex) {
+
+		const EscapeShuffleTable& shuffles = escapeShuffles();
+		alignas(16) unsigned char streams[VERTEX_BLOCK_SIZE_BYTES];
+		size_t alignedCount = (vertexCount + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+		for (size_t k = 0; k < vertexSize; k++) {
+			data = decodeBytesSse(data, end, streams + k * alignedCount, alignedCount, shuffles);
+			if (!data) {
+				return nullptr;
+			}
+		}
+
+		for (size_t k = 0; k < vertexSize; k += 4) {
+			// lane 15 carries the last vertex into the first group
+			__m128i previous[4];
+			for (size_t j = 0; j < 4; j++) {
+				previous[j] = _mm_set1_epi8(static_cast<char>(lastVertex[k + j]));
+			}
+
+			for (size_t i = 0; i < vertexCount; i += BYTE_GROUP_SIZE) {
+				for (size_t j = 0; j < 4; j++) {
+					__m128i deltas = _mm_load_si128(reinterpret_cast<const __m128i*>(streams + (k + j) * alignedCount + i));
+					previous[j] = accumulateDeltasSse(deltas, previous[j]);
+				}
+
+				__m128i bytes01Low = _mm_unpacklo_epi8(previous[0], previous[1]);
+				__m128i bytes01High = _mm_unpackhi_epi8(previous[0], previous[1]);
+				__m128i bytes23Low = _mm_unpacklo_epi8(previous[2], previous[3]);
+				__m128i bytes23High = _mm_unpackhi_epi8(previous[2], previous[3]);
+
+				__m128i transposed[4] = {
+					_mm_unpacklo_epi16(bytes01Low, bytes23Low),
+					_mm_unpackhi_epi16(bytes01Low, bytes23Low),
+					_mm_unpacklo_epi16(bytes01High, bytes23High),
+					_mm_unpackhi_epi16(bytes01High, bytes23High),
+				};
+
+				unsigned char* output = vertices + i * vertexSize + k;
+				if (vertexCount - i >= BYTE_GROUP_SIZE) {
+					for (size_t r = 0; r < 4; r++) {
+						storeVertexBytesSse(output + (r * 4 + 0) * vertexSize, transposed[r]);
+						storeVertexBytesSse(output + (r * 4 + 1) * vertexSize, _mm_srli_si128(transposed[r], 4));
+						storeVertexBytesSse(output + (r * 4 + 2) * vertexSize, _mm_srli_si128(transposed[r], 8));
+						storeVertexBytesSse(output + (r * 4 + 3) * vertexSize, _mm_srli_si128(transposed[r], 12));
+					}
+				} else {
+					alignas(16) uint32_t partial[BYTE_GROUP_SIZE];
+					memcpy(partial, transposed, sizeof(partial));
+					for (size_t v = 0; v < vertexCount - i; v++) {
+						memcpy(output + v * vertexSize, &partial[v], sizeof(uint32_t));
+					}
+				}
+			}
+		}
+
+		memcpy(lastVertex, vertices + (vertexCount - 1) * vertexSize, vertexSize);
+		return data;
+	}
+#endif
+
+	uint32_t decodeVByte(const unsigned char*& data) {
+		unsigned char lead = *data++;
+		if (lead < 128) {
+			return lead;
+		}
+
+		uint32_t result = lead & 127;
+		uint32_t shift = 7;
+		for (int i = 0; i < 4; i++) {
+			unsigned char group = *data++;
+			result |= uint32_t(group & 127) << shift;
+			shift += 7;
+			if (group < 128) {
+				break;
+			}
+		}
+		return result;
+	}
+
+	// Zigzag encoded delta to the previous free index
+	uint32_t decodeIndex(const unsigned char*& data, uint32_t last) {
+		uint32_t value = decodeVByte(data);
+		return last + ((value >> 1) ^ (0u - (value & 1)));
+	}
+
+	void writeIndex(void* destination, size_t index, size_t indexSize, uint32_t value) {
+		if (indexSize == 2) {
+			static_cast<uint16_t*>(destination)[index] = static_cast<uint16_t>(value);
+		} else {
+			static_cast<uint32_t*>(destination)[index] = value;
+		}
+	}
+
+	void writeTriangle(void* destination, size_t index, size_t indexSize, uint32_t a, uint32_t b, uint32_t c) {
+		writeIndex(destination, index + 0, indexSize, a);
+		writeIndex(destination, index + 1, indexSize, b);
+		writeIndex(destination, index + 2, indexSize, c);
+	}
+
+	// The index codec mirrors the encoder's FIFOs exactly, every push has to match its encoding step
+	struct TriangleFifos {
+		uint32_t edges[16][2];
+		uint32_t vertices[16];
+		size_t edgeOffset = 0;
+		size_t vertexOffset = 0;
+
+		TriangleFifos() {
+			memset(edges, -1, sizeof(edges));
+			memset(vertices, -1, sizeof(vertices));
+		}
+
+		void pushEdge(uint32_t a, uint32_t b) {
+			edges[edgeOffset][0] = a;
+			edges[edgeOffset][1] = b;
+			edgeOffset = (edgeOffset + 1) & 15;
+		}
+
+		void pushVertex(uint32_t v, bool condition = true) {
+			vertices[vertexOffset] = v;
+			vertexOffset = (vertexOffset + (condition ? 1 : 0)) & 15;
+		}
+
+		uint32_t vertex(size_t age) const {
+			return vertices[(vertexOffset - age) & 15];
+		}
+	};
+
+	template<typename T>
+	void decodeFilterOctahedral(T* data, size_t count) {
+		const float maximum = float((1 << (sizeof(T) * 8 - 1)) - 1);
+		for (size_t i = 0; i < count; i++) {
+			T* v = data + i * 4;
+			// z is stored as 1 - |x| - |y| at the same scale as x and y
+			float x = float(v[0]);
+			float y = float(v[1]);
+			float z = float(v[2]) - fabsf(x) - fabsf(y);
+
+			// fold the lower hemisphere back
+			float t = z >= 0.0f ? 0.0f : z;
+			x += x >= 0.0f ? t : -t;
+			y += y >= 0.0f ? t : -t;
+
+			float scale = maximum / sqrtf(x * x + y * y + z * z);
+			v[0] = T(int(x * scale + (x >= 0.0f ? 0.5f : -0.5f)));
+			v[1] = T(int(y * scale + (y >= 0.0f ? 0.5f : -0.5f)));
+			v[2] = T(int(z * scale + (z >= 0.0f ? 0.5f : -0.5f)));
+		}
+	}
+
+	void decodeFilterQuaternion(int16_t* data, size_t count) {
+		const float range = 1.0f / sqrtf(2.0f);
+		for (size_t i = 0; i < count; i++) {
+			int16_t* q = data + i * 4;
+			// the fourth component holds the quantization scale in its upper bits and the index of the dropped component
+			float scale = range / float(q[3] | 3);
+			float x = float(q[0]) * scale;
+			float y = float(q[1]) * scale;
+			float z = float(q[2]) * scale;
+
+			// the dropped (largest) component is positive, clamped against rounding errors
+			float ww = 1.0f - x * x - y * y - z * z;
+			float w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+
+			int qx = int(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f));
+			int qy = int(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f));
+			int qz = int(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f));
+			int qw = int(w * 32767.0f + 0.5f);
+
+			int index = q[3] & 3;
+			q[(index + 1) & 3] = int16_t(qx);
+			q[(index + 2) & 3] = int16_t(qy);
+			q[(index + 3) & 3] = int16_t(qz);
+			q[index] = int16_t(qw);
+		}
+	}
+
+	void decodeFilterExponential(uint32_t* data, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			// signed 24 bit mantissa and signed 8 bit exponent, the value is mantissa * 2^exponent
+			int32_t mantissa = int32_t(data[i] << 8) >> 8;
+			int32_t exponent = int32_t(data[i]) >> 24;
+
+			uint32_t bits = uint32_t(exponent + 127) << 23;
+			float power;
+			memcpy(&power, &bits, sizeof(float));
+			float value = power * float(mantissa);
+			memcpy(&data[i], &value, sizeof(float));
+		}
+	}
+
+}
+
+
+namespace vkbase {
+
+	namespace meshopt {
+
+		bool decodeVertexBuffer(void* destination, size_t vertexCount, size_t vertexSize, const unsigned char* data, size_t size) {
+			if (vertexSize == 0 || vertexSize > 256 || vertexSize % 4 != 0) {
+				return false;
+			}
+			if (size < 1 + vertexSize || data[0] != VERTEX_HEADER) {
+				return false;
+			}
+
+			const unsigned char* end = data + size;
+			unsigned char lastVertex[256];
+			memcpy(lastVertex, end - vertexSize, vertexSize);
+
+			typedef const unsigned char* (*DecodeBlock)(const unsigned char*, const unsigned char*, unsigned char*, size_t, size_t, unsigned char*);
+			DecodeBlock decodeBlock = decodeVertexBlock;
+#ifdef VKTINY_DECODE_SIMD
+			if (bestDecodeIsa() != DecodeIsa::Scalar) {
+				decodeBlock = decodeVertexBlockSse;
+			}
+#endif
+
+			unsigned char* vertices = static_cast<unsigned char*>(destination);
+			const unsigned char* current = data + 1;
+			const size_t blockSize = vertexBlockSize(vertexSize);
+			for (size_t first = 0; first < vertexCount; first += blockSize) {
+				size_t count = first + blockSize < vertexCount ? blockSize : vertexCount - first;
+				current = decodeBlock(current, end, vertices + first * vertexSize, count, vertexSize, lastVertex);
+				if (!current) {
+					return false;
+				}
+			}
+
+			size_t tailSize = vertexSize < VERTEX_TAIL_MIN_SIZE ? VERTEX_TAIL_MIN_SIZE : vertexSize;
+			return size_t(end - current) == tailSize;
+		}
+
+		bool decodeIndexBuffer(void* destination, size_t indexCount, size_t indexSize, const unsigned char* data, size_t size) {
+			if (indexCount % 3 != 0 || (indexSize != 2 && indexSize != 4)) {
+				return false;
+			}
+			// header, one code per triangle and the 16 byte auxiliary code table at the end
+			if (size < 1 + indexCount / 3 + 16 || (data[0] & 0xf0) != INDEX_HEADER) {
+				return false;
+			}
+			int version = data[0] & 0x0f;
+			if (version > 1) {
+				return false;
+			}
+
+			TriangleFifos fifos;
+			uint32_t next = 0;
+			uint32_t last = 0;
+			// version 1 uses vertex codes 13 and 14 for free indices one below and above the last one
+			const int fifoCodeLimit = version >= 1 ? 13 : 15;
+
+			const unsigned char* codes = data + 1;
+			const unsigned char* current = codes + indexCount / 3;
+			const unsigned char* safeEnd = data + size - 16;
+			const unsigned char* codeTable = safeEnd;
+
+			for (size_t i = 0; i < indexCount; i += 3) {
+				// a triangle reads at most 16 bytes (one auxiliary code and three 5 byte indices), the code table keeps the reads in bounds
+				if (current > safeEnd) {
+					return false;
+				}
+
+				unsigned char code = *codes++;
+				if (code < 0xf0) {
+					// edge from the edge FIFO plus a new, cached or free vertex
+					const uint32_t* edge = fifos.edges[(fifos.edgeOffset - 1 - (code >> 4)) & 15];
+					uint32_t a = edge[0];
+					uint32_t b = edge[1];
+					int vertexCode = code & 15;
+
+					uint32_t c;
+					bool pushed = true;
+					if (vertexCode < fifoCodeLimit) {
+						c = vertexCode == 0 ? next++ : fifos.vertex(1 + vertexCode);
+						pushed = vertexCode == 0;
+					} else {
+						// 13 and 14 decode to -1 and 1
+						last = c = vertexCode != 15 ? last + (vertexCode - (vertexCode ^ 3)) : decodeIndex(current, last);
+					}
+
+					writeTriangle(destination, i, indexSize, a, b, c);
+					fifos.pushVertex(c, pushed);
+					fifos.pushEdge(c, b);
+					fifos.pushEdge(a, c);
+				} else {
+					// a new vertex followed by two new, cached or free ones, the common combinations come from the code table
+					unsigned char auxiliary = code < 0xfe ? codeTable[code & 15] : *current++;
+					int codeA = code == 0xff ? 15 : 0;
+					int codeB = auxiliary >> 4;
+					int codeC = auxiliary & 15;
+					if (code >= 0xfe && auxiliary == 0) {
+						next = 0;
+					}
+
+					// next is advanced for all three vertices before any free index is decoded, matching the encoder
+					uint32_t a = codeA == 0 ? next++ : 0;
+					uint32_t b = codeB == 0 ? next++ : fifos.vertex(codeB);
+					uint32_t c = codeC == 0 ? next++ : fifos.vertex(codeC);
+					if (codeA == 15) {
+						last = a = decodeIndex(current, last);
+					}
+					if (codeB == 15) {
+						last = b = decodeIndex(current, last);
+					}
+					if (codeC == 15) {
+						last = c = decodeIndex(current, last);
+					}
+
+					writeTriangle(destination, i, indexSize, a, b, c);
+					fifos.pushVertex(a);
+					fifos.pushVertex(b, codeB == 0 || codeB == 15);
+					fifos.pushVertex(c, codeC == 0 || codeC == 15);
+					fifos.pushEdge(b, a);
+					fifos.pushEdge(c, b);
+					fifos.pushEdge(a, c);
+				}
+			}
+
+			// all triangle data has to be consumed, ending exactly at the code table
+			return current == safeEnd;
+		}
+
+		bool decodeIndexSequence(void* destination, size_t indexCount, size_t indexSize, const unsigned char* data, size_t size) {
+			if (indexSize != 2 && indexSize != 4) {
+				return false;
+			}
+			// header, at least one byte per index and a 4 byte tail
+			if (size < 1 + indexCount + 4 || (data[0] & 0xf0) != SEQUENCE_HEADER || (data[0] & 0x0f) > 1) {
+				return false;
+			}
+
+			const unsigned char* current = data + 1;
+			const unsigned char* safeEnd = data + size - 4;
+			uint32_t last[2] = {};
+			for (size_t i = 0; i < indexCount; i++) {
+				// an index reads at most 5 bytes, the tail keeps the reads in bounds
+				if (current >= safeEnd) {
+					return false;
+				}
+
+				// the lowest bit selects which of the two previous indices the delta is relative to
+				uint32_t value = decodeVByte(current);
+				uint32_t baseline = value & 1;
+				value >>= 1;
+				uint32_t index = last[baseline] + ((value >> 1) ^ (0u - (value & 1)));
+				last[baseline] = index;
+				writeIndex(destination, i, indexSize, index);
+			}
+			return current == safeEnd;
+		}
+
+		bool decodeFilter(void* data, size_t count, size_t stride, CompressionFilter filter) {
+			switch (filter) {
+			case CompressionFilter::None:
+				return true;
+			case CompressionFilter::Octahedral:
+				if (stride == 4) {
+					decodeFilterOctahedral(static_cast<int8_t*>(data), count);
+					return true;
+				}
+				if (stride == 8) {
+					decodeFilterOctahedral(static_cast<int16_t*>(data), count);
+					return true;
+				}
+				return false;
+			case CompressionFilter::Quaternion:
+				if (stride != 8) {
+					return false;
+				}
+				decodeFilterQuaternion(static_cast<int16_t*>(data), count);
+				return true;
+			case CompressionFilter::Exponential:
+				if (stride == 0 || stride % 4 != 0) {
+					return false;
+				}
+				decodeFilterExponential(static_cast<uint32_t*>(data), count * (stride / 4));
+				return true;
+			}
+			return false;
+		}
+
+		bool decodeView(const CompressedView& view, unsigned char* destination) {
+			switch (view.mode) {
+			case CompressionMode::Attributes:
+				return decodeVertexBuffer(destination, view.count, view.stride, view.data, view.size) &&
+					decodeFilter(destination, view.count, view.stride, view.filter);
+			case CompressionMode::Triangles:
+				return view.filter == CompressionFilter::None && decodeIndexBuffer(destination, view.count, view.stride, view.data, view.size);
+			case CompressionMode::Indices:
+				return view.filter == CompressionFilter::None && decodeIndexSequence(destination, view.count, view.stride, view.data, view.size);
+			}
+			return false;
+		}
+
+	}
+
+}
@@ -0,0 +1,107 @@
+#include "../include/NodeHierarchy.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+
+
+namespace vkbase {
+
+	uint32_t NodeHierarchy::addNode(int32_t parent, const std::string& name) {
+		uint32_t node = static_cast<uint32_t>(parentIndices.size());
+
+		// Parents have to come first, otherwise the single pass update would read stale world matrices
+		parentIndices.push_back(parent >= 0 && static_cast<uint32_t>(parent) < node ? parent : -1);
+		translations.push_back(glm::vec3(0.0f));
+		rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		scales.push_back(glm::vec3(1.0f));
+		matrices.push_back(glm::mat4(1.0f));
+		localMatrices.push_back(glm::mat4(1.0f));
+		worldMatrices.push_back(glm::mat4(1.0f));
+		meshIndices.push_back(-1);
+		names.push_back(name);
+		visibleFlags.push_back(1);
+		visibleInScene.push_back(1);
+		dirty.push_back(LOCAL_CHANGED);
+		anyDirty = true;
+		return node;
+	}
+
+	void NodeHierarchy::clear(void) {
+		parentIndices.clear();
+		translations.clear();
+		rotations.clear();
+		scales.clear();
+		matrices.clear();
+		localMatrices.clear();
+		worldMatrices.clear();
+		meshIndices.clear();
+		names.clear();
+		visibleFlags.clear();
+		visibleInScene.clear();
+		dirty.clear();
+		anyDirty = false;
+	}
+
+	void NodeHierarchy::setTranslation(uint32_t node, const glm::vec3& translation) {
+		translations[node] = translation;
+		markDirty(node, LOCAL_CHANGED);
+	}
+
+	void NodeHierarchy::setRotation(uint32_t node, const glm::quat& rotation) {
+		rotations[node] = rotation;
+		markDirty(node, LOCAL_CHANGED);
+	}
+
+	void NodeHierarchy::setScale(uint32_t node, const glm::vec3& scale) {
+		scales[node] = scale;
+		markDirty(node, LOCAL_CHANGED);
+	}
+
+	void NodeHierarchy::setMatrix(uint32_t node, const glm::mat4& matrix) {
+		matrices[node] = matrix;
+		markDirty(node, LOCAL_CHANGED);
+	}
+
+	void NodeHierarchy::setVisible(uint32_t node, bool visible) {
+		visibleFlags[node] = visible ? 1 : 0;
+		markDirty(node, WORLD_CHANGED);
+	}
+
+	bool NodeHierarchy::updateWorldMatrices(void) {
+		if (!anyDirty) {
+			return false;
+		}
+
+		// Parents precede their children, so a parent's world matrix and flags are final when its children are reached
+		const size_t count = parentIndices.size();
+		for (size_t i = 0; i < count; i++) {
+			const int32_t parent = parentIndices[i];
+			if (parent >= 0 && dirty[parent]) {
+				dirty[i] |= WORLD_CHANGED;
+			}
+			if (!dirty[i]) {
+				continue;
+			}
+
+			// Nodes that only moved with their parent keep their local matrix
+			if (dirty[i] & LOCAL_CHANGED) {
+				glm::mat4 local = glm::translate(glm::mat4(1.0f), translations[i]) * glm::mat4(rotations[i]);
+				localMatrices[i] = glm::scale(local, scales[i]) * matrices[i];
+			}
+			if (parent >= 0) {
+				worldMatrices[i] = worldMatrices[parent] * localMatrices[i];
+				visibleInScene[i] = visibleFlags[i] & visibleInScene[parent];
+			}
+			else {
+				worldMatrices[i] = localMatrices[i];
+				visibleInScene[i] = visibleFlags[i];
+			}
+		}
+
+		std::fill(dirty.begin(), dirty.end(), 0);
+		anyDirty = false;
+		return true;
+	}
+
+}
@@ -0,0 +1,111 @@
+#include "../include/PipelineCache.h"
+#include "../include/Hash.h"
+#include "../include/MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+
+
+namespace {
+
+	const uint32_t PIPELINE_CACHE_MAGIC = 0x43504b56; // "VKPC"
+	const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+	// Precedes the driver's data, the hash catches truncated or damaged files before the driver sees them
+	struct PipelineCacheFileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t driverVersion;
+		uint32_t reserved;
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+
+	// Start of the data of every pipeline cache (VkPipelineCacheHeaderVersionOne)
+	struct DriverCacheHeader {
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+	bool matchesDevice(const unsigned char* data, size_t size, const VkPhysicalDeviceProperties& properties) {
+		if (size < sizeof(DriverCacheHeader)) {
+			return false;
+		}
+		DriverCacheHeader header;
+		memcpy(&header, data, sizeof(header));
+		return header.headerSize >= sizeof(DriverCacheHeader)
+			&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			&& header.vendorID == properties.vendorID
+			&& header.deviceID == properties.deviceID
+			&& memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+}
+
+
+namespace vkbase {
+
+	std::vector<unsigned char> loadPipelineCacheData(const std::string& filename, const VkPhysicalDeviceProperties& properties) {
+		MappedFile file;
+		if (!file.open(filename) || file.size() < sizeof(PipelineCacheFileHeader)) {
+			return {};
+		}
+
+		PipelineCacheFileHeader header;
+		memcpy(&header, file.data(), sizeof(header));
+		const unsigned char* data = static_cast<const unsigned char*>(file.data()) + sizeof(header);
+		if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION
+			|| header.driverVersion != properties.driverVersion
+			|| header.dataSize != file.size() - sizeof(header)
+			|| header.dataHash != hashBytes(data, static_cast<size_t>(header.dataSize))
+			|| !matchesDevice(data, static_cast<size_t>(header.dataSize), properties)) {
+			return {};
+		}
+		return std::vector<unsigned char>(data, data + header.dataSize);
+	}
+
+	bool savePipelineCache(const std::string& filename, VkDevice device, VkPipelineCache pipelineCache, const VkPhysicalDeviceProperties& properties) {
+		size_t size = 0;
+		if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+			return false;
+		}
+		std::vector<unsigned char> data(size);
+		if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+			return false;
+		}
+		data.resize(size);
+
+		PipelineCacheFileHeader header{};
+		header.magic = PIPELINE_CACHE_MAGIC;
+		header.version = PIPELINE_CACHE_VERSION;
+		header.driverVersion = properties.driverVersion;
+		header.dataSize = data.size();
+		header.dataHash = hashBytes(data.data(), data.size());
+
+		std::string tempFilename = filename + ".tmp";
+		FILE* file = fopen(tempFilename.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(data.data(), 1, data.size(), file) == data.size();
+		ok = (fclose(file) == 0) && ok;
+
+		if (!ok) {
+			remove(tempFilename.c_str());
+			return false;
+		}
+
+		// rename does not replace existing files on windows
+		remove(filename.c_str());
+		if (rename(tempFilename.c_str(), filename.c_str()) != 0) {
+			remove(tempFilename.c_str());
+			return false;
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,481 @@
+#include "../include/PipelineRegistry.h"
+#include "../include/Hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+
+namespace vkbase {
+
+	namespace {
+
+		// Appends values to a state key, structs are only written whole if they consist of 32 bit fields without pointers
+		struct KeyWriter {
+			std::vector<unsigned char>& key;
+
+			template<typename T>
+			void put(const T& value) {
+				const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+				key.insert(key.end(), bytes, bytes + sizeof(T));
+			}
+
+			template<typename T>
+			void putArray(const T* values, uint32_t count) {
+				put(count);
+				if (values != nullptr && count > 0) {
+					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+					key.insert(key.end(), bytes, bytes + sizeof(T) * count);
+				}
+			}
+
+			void putString(const char* string) {
+				uint32_t length = string ? static_cast<uint32_t>(strlen(string)) : 0;
+				put(length);
+				key.insert(key.end(), string, string + length);
+			}
+
+			// Optional state structs are prefixed with whether they are present
+			bool present(const void* state) {
+				put(static_cast<uint32_t>(state != nullptr));
+				return state != nullptr;
+			}
+		};
+
+	}
+
+	// A state waiting for or done with compilation, the create info is a deep copy since the caller's one is gone by then
+	struct PipelineRegistry::Compilation {
+		enum class State {
+			Queued,
+			Compiling,
+			Done,
+		};
+
+		std::mutex mutex;
+		std::condition_variable done;
+		State state = State::Queued;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkResult result = VK_SUCCESS;
+		double ms = 0.0;
+
+		// Set for a pipeline library (VkGraphicsPipelineLibraryFlagsEXT), the parts it covers
+		uint32_t libraryFlags = 0;
+		// Set for a pipeline linked from libraries, the create info is then only used for its layout
+		std::vector<std::shared_ptr<Compilation>> libraries;
+
+		VkGraphicsPipelineCreateInfo info;
+		std::vector<VkPipelineShaderStageCreateInfo> stages;
+		std::vector<std::string> entryPoints;
+		std::vector<VkSpecializationInfo> specializations;
+		std::vector<std::vector<VkSpecializationMapEntry>> mapEntries;
+		std::vector<std::vector<unsigned char>> specializationData;
+		VkPipelineVertexInputStateCreateInfo vertexInputState;
+		std::vector<VkVertexInputBindingDescription> vertexBindings;
+		std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+		VkPipelineTessellationStateCreateInfo tessellationState;
+		VkPipelineViewportStateCreateInfo viewportState;
+		std::vector<VkViewport> viewports;
+		std::vector<VkRect2D> scissors;
+		VkPipelineRasterizationStateCreateInfo rasterizationState;
+		VkPipelineMultisampleStateCreateInfo multisampleState;
+		std::vector<VkSampleMask> sampleMask;
+		VkPipelineDepthStencilStateCreateInfo depthStencilState;
+		VkPipelineColorBlendStateCreateInfo colorBlendState;
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+		VkPipelineDynamicStateCreateInfo dynamicState;
+		std::vector<VkDynamicState> dynamicStates;
+
+		explicit Compilation(const VkGraphicsPipelineCreateInfo& source) {
+			info = source;
+			info.pNext = nullptr;
+
+			// Sized up front, the create info points into these
+			stages.assign(source.pStages, source.pStages + source.stageCount);
+			entryPoints.resize(source.stageCount);
+			specializations.resize(source.stageCount);
+			mapEntries.resize(source.stageCount);
+			specializationData.resize(source.stageCount);
+			for (uint32_t i = 0; i < source.stageCount; i++) {
+				VkPipelineShaderStageCreateInfo& stage = stages[i];
+				stage.pNext = nullptr;
+				entryPoints[i] = stage.pName ? stage.pName : "";
+				stage.pName = entryPoints[i].c_str();
+				if (stage.pSpecializationInfo) {
+					const VkSpecializationInfo& specialization = *stage.pSpecializationInfo;
+					const unsigned char* data = static_cast<const unsigned char*>(specialization.pData);
+					specializations[i] = specialization;
+					specializations[i].pMapEntries = copyArray(specialization.pMapEntries, specialization.mapEntryCount, mapEntries[i]);
+					specializations[i].pData = copyArray(data, static_cast<uint32_t>(specialization.dataSize), specializationData[i]);
+					stage.pSpecializationInfo = &specializations[i];
+				}
+			}
+			info.pStages = stages.data();
+
+			if ((info.pVertexInputState = copyState(source.pVertexInputState, vertexInputState))) {
+				vertexInputState.pVertexBindingDescriptions = copyArray(vertexInputState.pVertexBindingDescriptions, vertexInputState.vertexBindingDescriptionCount, vertexBindings);
+				vertexInputState.pVertexAttributeDescriptions = copyArray(vertexInputState.pVertexAttributeDescriptions, vertexInputState.vertexAttributeDescriptionCount, vertexAttributes);
+			}
+			info.pInputAssemblyState = copyState(source.pInputAssemblyState, inputAssemblyState);
+			info.pTessellationState = copyState(source.pTessellationState, tessellationState);
+			if ((info.pViewportState = copyState(source.pViewportState, viewportState))) {
+				viewportState.pViewports = copyArray(viewportState.pViewports, viewportState.viewportCount, viewports);
+				viewportState.pScissors = copyArray(viewportState.pScissors, viewportState.scissorCount, scissors);
+			}
+			info.pRasterizationState = copyState(source.pRasterizationState, rasterizationState);
+			if ((info.pMultisampleState = copyState(source.pMultisampleState, multisampleState))) {
+				multisampleState.pSampleMask = copyArray(multisampleState.pSampleMask, (static_cast<uint32_t>(multisampleState.rasterizationSamples) + 31) / 32, sampleMask);
+			}
+			info.pDepthStencilState = copyState(source.pDepthStencilState, depthStencilState);
+			if ((info.pColorBlendState = copyState(source.pColorBlendState, colorBlendState))) {
+				colorBlendState.pAttachments = copyArray(colorBlendState.pAttachments, colorBlendState.attachmentCount, blendAttachments);
+			}
+			if ((info.pDynamicState = copyState(source.pDynamicState, dynamicState))) {
+				dynamicState.pDynamicStates = copyArray(dynamicState.pDynamicStates, dynamicState.dynamicStateCount, dynamicStates);
+			}
+		}
+
+		Compilation(const Compilation&) = delete;
+		Compilation& operator=(const Compilation&) = delete;
+
+		template<typename T>
+		static const T* copyState(const T* source, T& target) {
+			if (source == nullptr) {
+				return nullptr;
+			}
+			target = *source;
+			target.pNext = nullptr;
+			return &target;
+		}
+
+		template<typename T>
+		static const T* copyArray(const T* source, uint32_t count, std::vector<T>& target) {
+			if (source == nullptr || count == 0) {
+				return nullptr;
+			}
+			target.assign(source, source + count);
+			return target.data();
+		}
+	};
+
+	PipelineRegistry::PipelineRegistry(VkDevice device, VkPipelineCache pipelineCache, bool pipelineLibraries, uint32_t threadCount)
+		: device(device), pipelineCache(pipelineCache), workers(std::make_unique<ThreadPool>(threadCount)) {
+#ifdef VK_EXT_graphics_pipeline_library
+		this->pipelineLibraries = pipelineLibraries;
+#endif
+	}
+
+	PipelineRegistry::~PipelineRegistry() {
+		// Joins the workers, queued compilations still run
+		workers.reset();
+		for (auto& compilation : compilations) {
+			if (compilation->pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, compilation->pipeline, nullptr);
+			}
+		}
+		for (auto& library : libraries) {
+			if (library.second->pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, library.second->pipeline, nullptr);
+			}
+		}
+	}
+
+	uint32_t PipelineRegistry::request(const VkGraphicsPipelineCreateInfo& createInfo) {
+		requests++;
+
+		std::vector<unsigned char> key = stateKey(createInfo);
+		auto found = stateIds.find(key);
+		if (found != stateIds.end()) {
+			return found->second;
+		}
+
+		uint32_t id = static_cast<uint32_t>(compilations.size());
+		std::shared_ptr<Compilation> compilation = std::make_shared<Compilation>(createInfo);
+		compilations.push_back(compilation);
+		stateIds.emplace(std::move(key), id);
+
+#ifdef VK_EXT_graphics_pipeline_library
+		// Each part only sees the state the library subset consists of, so variants that agree on a part share its library
+		if (pipelineLibraries) {
+			std::vector<VkPipelineShaderStageCreateInfo> preRasterizationStages;
+			std::vector<VkPipelineShaderStageCreateInfo> fragmentStages;
+			for (uint32_t i = 0; i < createInfo.stageCount; i++) {
+				(createInfo.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT ? fragmentStages : preRasterizationStages).push_back(createInfo.pStages[i]);
+			}
+			VkGraphicsPipelineCreateInfo partInfo = {};
+			partInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			partInfo.flags = createInfo.flags;
+			partInfo.pDynamicState = createInfo.pDynamicState;
+
+			VkGraphicsPipelineCreateInfo vertexInput = partInfo;
+			vertexInput.pVertexInputState = createInfo.pVertexInputState;
+			vertexInput.pInputAssemblyState = createInfo.pInputAssemblyState;
+			compilation->libraries.push_back(requestLibrary(vertexInput, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT));
+
+			partInfo.layout = createInfo.layout;
+			partInfo.renderPass = createInfo.renderPass;
+			partInfo.subpass = createInfo.subpass;
+
+			VkGraphicsPipelineCreateInfo preRasterization = partInfo;
+			preRasterization.stageCount = static_cast<uint32_t>(preRasterizationStages.size());
+			preRasterization.pStages = preRasterizationStages.data();
+			preRasterization.pTessellationState = createInfo.pTessellationState;
+			preRasterization.pViewportState = createInfo.pViewportState;
+			preRasterization.pRasterizationState = createInfo.pRasterizationState;
+			compilation->libraries.push_back(requestLibrary(preRasterization, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT));
+
+			VkGraphicsPipelineCreateInfo fragmentShader = partInfo;
+			fragmentShader.stageCount = static_cast<uint32_t>(fragmentStages.size());
+			fragmentShader.pStages = fragmentStages.data();
+			fragmentShader.pMultisampleState = createInfo.pMultisampleState;
+			fragmentShader.pDepthStencilState = createInfo.pDepthStencilState;
+			compilation->libraries.push_back(requestLibrary(fragmentShader, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT));
+
+			VkGraphicsPipelineCreateInfo fragmentOutput = partInfo;
+			fragmentOutput.pMultisampleState = createInfo.pMultisampleState;
+			fragmentOutput.pColorBlendState = createInfo.pColorBlendState;
+			compilation->libraries.push_back(requestLibrary(fragmentOutput, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT));
+		}
+#endif
+
+		workers->submit([this, compilation] {
+			compile(*compilation);
+		});
+		return id;
+	}
+
+	VkPipeline PipelineRegistry::pipeline(uint32_t id) {
+		Compilation& compilation = *compilations[id];
+		std::lock_guard<std::mutex> lock(compilation.mutex);
+		if (compilation.state != Compilation::State::Done) {
+			return VK_NULL_HANDLE;
+		}
+		if (compilation.result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create graphics pipeline");
+		}
+		return compilation.pipeline;
+	}
+
+	VkPipeline PipelineRegistry::wait(uint32_t id) {
+		Compilation& compilation = *compilations[id];
+		if (finish(compilation) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create graphics pipeline");
+		}
+		return compilation.pipeline;
+	}
+
+	double PipelineRegistry::creationMs() {
+		double ms = 0.0;
+		for (auto& compilation : compilations) {
+			std::lock_guard<std::mutex> lock(compilation->mutex);
+			ms += compilation->ms;
+		}
+		for (auto& library : libraries) {
+			std::lock_guard<std::mutex> lock(library.second->mutex);
+			ms += library.second->ms;
+		}
+		return ms;
+	}
+
+	std::shared_ptr<PipelineRegistry::Compilation> PipelineRegistry::requestLibrary(const VkGraphicsPipelineCreateInfo& createInfo, uint32_t libraryFlags) {
+		std::vector<unsigned char> key = stateKey(createInfo);
+		key.insert(key.end(), reinterpret_cast<const unsigned char*>(&libraryFlags), reinterpret_cast<const unsigned char*>(&libraryFlags) + sizeof(libraryFlags));
+		auto found = libraries.find(key);
+		if (found != libraries.end()) {
+			return found->second;
+		}
+
+		std::shared_ptr<Compilation> library = std::make_shared<Compilation>(createInfo);
+		library->libraryFlags = libraryFlags;
+		libraries.emplace(std::move(key), library);
+
+		workers->submit([this, library] {
+			compile(*library);
+		});
+		return library;
+	}
+
+	void PipelineRegistry::compile(Compilation& compilation) {
+		{
+			std::lock_guard<std::mutex> lock(compilation.mutex);
+			if (compilation.state != Compilation::State::Queued) {
+				return;
+			}
+			compilation.state = Compilation::State::Compiling;
+		}
+
+		VkGraphicsPipelineCreateInfo info = compilation.info;
+		VkResult result = VK_SUCCESS;
+#ifdef VK_EXT_graphics_pipeline_library
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = {};
+		libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+		libraryInfo.flags = compilation.libraryFlags;
+		if (compilation.libraryFlags != 0) {
+			info.pNext = &libraryInfo;
+			info.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+		}
+
+		// Linking waits for the libraries, a worker that gets here first compiles the ones nobody started yet
+		std::vector<VkPipeline> libraryPipelines;
+		VkPipelineLibraryCreateInfoKHR linkInfo = {};
+		linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		if (!compilation.libraries.empty()) {
+			for (auto& library : compilation.libraries) {
+				VkResult libraryResult = finish(*library);
+				result = result == VK_SUCCESS ? libraryResult : result;
+				libraryPipelines.push_back(library->pipeline);
+			}
+			linkInfo.libraryCount = static_cast<uint32_t>(libraryPipelines.size());
+			linkInfo.pLibraries = libraryPipelines.data();
+
+			// Without VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT this is a fast link, all state comes from the libraries
+			VkGraphicsPipelineCreateInfo linkedInfo = {};
+			linkedInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			linkedInfo.pNext = &linkInfo;
+			linkedInfo.layout = info.layout;
+			info = linkedInfo;
+		}
+#endif
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (result == VK_SUCCESS) {
+			result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &info, nullptr, &pipeline);
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(compilation.mutex);
+			compilation.pipeline = result == VK_SUCCESS ? pipeline : VK_NULL_HANDLE;
+			compilation.result = result;
+			compilation.ms = ms;
+			compilation.state = Compilation::State::Done;
+		}
+		compilation.done.notify_all();
+	}
+
+	VkResult PipelineRegistry::finish(Compilation& compilation) {
+		compile(compilation);
+
+		std::unique_lock<std::mutex> lock(compilation.mutex);
+		compilation.done.wait(lock, [&compilation] { return compilation.state == Compilation::State::Done; });
+		return compilation.result;
+	}
+
+	size_t PipelineRegistry::KeyHash::operator()(const std::vector<unsigned char>& key) const {
+		return static_cast<size_t>(hashBytes(key.data(), key.size()));
+	}
+
+	std::vector<unsigned char> PipelineRegistry::stateKey(const VkGraphicsPipelineCreateInfo& info) {
+		std::vector<unsigned char> key;
+		key.reserve(512);
+		KeyWriter writer{ key };
+
+		writer.put(info.flags);
+		writer.put(info.stageCount);
+		for (uint32_t i = 0; i < info.stageCount; i++) {
+			const VkPipelineShaderStageCreateInfo& stage = info.pStages[i];
+			writer.put(stage.flags);
+			writer.put(stage.stage);
+			writer.put(stage.module);
+			writer.putString(stage.pName);
+			if (writer.present(stage.pSpecializationInfo)) {
+				const VkSpecializationInfo& specialization = *stage.pSpecializationInfo;
+				writer.putArray(specialization.pMapEntries, specialization.mapEntryCount);
+				writer.putArray(static_cast<const unsigned char*>(specialization.pData), static_cast<uint32_t>(specialization.dataSize));
+			}
+		}
+
+		// Viewports and scissors of dynamic state are ignored by Vulkan, so they don't split pipelines either
+		std::vector<VkDynamicState> dynamicStates;
+		if (info.pDynamicState) {
+			dynamicStates.assign(info.pDynamicState->pDynamicStates, info.pDynamicState->pDynamicStates + info.pDynamicState->dynamicStateCount);
+		}
+		auto dynamic = [&](VkDynamicState state) {
+			return std::find(dynamicStates.begin(), dynamicStates.end(), state) != dynamicStates.end();
+		};
+
+		if (writer.present(info.pVertexInputState)) {
+			const VkPipelineVertexInputStateCreateInfo& state = *info.pVertexInputState;
+			writer.put(state.flags);
+			writer.putArray(state.pVertexBindingDescriptions, state.vertexBindingDescriptionCount);
+			writer.putArray(state.pVertexAttributeDescriptions, state.vertexAttributeDescriptionCount);
+		}
+		if (writer.present(info.pInputAssemblyState)) {
+			const VkPipelineInputAssemblyStateCreateInfo& state = *info.pInputAssemblyState;
+			writer.put(state.flags);
+			writer.put(state.topology);
+			writer.put(state.primitiveRestartEnable);
+		}
+		if (writer.present(info.pTessellationState)) {
+			writer.put(info.pTessellationState->flags);
+			writer.put(info.pTessellationState->patchControlPoints);
+		}
+		if (writer.present(info.pViewportState)) {
+			const VkPipelineViewportStateCreateInfo& state = *info.pViewportState;
+			writer.put(state.flags);
+			writer.putArray(dynamic(VK_DYNAMIC_STATE_VIEWPORT) ? nullptr : state.pViewports, state.viewportCount);
+			writer.putArray(dynamic(VK_DYNAMIC_STATE_SCISSOR) ? nullptr : state.pScissors, state.scissorCount);
+		}
+		if (writer.present(info.pRasterizationState)) {
+			const VkPipelineRasterizationStateCreateInfo& state = *info.pRasterizationState;
+			writer.put(state.flags);
+			writer.put(state.depthClampEnable);
+			writer.put(state.rasterizerDiscardEnable);
+			writer.put(state.polygonMode);
+			writer.put(state.cullMode);
+			writer.put(state.frontFace);
+			writer.put(state.depthBiasEnable);
+			writer.put(state.depthBiasConstantFactor);
+			writer.put(state.depthBiasClamp);
+			writer.put(state.depthBiasSlopeFactor);
+			writer.put(state.lineWidth);
+		}
+		if (writer.present(info.pMultisampleState)) {
+			const VkPipelineMultisampleStateCreateInfo& state = *info.pMultisampleState;
+			writer.put(state.flags);
+			writer.put(state.rasterizationSamples);
+			writer.put(state.sampleShadingEnable);
+			writer.put(state.minSampleShading);
+			writer.putArray(state.pSampleMask, state.pSampleMask ? (static_cast<uint32_t>(state.rasterizationSamples) + 31) / 32 : 0);
+			writer.put(state.alphaToCoverageEnable);
+			writer.put(state.alphaToOneEnable);
+		}
+		if (writer.present(info.pDepthStencilState)) {
+			const VkPipelineDepthStencilStateCreateInfo& state = *info.pDepthStencilState;
+			writer.put(state.flags);
+			writer.put(state.depthTestEnable);
+			writer.put(state.depthWriteEnable);
+			writer.put(state.depthCompareOp);
+			writer.put(state.depthBoundsTestEnable);
+			writer.put(state.stencilTestEnable);
+			writer.put(state.front);
+			writer.put(state.back);
+			writer.put(state.minDepthBounds);
+			writer.put(state.maxDepthBounds);
+		}
+		if (writer.present(info.pColorBlendState)) {
+			const VkPipelineColorBlendStateCreateInfo& state = *info.pColorBlendState;
+			writer.put(state.flags);
+			writer.put(state.logicOpEnable);
+			writer.put(state.logicOp);
+			writer.putArray(state.pAttachments, state.attachmentCount);
+			writer.put(state.blendConstants);
+		}
+		if (writer.present(info.pDynamicState)) {
+			writer.put(info.pDynamicState->flags);
+			writer.putArray(dynamicStates.data(), static_cast<uint32_t>(dynamicStates.size()));
+		}
+
+		writer.put(info.layout);
+		writer.put(info.renderPass);
+		writer.put(info.subpass);
+		return key;
+	}
+
+}
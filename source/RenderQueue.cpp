@@ -0,0 +1,66 @@
+#include "../include/RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace vkbase {
+
+	uint64_t drawSortKey(RenderPass pass, uint32_t pipeline, uint32_t material, float depth) {
+
+		// The bits of a non negative float sort like the float, the top 24 of its 31 bits are the depth bucket
+		uint32_t depthBits = 0;
+		if (depth > 0.0f) {
+			memcpy(&depthBits, &depth, sizeof(depthBits));
+		}
+		uint64_t bucket = depthBits >> 7;
+		uint64_t state = (static_cast<uint64_t>(std::min(pipeline, 0x3fffu)) << 16) | std::min(material, 0xffffu);
+		uint64_t key = static_cast<uint64_t>(pass) << 62;
+
+		if (pass == RenderPass::Blended) {
+			return key | ((~bucket & 0xffffff) << 38) | (state << 8);
+		}
+		return key | (state << 24) | bucket;
+	}
+
+	void RenderQueue::sort(void) {
+
+		const size_t count = keys.size();
+		if (count < 2) {
+			return;
+		}
+		scratchKeys.resize(count);
+		scratchItems.resize(count);
+
+		// All eight digit histograms in one pass over the keys
+		uint32_t histograms[8][256] = {};
+		for (uint64_t key : keys) {
+			for (int digit = 0; digit < 8; digit++) {
+				histograms[digit][(key >> (digit * 8)) & 0xff]++;
+			}
+		}
+
+		// Stable scatter per 8 bit digit, least significant first; digits shared by all keys are skipped
+		for (int digit = 0; digit < 8; digit++) {
+			uint32_t* histogram = histograms[digit];
+			if (histogram[(keys[0] >> (digit * 8)) & 0xff] == count) {
+				continue;
+			}
+
+			uint32_t offset = 0;
+			for (int bucket = 0; bucket < 256; bucket++) {
+				uint32_t bucketCount = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += bucketCount;
+			}
+			for (size_t i = 0; i < count; i++) {
+				uint32_t target = histogram[(keys[i] >> (digit * 8)) & 0xff]++;
+				scratchKeys[target] = keys[i];
+				scratchItems[target] = items[i];
+			}
+			keys.swap(scratchKeys);
+			items.swap(scratchItems);
+		}
+	}
+
+}
@@ -0,0 +1,239 @@
+#include "../include/SceneCache.h"
+#include "../include/Hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+
+namespace {
+
+	const uint32_t CACHE_MAGIC = 0x43544b56; // "VKTC"
+	const uint32_t CACHE_VERSION = 7;
+	const size_t SECTION_ALIGNMENT = 16;
+
+	struct CacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t settingsHash;
+		uint32_t sectionCount;
+		uint32_t reserved;
+	};
+
+	struct CacheSectionEntry {
+		uint32_t id;
+		uint32_t reserved;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	bool statFile(const std::string& filename, uint64_t& size, int64_t& modifiedTime) {
+		struct stat fileStat;
+		if (stat(filename.c_str(), &fileStat) != 0) {
+			return false;
+		}
+		size = static_cast<uint64_t>(fileStat.st_size);
+		modifiedTime = static_cast<int64_t>(fileStat.st_mtime);
+		return true;
+	}
+
+	bool hashFile(const std::string& filename, uint64_t& hash) {
+		vkbase::MappedFile file;
+		if (!file.open(filename)) {
+			return false;
+		}
+		file.adviseSequential();
+		hash = vkbase::hashBytes(file.data(), file.size());
+		return true;
+	}
+
+	size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+}
+
+
+namespace vkbase {
+
+	bool SceneCacheWriter::addSource(const std::string& filename) {
+		SceneCacheSource source{};
+		if (!statFile(filename, source.size, source.modifiedTime) || !hashFile(filename, source.contentHash)) {
+			return false;
+		}
+		SceneCacheString path = addString(filename);
+		source.pathOffset = path.offset;
+		source.pathLength = path.length;
+		sources.push_back(source);
+		return true;
+	}
+
+	SceneCacheString SceneCacheWriter::addString(const std::string& string) {
+		SceneCacheString result;
+		result.offset = static_cast<uint32_t>(strings.size());
+		result.length = static_cast<uint32_t>(string.size());
+		strings.insert(strings.end(), string.begin(), string.end());
+		return result;
+	}
+
+	void SceneCacheWriter::setSection(SceneCacheSection section, const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (auto& entry : sections) {
+			if (entry.first == section) {
+				entry.second.assign(bytes, bytes + size);
+				return;
+			}
+		}
+		sections.emplace_back(section, std::vector<unsigned char>(bytes, bytes + size));
+	}
+
+	bool SceneCacheWriter::write(const std::string& filename, uint64_t settingsHash) {
+
+		setSection(SceneCacheSection::Sources, sources);
+		setSection(SceneCacheSection::Strings, strings);
+
+		CacheHeader header{};
+		header.magic = CACHE_MAGIC;
+		header.version = CACHE_VERSION;
+		header.settingsHash = settingsHash;
+		header.sectionCount = static_cast<uint32_t>(sections.size());
+
+		std::vector<CacheSectionEntry> entries(sections.size());
+		size_t offset = alignUp(sizeof(CacheHeader) + entries.size() * sizeof(CacheSectionEntry), SECTION_ALIGNMENT);
+		for (size_t i = 0; i < sections.size(); i++) {
+			entries[i].id = static_cast<uint32_t>(sections[i].first);
+			entries[i].offset = offset;
+			entries[i].size = sections[i].second.size();
+			offset = alignUp(offset + sections[i].second.size(), SECTION_ALIGNMENT);
+		}
+
+		std::string tempFilename = filename + ".tmp";
+		FILE* file = fopen(tempFilename.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(entries.data(), sizeof(CacheSectionEntry), entries.size(), file) == entries.size();
+		size_t written = sizeof(CacheHeader) + entries.size() * sizeof(CacheSectionEntry);
+		const unsigned char padding[SECTION_ALIGNMENT] = {};
+		for (size_t i = 0; ok && i < sections.size(); i++) {
+			size_t paddingSize = static_cast<size_t>(entries[i].offset) - written;
+			ok = fwrite(padding, 1, paddingSize, file) == paddingSize;
+			if (ok && !sections[i].second.empty()) {
+				ok = fwrite(sections[i].second.data(), 1, sections[i].second.size(), file) == sections[i].second.size();
+			}
+			written = static_cast<size_t>(entries[i].offset + entries[i].size);
+		}
+		ok = (fclose(file) == 0) && ok;
+
+		if (!ok) {
+			remove(tempFilename.c_str());
+			return false;
+		}
+
+		// rename does not replace existing files on windows
+		remove(filename.c_str());
+		if (rename(tempFilename.c_str(), filename.c_str()) != 0) {
+			remove(tempFilename.c_str());
+			return false;
+		}
+		return true;
+	}
+
+
+	bool SceneCache::open(const std::string& filename, uint64_t settingsHash) {
+
+		if (!file.open(filename)) {
+			return false;
+		}
+
+		bool valid = file.size() >= sizeof(CacheHeader);
+		if (valid) {
+			const CacheHeader* header = reinterpret_cast<const CacheHeader*>(file.data());
+			valid = header->magic == CACHE_MAGIC && header->version == CACHE_VERSION && header->settingsHash == settingsHash &&
+				file.size() >= sizeof(CacheHeader) + header->sectionCount * sizeof(CacheSectionEntry);
+		}
+		if (valid) {
+			const CacheHeader* header = reinterpret_cast<const CacheHeader*>(file.data());
+			const CacheSectionEntry* entries = reinterpret_cast<const CacheSectionEntry*>(file.data() + sizeof(CacheHeader));
+			for (uint32_t i = 0; i < header->sectionCount; i++) {
+				valid = valid && entries[i].offset + entries[i].size <= file.size();
+			}
+		}
+
+		valid = valid && sourcesValid();
+		if (!valid) {
+			file.close();
+			return false;
+		}
+
+		file.adviseSequential();
+		return true;
+	}
+
+	const unsigned char* SceneCache::sectionData(SceneCacheSection id, size_t& size) const {
+		size = 0;
+		if (!file.isOpen()) {
+			return nullptr;
+		}
+
+		const CacheHeader* header = reinterpret_cast<const CacheHeader*>(file.data());
+		const CacheSectionEntry* entries = reinterpret_cast<const CacheSectionEntry*>(file.data() + sizeof(CacheHeader));
+		for (uint32_t i = 0; i < header->sectionCount; i++) {
+			if (entries[i].id == static_cast<uint32_t>(id)) {
+				size = static_cast<size_t>(entries[i].size);
+				return file.data() + entries[i].offset;
+			}
+		}
+		return nullptr;
+	}
+
+	std::string SceneCache::string(const SceneCacheString& string) const {
+		size_t size = 0;
+		const unsigned char* strings = sectionData(SceneCacheSection::Strings, size);
+		if (!strings || string.offset + string.length > size) {
+			return std::string();
+		}
+		return std::string(reinterpret_cast<const char*>(strings) + string.offset, string.length);
+	}
+
+	std::vector<std::string> SceneCache::sourcePaths() const {
+		size_t count = 0;
+		const SceneCacheSource* sources = section<SceneCacheSource>(SceneCacheSection::Sources, count);
+
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < count; i++) {
+			paths.push_back(string({ sources[i].pathOffset, sources[i].pathLength }));
+		}
+		return paths;
+	}
+
+	bool SceneCache::sourcesValid() const {
+		size_t count = 0;
+		const SceneCacheSource* sources = section<SceneCacheSource>(SceneCacheSection::Sources, count);
+		if (!sources || count == 0) {
+			return false;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			std::string path = string({ sources[i].pathOffset, sources[i].pathLength });
+
+			uint64_t size;
+			int64_t modifiedTime;
+			if (!statFile(path, size, modifiedTime) || size != sources[i].size) {
+				return false;
+			}
+
+			// Only touched files need to be hashed again
+			if (modifiedTime != sources[i].modifiedTime) {
+				uint64_t hash;
+				if (!hashFile(path, hash) || hash != sources[i].contentHash) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,219 @@
+#include "../include/SceneStreaming.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <numeric>
+
+
+namespace vkbase {
+
+	std::vector<StreamChunk> partitionScene(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax, float cellSize) {
+
+		// Cells are keyed by their integer coordinates, the ordered map keeps neighbouring cells close in the chunk list
+		std::map<std::array<int64_t, 3>, std::vector<uint32_t>> cells;
+		for (uint32_t i = 0; i < boundsMin.size(); i++) {
+			if (glm::any(glm::greaterThan(boundsMin[i], boundsMax[i]))) {
+				continue;
+			}
+			glm::vec3 center = (boundsMin[i] + boundsMax[i]) * 0.5f;
+			std::array<int64_t, 3> cell = { 0, 0, 0 };
+			if (cellSize > 0.0f) {
+				for (int k = 0; k < 3; k++) {
+					cell[k] = static_cast<int64_t>(std::floor(center[k] / cellSize));
+				}
+			}
+			cells[cell].push_back(i);
+		}
+
+		std::vector<StreamChunk> chunks;
+		chunks.reserve(cells.size());
+		for (auto& cell : cells) {
+			StreamChunk chunk;
+			chunk.meshes = std::move(cell.second);
+
+			// Meshes reach past their cell, the chunk's bounds cover all of them
+			glm::vec3 chunkMin = boundsMin[chunk.meshes[0]];
+			glm::vec3 chunkMax = boundsMax[chunk.meshes[0]];
+			for (uint32_t mesh : chunk.meshes) {
+				chunkMin = glm::min(chunkMin, boundsMin[mesh]);
+				chunkMax = glm::max(chunkMax, boundsMax[mesh]);
+			}
+			chunk.boundingSphere = glm::vec4((chunkMin + chunkMax) * 0.5f, glm::length(chunkMax - chunkMin) * 0.5f);
+			chunks.push_back(std::move(chunk));
+		}
+		return chunks;
+	}
+
+	void ChunkResidency::reset(const std::vector<StreamChunk>& chunks, const std::vector<uint64_t>& imageBytes, uint64_t budget) {
+		chunkList = chunks;
+		states.assign(chunks.size(), ChunkState::Evicted);
+		lastUsed.assign(chunks.size(), 0);
+		imageSizes = imageBytes;
+		imageUsers.assign(imageBytes.size(), 0);
+		frame = 0;
+
+		statistics = StreamingStats();
+		statistics.budget = budget;
+		statistics.chunkCount = static_cast<uint32_t>(chunks.size());
+	}
+
+	void ChunkResidency::plan(const std::vector<float>& distances, uint64_t uploadLimit, std::vector<uint32_t>& load, std::vector<uint32_t>& evict,
+		std::vector<uint32_t>& loadImages, std::vector<uint32_t>& evictImages) {
+
+		load.clear();
+		evict.clear();
+		loadImages.clear();
+		evictImages.clear();
+		frame++;
+
+		std::vector<uint32_t> order(chunkList.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return distances[a] < distances[b];
+		});
+
+		// The wanted set grows from the camera outwards until the budget is used up, shared images count once
+		std::vector<bool> wanted(chunkList.size(), false);
+		std::vector<bool> imageCounted(imageSizes.size(), false);
+		uint64_t wantedBytes = 0;
+		size_t wantedCount = 0;
+		for (uint32_t chunk : order) {
+			uint64_t bytes = chunkList[chunk].geometryBytes;
+			for (uint32_t image : chunkList[chunk].images) {
+				bytes += imageCounted[image] ? 0 : imageSizes[image];
+			}
+			if (wantedBytes + bytes > statistics.budget) {
+				break;
+			}
+			wantedBytes += bytes;
+			wanted[chunk] = true;
+			wantedCount++;
+			lastUsed[chunk] = frame;
+			for (uint32_t image : chunkList[chunk].images) {
+				imageCounted[image] = true;
+			}
+		}
+
+		// Resident chunks outside the wanted set stay cached until their room is needed
+		std::vector<uint32_t> victims;
+		for (uint32_t chunk = 0; chunk < chunkList.size(); chunk++) {
+			if (states[chunk] == ChunkState::Resident && !wanted[chunk]) {
+				victims.push_back(chunk);
+			}
+		}
+		std::sort(victims.begin(), victims.end(), [&](uint32_t a, uint32_t b) {
+			return lastUsed[a] != lastUsed[b] ? lastUsed[a] < lastUsed[b] : distances[a] > distances[b];
+		});
+		size_t nextVictim = 0;
+
+		uint64_t batchBytes = 0;
+		statistics.missingChunks = 0;
+		for (size_t i = 0; i < wantedCount; i++) {
+			uint32_t chunk = order[i];
+			if (states[chunk] != ChunkState::Evicted) {
+				continue;
+			}
+			if (!load.empty() && batchBytes >= uploadLimit) {
+				statistics.missingChunks++;
+				continue;
+			}
+
+			uint64_t cost = loadCost(chunk);
+			while (statistics.residentBytes + cost > statistics.budget && nextVictim < victims.size()) {
+				uint32_t victim = victims[nextVictim++];
+				statistics.evictedBytes += chunkList[victim].geometryBytes;
+				statistics.evictions++;
+				release(victim, evictImages);
+				evict.push_back(victim);
+				cost = loadCost(chunk);
+			}
+			if (statistics.residentBytes + cost > statistics.budget) {
+				statistics.missingChunks++;
+				continue;
+			}
+
+			states[chunk] = ChunkState::Loading;
+			for (uint32_t image : chunkList[chunk].images) {
+				if (imageUsers[image]++ > 0) {
+					continue;
+				}
+				// An image whose last user was evicted by this batch is still loaded and simply stays
+				auto evicted = std::find(evictImages.begin(), evictImages.end(), image);
+				if (evicted != evictImages.end()) {
+					evictImages.erase(evicted);
+				}
+				else {
+					loadImages.push_back(image);
+				}
+			}
+			statistics.residentBytes += cost;
+			statistics.loadedBytes += cost;
+			statistics.loads++;
+			batchBytes += cost;
+			load.push_back(chunk);
+		}
+
+		updateCounts();
+	}
+
+	void ChunkResidency::finishLoads(const std::vector<uint32_t>& chunks) {
+		for (uint32_t chunk : chunks) {
+			if (states[chunk] == ChunkState::Loading) {
+				states[chunk] = ChunkState::Resident;
+			}
+		}
+		updateCounts();
+	}
+
+	void ChunkResidency::cancelLoads(const std::vector<uint32_t>& chunks) {
+		std::vector<uint32_t> unusedImages;
+		for (uint32_t chunk : chunks) {
+			if (states[chunk] == ChunkState::Loading) {
+				release(chunk, unusedImages);
+			}
+		}
+		updateCounts();
+	}
+
+	void ChunkResidency::setImageBytes(uint32_t image, uint64_t bytes) {
+		if (imageUsers[image] > 0) {
+			statistics.residentBytes = statistics.residentBytes - imageSizes[image] + bytes;
+		}
+		imageSizes[image] = bytes;
+	}
+
+	uint64_t ChunkResidency::loadCost(uint32_t chunk) const {
+		uint64_t cost = chunkList[chunk].geometryBytes;
+		for (uint32_t image : chunkList[chunk].images) {
+			cost += imageUsers[image] == 0 ? imageSizes[image] : 0;
+		}
+		return cost;
+	}
+
+	void ChunkResidency::release(uint32_t chunk, std::vector<uint32_t>& evictImages) {
+		states[chunk] = ChunkState::Evicted;
+		statistics.residentBytes -= chunkList[chunk].geometryBytes;
+		for (uint32_t image : chunkList[chunk].images) {
+			if (--imageUsers[image] == 0) {
+				statistics.residentBytes -= imageSizes[image];
+				evictImages.push_back(image);
+			}
+		}
+	}
+
+	void ChunkResidency::updateCounts() {
+		statistics.residentChunks = 0;
+		statistics.loadingChunks = 0;
+		for (ChunkState state : states) {
+			statistics.residentChunks += state == ChunkState::Resident ? 1 : 0;
+			statistics.loadingChunks += state == ChunkState::Loading ? 1 : 0;
+		}
+		statistics.residentImages = 0;
+		for (uint32_t users : imageUsers) {
+			statistics.residentImages += users > 0 ? 1 : 0;
+		}
+	}
+
+}
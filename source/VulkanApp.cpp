@@ -10,8 +10,9 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "../include/Hash.h"
 
-#define VERTEX_BUFFER_BIND_ID 0
+#include <chrono>
 
 bool firstMouse = true;
 float lastX = WIDTH / 2.0f;
@@ -44,6 +45,24 @@ VulkanApp::VulkanApp( ) : VulkanRenderer() {
 	global_camera = new Camera();
 }
 
+void VulkanApp::parseArguments(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--hot-reload") {
+			loaderSettings.hotReload = true;
+		}
+		else if (argument == "--benchmark-decode") {
+			loaderSettings.benchmarkDecode = true;
+#ifndef VKTINY_BENCHMARK
+			std::cerr << "--benchmark-decode needs a build with VKTINY_BENCHMARK" << std::endl;
+#endif
+		}
+		else {
+			std::cerr << "unknown argument " << argument << std::endl;
+		}
+	}
+}
+
 VulkanApp::~VulkanApp( ) {
 
 #ifndef NDEBUG
@@ -58,6 +77,11 @@ VulkanApp::~VulkanApp( ) {
 		model = nullptr;
 	}
 
+	// Material pipelines are owned by the registry
+	pipelineRegistry.reset();
+
+	sceneRecorder.reset();
+
 
 	vmaDestroyBuffer(global_allocator->allocator, global_uniform_buffer->buffer, global_uniform_buffer->allocation);
 
@@ -90,7 +114,40 @@ void VulkanApp::renderLoop() {
 		glfwPollEvents();
 		processInput(vulkan_surface->window);
 
-		render();
+		// The model loads in the background, its descriptor sets and pipelines are created once it is resident
+		if (!modelReady && model->pollLoad() == vkbase::LoadState::Resident) {
+			createDescriptorPool();
+			createDescriptorSets();
+			preparePipelines();
+			modelReady = true;
+			modelWatcher.watch(model->sourceFiles());
+		}
+
+		// Hot reload, changed sources are parsed in the background and swapped in between frames
+		if (modelReady) {
+			if (!modelWatcher.poll().empty()) {
+				reloadRequested = true;
+			}
+			if (reloadRequested && model->reloadAsync()) {
+				reloadRequested = false;
+			}
+			vkbase::ReloadChanges changes;
+			if (model->pollReload(changes)) {
+				applyModelChanges(changes);
+				modelWatcher.watch(model->sourceFiles());
+			}
+
+			// Streamed chunks load and evict around the camera of the previous frame
+			std::vector<uint32_t> streamedImages;
+			if (model->pollStreaming(streamedImages)) {
+				updateStreamedDescriptors(streamedImages);
+			}
+
+			// Pipelines no drawn material waited for arrive from the compile workers
+			if (!pendingPipelines.empty()) {
+				pollPipelines();
+			}
+		}
 
 		//transform_matrices.view *= glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
 		transform_matrices.view = global_camera->GetViewMatrix();
@@ -101,7 +158,12 @@ void VulkanApp::renderLoop() {
 		//transform_matrices.model = glm::rotate(transform_matrices.model, degreesToRadians(180.0f), glm::vec3(0.0, 0.0f, 1.0f));
 		transform_matrices.model = glm::scale(transform_matrices.model, glm::vec3(0.01f, 0.01f, 0.01f));
 
-		memcpy(uniform_allocation_info.pMappedData, &transform_matrices, sizeof(uboVS));
+		// Levels of detail are picked for the same scene matrix and camera the vertex shader uses
+		if (modelReady) {
+			model->lodView.sceneMatrix = transform_matrices.model;
+			model->lodView.cameraPosition = global_camera->Position;
+			model->lodView.projectionScale = (float)HEIGHT / (2.0f * tan(glm::radians(60.0f) * 0.5f));
+		}
 
 		//bool show_demo_window = true;
 		//bool show_another_window = false;
@@ -112,7 +174,7 @@ void VulkanApp::renderLoop() {
 
 		//ImGui::Render();
 
-		buildCommandBuffers();
+		render();
 	}
 	vkDeviceWaitIdle(global_device->logicalDevice);
 }
@@ -139,7 +201,7 @@ void VulkanApp::createDescriptorSetLayout() {
 	//descriptor set for passing matrices
 	VkDescriptorSetLayoutBinding layoutBinding = {};
 	layoutBinding.binding = 0;
-	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	layoutBinding.descriptorCount = 1;
 	layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -209,10 +271,11 @@ void VulkanApp::createDescriptorSets() {
 		descriptorWrites[0].dstBinding = 0;
 		descriptorWrites[0].dstArrayElement = 0;
 		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		descriptorWrites[0].pBufferInfo = &bufferInfo;
 
 		vkUpdateDescriptorSets(global_device->logicalDevice, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+		descriptorGeneration++;
 	}
 
 	{
@@ -228,32 +291,98 @@ void VulkanApp::createDescriptorSets() {
 				throw std::runtime_error("failed to allocate descriptor sets");
 			}
 
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+			writeMaterialDescriptors(material);
+		}
+	}
+
+}
+
+void VulkanApp::writeMaterialDescriptors(vkbase::Material& material) {
+
+	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
 
-			VkDescriptorImageInfo colorInfo = model->getTextureDescriptor(material.baseColorTextureIndex);
+	VkDescriptorImageInfo colorInfo = model->getTextureDescriptor(material.baseColorTextureIndex);
 
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = material.descriptorSet;
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[0].pImageInfo = &colorInfo;
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = material.descriptorSet;
+	descriptorWrites[0].dstBinding = 0;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[0].pImageInfo = &colorInfo;
 
-			VkDescriptorImageInfo normalInfo = model->getTextureDescriptor(material.normalTextureIndex);
+	VkDescriptorImageInfo normalInfo = model->getTextureDescriptor(material.normalTextureIndex);
 
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = material.descriptorSet;
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].pImageInfo = &normalInfo;
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = material.descriptorSet;
+	descriptorWrites[1].dstBinding = 1;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[1].pImageInfo = &normalInfo;
 
-			vkUpdateDescriptorSets(global_device->logicalDevice, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+	vkUpdateDescriptorSets(global_device->logicalDevice, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+	descriptorGeneration++;
+}
+
+bool VulkanApp::samplesImage(const vkbase::Material& material, const std::vector<uint32_t>& images) const {
+	// Materials reference textures, the changes list images, a texture names its image
+	auto samples = [&](uint32_t texture) {
+		return texture < model->textures.size() && std::find(images.begin(), images.end(), static_cast<uint32_t>(model->textures[texture].imageIndex)) != images.end();
+	};
+	return samples(material.baseColorTextureIndex) || samples(material.normalTextureIndex);
+}
+
+void VulkanApp::applyModelChanges(const vkbase::ReloadChanges& changes) {
+
+	// Frames in flight may still use the replaced descriptor sets
+	waitForFrames();
+
+	// Pipelines belong to the registry, materials that change state just pick up another shared one
+	if (changes.materialsResized) {
+		vkDestroyDescriptorPool(global_device->logicalDevice, descriptorPool, nullptr);
+		createDescriptorPool();
+		createDescriptorSets();
+		preparePipelines();
+	}
+	else {
+		auto contains = [](const std::vector<uint32_t>& list, uint32_t value) {
+			return std::find(list.begin(), list.end(), value) != list.end();
+		};
+		for (uint32_t i = 0; i < model->materials.size(); i++) {
+			vkbase::Material& material = model->materials[i];
+			if (contains(changes.textureMaterials, i) || samplesImage(material, changes.images)) {
+				writeMaterialDescriptors(material);
+			}
+		}
+		if (!changes.pipelineMaterials.empty()) {
+			preparePipelines(changes.pipelineMaterials);
+		}
+	}
+
+	std::cout << "reloaded model: " << changes.geometryBytes / 1024 << " KB of geometry, " << changes.images.size() << " images, "
+		<< (changes.materialsResized ? model->materials.size() : changes.pipelineMaterials.size()) << " pipelines" << std::endl;
+}
+
+void VulkanApp::updateStreamedDescriptors(const std::vector<uint32_t>& images) {
+
+	// As for a reload, no frame in flight may still use the descriptor sets
+	waitForFrames();
+
+	for (auto& material : model->materials) {
+		if (samplesImage(material, images)) {
+			writeMaterialDescriptors(material);
 		}
 	}
 
+	float now = glfwGetTime();
+	if (now - lastStreamingReport >= 1.0f) {
+		const vkbase::StreamingStats& stats = model->streamingStats();
+		std::cout << "streaming: " << stats.residentChunks << "/" << stats.chunkCount << " chunks, " << stats.residentImages << " images, "
+			<< (stats.residentBytes >> 20) << "/" << (stats.budget >> 20) << " MB, " << stats.missingChunks << " missing, "
+			<< stats.loads << " loads, " << stats.evictions << " evictions" << std::endl;
+		lastStreamingReport = now;
+	}
 }
 
 /*void VulkanApp::createApplicationInfoWindow() {
@@ -295,17 +424,33 @@ void VulkanApp::render() {
 
 void VulkanApp::loadAssets() {
 	//load model
+	VkDeviceSize alignment = std::max<VkDeviceSize>(global_device->properties.limits.minUniformBufferOffsetAlignment, 1);
+	uniform_slice_size = (sizeof(uboVS) + alignment - 1) / alignment * alignment;
 	global_uniform_buffer = new vkbase::Buffer(global_allocator->allocator);
-	global_allocator->createBuffer(global_uniform_buffer, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &uniform_allocation_info, sizeof(uboVS));
+	global_allocator->createBuffer(global_uniform_buffer, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_ONLY, &uniform_allocation_info, uniform_slice_size * frames_in_flight);
 
 
-	model = new GLTFKtxModel("../assets/sponza/sponza.gltf", global_device->graphicsQueue);
+	vkbase::LoaderSettings settings = loaderSettings;
+	// Scenes that don't fit into memory are streamed from their scene cache in chunks around the camera
+	//settings.streaming = true;
+	//settings.streamingBudget = 512ull << 20;
+	model = new GLTFKtxModel(global_device->graphicsQueue, settings);
+	modelLoad = model->loadAsync("../assets/sponza/sponza.gltf");
 	//model = new GLTFPngModel("../assets/bistro_exterior/bistro_exterior.gltf", global_device->graphicsQueue);
 	//model = new GLTFPngModel("../assets/bistro_interior/bistro_interior.gltf", global_device->graphicsQueue);
 }
 
 
 void VulkanApp::preparePipelines() {
+	std::vector<uint32_t> materialIndices(model->materials.size());
+	for (uint32_t i = 0; i < materialIndices.size(); i++) {
+		materialIndices[i] = i;
+	}
+	preparePipelines(materialIndices);
+}
+
+
+void VulkanApp::preparePipelines(const std::vector<uint32_t>& materialIndices) {
 	
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vkbase::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 	VkPipelineRasterizationStateCreateInfo rasterizationState = vkbase::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
@@ -319,27 +464,41 @@ void VulkanApp::preparePipelines() {
 		VK_DYNAMIC_STATE_VIEWPORT,
 		VK_DYNAMIC_STATE_SCISSOR,
 	};
+#ifdef VK_EXT_extended_dynamic_state
+	// The cull mode is set per material while recording, so all materials share one pipeline
+	if (global_device->extendedDynamicState) {
+		dynamicStateEnables.push_back(VK_DYNAMIC_STATE_CULL_MODE_EXT);
+	}
+#endif
+	model->dynamicCullMode = global_device->extendedDynamicState;
 
 	VkPipelineDynamicStateCreateInfo dynamicState = vkbase::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), dynamicStateEnables.size(), 0);
 
 	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
-	VkVertexInputBindingDescription vertexInputBinding = vkbase::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+	std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+		vkbase::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, vkbase::vertexStride(model->vertexFormat()), VK_VERTEX_INPUT_RATE_VERTEX),
+		vkbase::initializers::vertexInputBindingDescription(INSTANCE_BUFFER_BIND_ID, sizeof(glm::mat4), VK_VERTEX_INPUT_RATE_INSTANCE),
+	};
 
 	// Attribute descriptions
 	// Describes memory layout and shader positions
 	// Vertex
-	std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-		vkbase::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)),
-		vkbase::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)),
-		vkbase::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)),
-		vkbase::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 3, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)),
-		vkbase::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 4, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, tangent)),
-	};
+	// Vertex (generated from the model's vertex format)
+	std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = vkbase::vertexInputAttributes(model->vertexFormat(), VERTEX_BUFFER_BIND_ID);
+	// Instance (model matrix, one attribute per column)
+	for (uint32_t column = 0; column < 4; column++) {
+		vertexInputAttributes.push_back(vkbase::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 5 + column, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(glm::vec4) * column));
+	}
 
 	//mesh rendering pipeline
-	shaderStages[0] = loadShader("../shaders/mesh_basic.vspv", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderStages[1] = loadShader("../shaders/mesh_basic.fspv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	// The modules are loaded once, so pipelines requested again after a reload are found in the registry
+	if (meshShaderStages.empty()) {
+		meshShaderStages.push_back(loadShader(vkbase::vertexShaderPath(model->vertexFormat()), VK_SHADER_STAGE_VERTEX_BIT));
+		meshShaderStages.push_back(loadShader("../shaders/mesh_basic.fspv", VK_SHADER_STAGE_FRAGMENT_BIT));
+	}
+	shaderStages[0] = meshShaderStages[0];
+	shaderStages[1] = meshShaderStages[1];
 	//shaderStages[0] = loadShader("../shaders/tbn.vspv", VK_SHADER_STAGE_VERTEX_BIT);
 	//shaderStages[1] = loadShader("../shaders/tbn.fspv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
@@ -355,25 +514,92 @@ void VulkanApp::preparePipelines() {
 	pipelineCreateInfo.pStages = shaderStages.data();
 
 	VkPipelineVertexInputStateCreateInfo vertexInputState = vkbase::initializers::pipelineVertexInputStateCreateInfo();
-	vertexInputState.vertexBindingDescriptionCount = 1;
-	vertexInputState.pVertexBindingDescriptions = &vertexInputBinding;
+	vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
+	vertexInputState.pVertexBindingDescriptions = vertexInputBindings.data();
 	vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
 	vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
 
 	pipelineCreateInfo.pVertexInputState = &vertexInputState;
 
-	//we need a pipeline for each material
-	for (auto& material : model->materials) {
+	if (!pipelineRegistry) {
+		// VKTINY_MONOLITHIC_PIPELINES allows comparing both paths on a device with pipeline libraries
+#ifdef VKTINY_MONOLITHIC_PIPELINES
+		const bool pipelineLibraries = false;
+#else
+		const bool pipelineLibraries = global_device->graphicsPipelineLibrary;
+#endif
+		pipelineRegistry = std::make_unique<vkbase::PipelineRegistry>(global_device->logicalDevice, pipeline_cache, pipelineLibraries);
+	}
+
+	// Requests of earlier calls for these materials are superseded
+	pendingPipelines.erase(std::remove_if(pendingPipelines.begin(), pendingPipelines.end(), [&](const std::pair<uint32_t, uint32_t>& pending) {
+		return std::find(materialIndices.begin(), materialIndices.end(), pending.first) != materialIndices.end();
+	}), pendingPipelines.end());
+	if (pendingPipelines.empty()) {
+		pipelineBuildStart = std::chrono::high_resolution_clock::now();
+		pipelineBuildCreationMs = pipelineRegistry->creationMs();
+	}
+
+	// All states are requested (and copied) first, the workers compile them while the ones the draw list needs are awaited below
+	std::vector<uint32_t> stateIds(materialIndices.size());
+	for (size_t i = 0; i < materialIndices.size(); i++) {
+		const vkbase::Material& material = model->materials[materialIndices[i]];
+
+		// For double sided materials, culling will be disabled (the static cull mode is ignored if it is dynamic)
+		rasterizationState.cullMode = material.doubleSided && !model->dynamicCullMode ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+		stateIds[i] = pipelineRegistry->request(pipelineCreateInfo);
+	}
+
+	// Only the materials of the draw list block the first frame, the others are picked up by pollPipelines
+	std::vector<bool> drawn(model->materials.size(), false);
+	for (const vkbase::DrawPacket& packet : model->drawList()) {
+		drawn[packet.material] = true;
+	}
+	for (size_t i = 0; i < materialIndices.size(); i++) {
+		vkbase::Material& material = model->materials[materialIndices[i]];
+		material.pipeline = drawn[materialIndices[i]] ? pipelineRegistry->wait(stateIds[i]) : pipelineRegistry->pipeline(stateIds[i]);
+		if (material.pipeline == VK_NULL_HANDLE) {
+			pendingPipelines.emplace_back(materialIndices[i], stateIds[i]);
+		}
+	}
+	if (pendingPipelines.empty()) {
+		reportPipelineBuild();
+	}
 
-		// For double sided materials, culling will be disabled
-		rasterizationState.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+	// Packets hold the pipeline and descriptor set handles
+	model->invalidateDrawList();
 
-		if (vkCreateGraphicsPipelines(global_device->logicalDevice, pipeline_cache, 1, &pipelineCreateInfo, nullptr, &material.pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create graphics pipeline");
+
+}
+
+void VulkanApp::pollPipelines() {
+	bool changed = false;
+	for (size_t i = 0; i < pendingPipelines.size();) {
+		VkPipeline pipeline = pipelineRegistry->pipeline(pendingPipelines[i].second);
+		if (pipeline == VK_NULL_HANDLE) {
+			i++;
+			continue;
 		}
+		model->materials[pendingPipelines[i].first].pipeline = pipeline;
+		pendingPipelines[i] = pendingPipelines.back();
+		pendingPipelines.pop_back();
+		changed = true;
 	}
 
+	if (changed) {
+		model->invalidateDrawList();
+	}
+	if (pendingPipelines.empty()) {
+		reportPipelineBuild();
+	}
+}
 
+void VulkanApp::reportPipelineBuild() {
+	double wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pipelineBuildStart).count();
+	std::cout << "pipelines: " << pipelineRegistry->size() << " unique for " << pipelineRegistry->requestCount() << " material requests, compiled in "
+		<< wallMs << " ms wall / " << pipelineRegistry->creationMs() - pipelineBuildCreationMs << " ms summed on " << pipelineRegistry->threadCount()
+		<< " threads (" << (pipelineRegistry->usesLibraries() ? "linked from " + std::to_string(pipelineRegistry->libraryCount()) + " libraries" : std::string("monolithic"))
+		<< ", " << (pipeline_cache_loaded ? "warm" : "cold") << " pipeline cache)" << std::endl;
 }
 
 
@@ -397,44 +623,193 @@ void VulkanApp::buildCommandBuffers()
 	VkViewport viewport = vkbase::initializers::viewport((float)WIDTH, (float)HEIGHT, 0.0f, 1.0f);
 	VkRect2D scissor = vkbase::initializers::rect2D(WIDTH, HEIGHT, 0, 0);
 
-	for (int32_t i = 0; i < draw_cmd_buffers.size(); ++i) {
-		renderPassBeginInfo.framebuffer = framebuffers[i];
+	const int32_t progressHeight = 8;
+	int32_t progressWidth = modelLoad ? static_cast<int32_t>(WIDTH * modelLoad->progress) : 0;
 
-		vkBeginCommandBuffer(draw_cmd_buffers[i], &cmdBufferInfo);
-		
-		vkCmdBeginRenderPass(draw_cmd_buffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	VkClearAttachment progressClear = {};
+	progressClear.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	progressClear.colorAttachment = 0;
+	progressClear.clearValue.color = VkClearColorValue{ 0.45f, 0.55f, 0.60f, 1.0f };
+
+	VkClearRect progressRect = {};
+	progressRect.rect = vkbase::initializers::rect2D(progressWidth, progressHeight, 0, HEIGHT - progressHeight);
+	progressRect.baseArrayLayer = 0;
+	progressRect.layerCount = 1;
+
+#ifdef VKTINY_BENCHMARK
+	auto recordStart = std::chrono::high_resolution_clock::now();
+#endif
+
+	// Only the command buffers of the current frame in flight are recorded, into the acquired image's framebuffer
+	VkCommandBuffer cmdBuffer = draw_cmd_buffers[current_frame];
+	renderPassBeginInfo.framebuffer = framebuffers[current_buffer];
+
+	// The scene goes into the frame's secondary buffers, which are kept as long as they would be recorded the same way
+	// Moving instances only rewrites the instance buffer, the draw order, levels of detail and descriptor sets change the key
+	if (modelReady) {
+		uint64_t sceneKey = vkbase::hashCombine(model->prepareBind(current_frame), descriptorGeneration);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo = vkbase::initializers::commandBufferInheritanceInfo();
+		inheritanceInfo.renderPass = render_pass;
+		inheritanceInfo.subpass = 0;
+
+		// The uniform slice of a frame in flight never moves, so its offset is part of the recording
+		uint32_t uniformOffset = static_cast<uint32_t>(current_frame * uniform_slice_size);
+
+		// Ranges of the sorted draws are recorded on the recorder's threads, each buffer starts without any state
+		vkbase::RenderQueueStats sceneStats;
+		std::mutex sceneStatsMutex;
+		vkbase::CommandRecorder::RecordRange recordRange = [&](VkCommandBuffer commandBuffer, size_t first, size_t count) {
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &uniformOffset);
+			vkbase::RenderQueueStats stats = model->recordBind(commandBuffer, pipelineLayout, current_frame, first, count);
+			std::lock_guard<std::mutex> lock(sceneStatsMutex);
+			sceneStats += stats;
+		};
+
+#ifdef VKTINY_BENCHMARK
+		// Once every pipeline is in, the recording is measured for each thread count; it overwrites the frame's buffers
+		if (!recordingBenchmarked && pendingPipelines.empty()) {
+			benchmarkRecording(inheritanceInfo, recordRange);
+			recordingBenchmarked = true;
+			scene_recording_keys[current_frame] = 0;
+			sceneStats = {};
+		}
+#endif
+
+		if (sceneKey != scene_recording_keys[current_frame]) {
+			sceneRecorder->record(current_frame, inheritanceInfo, model->bindCount(), recordRange);
+			model->setRenderStats(sceneStats);
+			scene_recording_keys[current_frame] = sceneKey;
+#ifdef VKTINY_BENCHMARK
+			recordings += static_cast<uint32_t>(sceneRecorder->buffers(current_frame).size());
+			sceneRecordings++;
+			const std::vector<double>& rangeMs = sceneRecorder->rangeMs();
+			if (threadRecordMs.size() < rangeMs.size()) {
+				threadRecordMs.resize(rangeMs.size(), 0.0);
+			}
+			for (size_t i = 0; i < rangeMs.size(); i++) {
+				threadRecordMs[i] += rangeMs[i];
+			}
+#endif
+		}
+	}
+
+	vkBeginCommandBuffer(cmdBuffer, &cmdBufferInfo);
+	beginFrameTimer(cmdBuffer);
+
+	vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, modelReady ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-			vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+		if (modelReady) {
+			const std::vector<VkCommandBuffer>& sceneBuffers = sceneRecorder->buffers(current_frame);
+			vkCmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(sceneBuffers.size()), sceneBuffers.data());
+		}
+		else if (progressWidth > 0) {
+			// Placeholder while the model is loading, a progress bar along the bottom edge
+			vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+			vkCmdClearAttachments(cmdBuffer, 1, &progressClear, 1, &progressRect);
+		}
 
-			vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+		// Record Imgui Draw Data and draw funcs into command buffer
+		//renderUIDrawData(cmdBuffer);
+	vkCmdEndRenderPass(cmdBuffer);
+
+	endFrameTimer(cmdBuffer);
+	if (vkEndCommandBuffer(cmdBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to end command buffer!");
+	}
 
-			vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-			model->bind(draw_cmd_buffers[i], pipelineLayout);
+#ifdef VKTINY_BENCHMARK
+	// CPU cost of recording the frame's command buffers, averaged over a second
+	recordMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+	recordedFrames++;
+	recordings++;
+	float now = glfwGetTime();
+	if (modelReady && now - lastRecordReport >= 1.0f) {
+		printf("recording: %.3f ms per frame (%u frames in flight, %zu draw packets)\n", recordMs / recordedFrames, frames_in_flight, model->drawList().size());
+		printf("  %.2f command buffer recordings per frame, scene re-recorded in %u of %u frames\n", static_cast<double>(recordings) / recordedFrames, sceneRecordings, recordedFrames);
+		if (sceneRecordings > 0) {
+			printf("  scene recording per thread (%u threads):", sceneRecorder->threadCount());
+			for (double ms : threadRecordMs) {
+				printf(" %.3f", ms / sceneRecordings);
+			}
+			printf(" ms\n");
+		}
+		const vkbase::RenderQueueStats& stats = model->renderStats();
+		printf("  %u packets, %u draws, %u pipeline binds (%u avoided), %u descriptor set binds (%u avoided)\n", stats.packets, stats.draws,
+			stats.pipelineBinds, stats.pipelineBindsAvoided, stats.descriptorSetBinds, stats.descriptorSetBindsAvoided);
+		// CPU work overlapped the GPU by cpu + gpu - frame, blocked is the wait on frame fences and image acquisition
+		if (frame_telemetry.frames > 0) {
+			double frameMs = frame_telemetry.frameMs / frame_telemetry.frames;
+			double cpuMs = (frame_telemetry.frameMs - frame_telemetry.blockedMs) / frame_telemetry.frames;
+			printf("  frame %.3f ms, CPU %.3f ms busy / %.3f ms blocked", frameMs, cpuMs, frame_telemetry.blockedMs / frame_telemetry.frames);
+			if (frame_telemetry.gpuFrames > 0) {
+				double gpuMs = frame_telemetry.gpuMs / frame_telemetry.gpuFrames;
+				printf(", GPU %.3f ms, overlap %.3f ms", gpuMs, std::max(cpuMs + gpuMs - frameMs, 0.0));
+			}
+			printf("\n");
+		}
+		frame_telemetry = {};
+		recordMs = 0.0;
+		recordedFrames = 0;
+		recordings = 0;
+		sceneRecordings = 0;
+		threadRecordMs.clear();
+		lastRecordReport = now;
+	}
+#endif
+}
 
-			// Record Imgui Draw Data and draw funcs into command buffer
-			//renderUIDrawData(draw_cmd_buffers[i]);
-		vkCmdEndRenderPass(draw_cmd_buffers[i]);
 
-		if (vkEndCommandBuffer(draw_cmd_buffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to end command buffer!");
+#ifdef VKTINY_BENCHMARK
+void VulkanApp::benchmarkRecording(const VkCommandBufferInheritanceInfo& inheritanceInfo, const vkbase::CommandRecorder::RecordRange& recordRange) {
+
+	// Split as finely as the thread count allows, so every thread count is measured even for small scenes
+	size_t minItemsPerThread = sceneRecorder->minItemsPerThread;
+	sceneRecorder->minItemsPerThread = 1;
+
+	double singleThreadMs = 0.0;
+	std::cout << "recording benchmark: " << model->bindCount() << " draws" << std::endl;
+	for (uint32_t threads = 1; threads <= sceneRecorder->threadCount(); threads++) {
+		const int runs = 5;
+		double bestMs = 0.0;
+		double slowestThreadMs = 0.0;
+		for (int run = 0; run < runs; run++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			sceneRecorder->record(current_frame, inheritanceInfo, model->bindCount(), recordRange, threads);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			if (run == 0 || ms < bestMs) {
+				bestMs = ms;
+				const std::vector<double>& rangeMs = sceneRecorder->rangeMs();
+				slowestThreadMs = *std::max_element(rangeMs.begin(), rangeMs.end());
+			}
+		}
+		if (threads == 1) {
+			singleThreadMs = bestMs;
 		}
+		printf("  %2u thread(s): %8.3f ms (%.2fx), slowest thread %.3f ms\n", threads, bestMs, singleThreadMs / bestMs, slowestThreadMs);
 	}
+
+	sceneRecorder->minItemsPerThread = minItemsPerThread;
 }
+#endif
 
 
 void VulkanApp::prepare() {
 	VulkanRenderer::prepare();
 
+	sceneRecorder = std::make_unique<vkbase::CommandRecorder>(global_device->logicalDevice,
+		findQueueFamilies(global_device->physicalDevice, vulkan_surface->surface).graphicsFamily, frames_in_flight);
+
 	//initUI();
 
 	loadAssets();
 
-	createDescriptorPool();
+	// Descriptor pool, sets and pipelines depend on the model's materials and follow in renderLoop
 	createDescriptorSetLayout();
-	createDescriptorSets();
 	createPipelineLayout();
-
-	preparePipelines();
 	//prepareUI();
 	//renderUIFrame();
 
@@ -467,7 +842,7 @@ void VulkanApp::createDescriptorPool() {
 	std::vector<VkDescriptorPoolSize> poolSizes = {};
 	
 	VkDescriptorPoolSize poolSize;
-	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	poolSize.descriptorCount = vulkan_swapchain->swapchainImages.size();
 	poolSizes.push_back(poolSize);
 
@@ -488,12 +863,13 @@ void VulkanApp::createDescriptorPool() {
 
 
 void VulkanApp::draw() {
-	VulkanRenderer::prepareFrame();
-
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &draw_cmd_buffers[current_buffer];
+	if (!VulkanRenderer::prepareFrame()) {
+		return;
+	}
 
-	vkQueueSubmit(global_device->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	// The frame's fence was waited on, so its uniform slice and command buffer are free again
+	memcpy(static_cast<char*>(uniform_allocation_info.pMappedData) + current_frame * uniform_slice_size, &transform_matrices, sizeof(uboVS));
+	buildCommandBuffers();
 
 	VulkanRenderer::submitFrame();
 }
@@ -586,6 +962,10 @@ void VulkanApp::processInput(GLFWwindow* window) {
 		glfwSetWindowShouldClose(window, true);
 	}
 
+	if (glfwGetKey(window, GLFW_KEY_BACKSPACE) == GLFW_PRESS && modelLoad && !modelLoad->finished()) {
+		modelLoad->cancel();
+	}
+
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
 		global_camera->ProcessKeyboard(FORWARD, deltaTime);
 	}
@@ -1,8 +1,11 @@
 #include "../include/VulkanRenderer.h"
+#include "../include/PipelineCache.h"
+#include <algorithm>
 #include <array>
 
 
-const unsigned int MAX_FRAMES_IN_FLIGHT = 2;
+// Pipeline cache kept across runs, next to the working directory like the other runtime files
+const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
 
 //defined in VulkanGlobals.h
 vkbase::VulkanAllocator* global_allocator;
@@ -10,7 +13,9 @@ vkbase::VulkanAllocator* global_allocator;
 vkbase::VulkanDevice* global_device;
 
 
-VulkanRenderer::VulkanRenderer( ) { }
+VulkanRenderer::VulkanRenderer( ) {
+    frames_in_flight = std::min( std::max( VKTINY_FRAMES_IN_FLIGHT, 1 ), static_cast<int>(MAX_FRAMES_IN_FLIGHT) );
+}
 
 VulkanRenderer::~VulkanRenderer( ) {
     std::cout << "destroying vulkan renderer instance" << std::endl;
@@ -27,13 +32,6 @@ void VulkanRenderer::initVulkan( ) {
 	if (enableValidationLayers) {
 		setupDebugMessenger();
 	}
-
-	submitInfo = vkbase::initializers::submitInfo();
-	submitInfo.pWaitDstStageMask = &submitPipelineStages;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &semaphores.renderComplete;
 }
 
 
@@ -187,7 +185,7 @@ void VulkanRenderer::createCommandPool( ) {
 
 void VulkanRenderer::createCommandBuffers(  ) {
 
-	draw_cmd_buffers.resize( vulkan_swapchain->swapchainImages.size( ) );
+	draw_cmd_buffers.resize( frames_in_flight );
 
 	VkCommandBufferAllocateInfo allocInfo = vkbase::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(draw_cmd_buffers.size()));
 
@@ -195,6 +193,9 @@ void VulkanRenderer::createCommandBuffers(  ) {
         throw std::runtime_error( "failed to allocate command buffers" );
     }
 
+	// Scene recordings inherited the old render pass
+	scene_recording_keys.assign( frames_in_flight, 0 );
+
 }
 
 void VulkanRenderer::destoryCommandBuffers( ) {
@@ -204,36 +205,81 @@ void VulkanRenderer::destoryCommandBuffers( ) {
 
 void VulkanRenderer::createSyncObjects( ) {
 
-    in_flight_fences.resize( MAX_FRAMES_IN_FLIGHT );
+    in_flight_fences.resize( frames_in_flight );
+    semaphores.presentComplete.resize( frames_in_flight );
+    semaphores.renderComplete.resize( vulkan_swapchain->swapchainImages.size( ) );
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
+    // Signaled, so the first use of every frame in flight does not wait
     VkFenceCreateInfo fenceInfo = {};
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-
-        if ( vkCreateSemaphore(global_device->logicalDevice, &semaphoreInfo, nullptr, &semaphores.presentComplete ) != VK_SUCCESS ||
-             vkCreateSemaphore(global_device->logicalDevice, &semaphoreInfo, nullptr, &semaphores.renderComplete ) != VK_SUCCESS ) {
+    for ( uint32_t i = 0; i < frames_in_flight; i++ ) {
+        if ( vkCreateSemaphore(global_device->logicalDevice, &semaphoreInfo, nullptr, &semaphores.presentComplete.at( i ) ) != VK_SUCCESS ) {
             throw std::runtime_error( "failed to create semaphores" );
         }
-        for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+        if ( vkCreateFence(global_device->logicalDevice, &fenceInfo, nullptr, &in_flight_fences.at( i ) ) != VK_SUCCESS ) {
+            throw std::runtime_error( "failed to create fence" );
+        }
+    }
+    for ( size_t i = 0; i < semaphores.renderComplete.size( ); i++ ) {
+        if ( vkCreateSemaphore(global_device->logicalDevice, &semaphoreInfo, nullptr, &semaphores.renderComplete.at( i ) ) != VK_SUCCESS ) {
+            throw std::runtime_error( "failed to create semaphores" );
+        }
+    }
+
+    // GPU frame times for the telemetry, if the graphics queue supports timestamps
+    timestamps_written.assign( frames_in_flight, false );
+    if ( global_device->properties.limits.timestampComputeAndGraphics ) {
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = frames_in_flight * 2;
+        if ( vkCreateQueryPool(global_device->logicalDevice, &queryPoolInfo, nullptr, &timestamp_pool ) != VK_SUCCESS ) {
+            throw std::runtime_error( "failed to create timestamp query pool" );
+        }
+    }
+}
+
+void VulkanRenderer::destroySyncObjects( ) {
 
-            if(  vkCreateFence(global_device->logicalDevice, &fenceInfo, nullptr, &in_flight_fences.at(i) ) != VK_SUCCESS ) {
-                throw std::runtime_error( "failed to create fence" );
-            }
+    for ( VkSemaphore semaphore : semaphores.presentComplete ) {
+        vkDestroySemaphore(global_device->logicalDevice, semaphore, nullptr );
     }
+    for ( VkSemaphore semaphore : semaphores.renderComplete ) {
+        vkDestroySemaphore(global_device->logicalDevice, semaphore, nullptr );
+    }
+    for ( VkFence fence : in_flight_fences ) {
+        vkDestroyFence(global_device->logicalDevice, fence, nullptr );
+    }
+    semaphores.presentComplete.clear( );
+    semaphores.renderComplete.clear( );
+    in_flight_fences.clear( );
 
+    if ( timestamp_pool != VK_NULL_HANDLE ) {
+        vkDestroyQueryPool(global_device->logicalDevice, timestamp_pool, nullptr );
+        timestamp_pool = VK_NULL_HANDLE;
+    }
+    current_frame = 0;
 }
 
 void VulkanRenderer::createPipelineCache( ) {
+    // Seeded with the cache of the last run, data of another device or driver is dropped by the loader
+    std::vector<unsigned char> cacheData = vkbase::loadPipelineCacheData( PIPELINE_CACHE_FILE, global_device->properties );
+    pipeline_cache_loaded = !cacheData.empty( );
+
     VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
     pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = cacheData.size( );
+    pipelineCacheCreateInfo.pInitialData = cacheData.empty( ) ? nullptr : cacheData.data( );
 
     if ( vkCreatePipelineCache(global_device->logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipeline_cache ) != VK_SUCCESS ) {
         throw std::runtime_error( "failed to create pipeline cache" );
     }
+    std::cout << "pipeline cache: " << cacheData.size( ) << " bytes from the last run" << std::endl;
 }
 
 void VulkanRenderer::recreateSwapchain( ) {
@@ -258,7 +304,6 @@ void VulkanRenderer::recreateSwapchain( ) {
 	createSyncObjects();
 	createDepthStencil();
 	createRenderpass();
-	createPipelineCache();
 	createImageViews();
 	createFramebuffers();
 }
@@ -271,6 +316,8 @@ void VulkanRenderer::cleanupSwapchain( ) {
 
     vkFreeCommandBuffers(global_device->logicalDevice, commandPool, static_cast< uint32_t >(draw_cmd_buffers.size( )), draw_cmd_buffers.data( ) );
 
+    destroySyncObjects( );
+
     vkDestroyRenderPass(global_device->logicalDevice, render_pass, nullptr );
 
     vkDestroyImageView(global_device->logicalDevice, depth_image_view, nullptr );
@@ -282,25 +329,87 @@ void VulkanRenderer::cleanupSwapchain( ) {
     delete vulkan_swapchain;
 }
 
-void VulkanRenderer::prepareFrame( ) {
+bool VulkanRenderer::prepareFrame( ) {
+
+    auto frameStart = std::chrono::high_resolution_clock::now( );
+    if ( last_frame_start.time_since_epoch( ).count( ) != 0 ) {
+        frame_telemetry.frameMs += std::chrono::duration<double, std::milli>(frameStart - last_frame_start).count( );
+        frame_telemetry.frames++;
+    }
+    last_frame_start = frameStart;
+
+    // The command buffer, uniform slice and timestamps of this frame in flight are reused only after the GPU is done with them
+    vkWaitForFences(global_device->logicalDevice, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX );
+
+    if ( timestamps_written[current_frame] ) {
+        uint64_t timestamps[2];
+        if ( vkGetQueryPoolResults(global_device->logicalDevice, timestamp_pool, current_frame * 2, 2, sizeof(timestamps ), timestamps, sizeof(uint64_t ), VK_QUERY_RESULT_64_BIT ) == VK_SUCCESS ) {
+            frame_telemetry.gpuMs += static_cast<double>(timestamps[1] - timestamps[0]) * global_device->properties.limits.timestampPeriod / 1000000.0;
+            frame_telemetry.gpuFrames++;
+        }
+        timestamps_written[current_frame] = false;
+    }
+
+    VkResult result = vulkan_swapchain->acquireNextImage( semaphores.presentComplete[current_frame], &current_buffer );
+    frame_telemetry.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now( ) - frameStart).count( );
 
-    VkResult result = vulkan_swapchain->acquireNextImage( semaphores.presentComplete, &current_buffer );
     if ( result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized ) {
         framebuffer_resized = false;
         recreateSwapchain( );
 		prepare();
 
-        return;
+        return false;
     } else if ( result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR ) {
         throw std::runtime_error( "failed to acquire swap chain image" );
     }
 
+    // Only reset once work is sure to be submitted with it, a skipped frame would otherwise wait forever
+    vkResetFences(global_device->logicalDevice, 1, &in_flight_fences[current_frame] );
+    return true;
 }
 
 void VulkanRenderer::submitFrame( ) {
 
-    VkResult res = vulkan_swapchain->queuePresent(global_device->presentQueue, current_buffer, semaphores.renderComplete );
-    vkQueueWaitIdle(global_device->presentQueue );
+    VkSubmitInfo submitInfo = vkbase::initializers::submitInfo( );
+    submitInfo.pWaitDstStageMask = &submitPipelineStages;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &semaphores.presentComplete[current_frame];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &semaphores.renderComplete[current_buffer];
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &draw_cmd_buffers[current_frame];
+
+    if ( vkQueueSubmit(global_device->graphicsQueue, 1, &submitInfo, in_flight_fences[current_frame] ) != VK_SUCCESS ) {
+        throw std::runtime_error( "failed to submit draw command buffer" );
+    }
+
+    // No wait for the queue, the next frame is recorded while the GPU works on this one
+    VkResult result = vulkan_swapchain->queuePresent(global_device->presentQueue, current_buffer, semaphores.renderComplete[current_buffer] );
+    if ( result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ) {
+        framebuffer_resized = true;
+    }
+
+    current_frame = (current_frame + 1) % frames_in_flight;
+}
+
+void VulkanRenderer::waitForFrames( ) {
+    if ( !in_flight_fences.empty( ) ) {
+        vkWaitForFences(global_device->logicalDevice, static_cast<uint32_t>(in_flight_fences.size( )), in_flight_fences.data( ), VK_TRUE, UINT64_MAX );
+    }
+}
+
+void VulkanRenderer::beginFrameTimer( VkCommandBuffer commandBuffer ) {
+    if ( timestamp_pool != VK_NULL_HANDLE ) {
+        vkCmdResetQueryPool( commandBuffer, timestamp_pool, current_frame * 2, 2 );
+        vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool, current_frame * 2 );
+    }
+}
+
+void VulkanRenderer::endFrameTimer( VkCommandBuffer commandBuffer ) {
+    if ( timestamp_pool != VK_NULL_HANDLE ) {
+        vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool, current_frame * 2 + 1 );
+        timestamps_written[current_frame] = true;
+    }
 }
 
 
@@ -408,16 +517,14 @@ void VulkanRenderer::cleanup( ) {
 
     cleanupSwapchain( );
 
+    if ( !vkbase::savePipelineCache( PIPELINE_CACHE_FILE, global_device->logicalDevice, pipeline_cache, global_device->properties ) ) {
+        std::cerr << "failed to write pipeline cache " << PIPELINE_CACHE_FILE << std::endl;
+    }
     vkDestroyPipelineCache(global_device->logicalDevice, pipeline_cache, nullptr );
 
-    vkDestroySemaphore(global_device->logicalDevice, semaphores.renderComplete, nullptr );
-    vkDestroySemaphore(global_device->logicalDevice, semaphores.presentComplete, nullptr );
 
 	vkDestroyCommandPool(global_device->logicalDevice, commandPool, nullptr);
 
-    for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i ) {
-       vkDestroyFence(global_device->logicalDevice, in_flight_fences.at( i ), nullptr );
-    }
 
 	delete global_allocator;
 
@@ -5,9 +5,12 @@
 #if defined(__ANDROID__)
 int android_main(android_app* app_state){
 #else
-int main( ) {
+int main( int argc, char** argv ) {
 #endif
     VulkanApp* vulkan_app = new VulkanApp( );
+#if !defined(__ANDROID__)
+    vulkan_app->parseArguments( argc, argv );
+#endif
     try {
 		vulkan_app->prepare();
     } catch ( const std::exception& e ) {
@@ -0,0 +1,230 @@
+#include "Tests.h"
+#include "../include/AccessorDecoder.h"
+#include "../include/MeshoptDecoder.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+
+namespace {
+
+	using namespace vkbase;
+
+	const int BYTE = 5120;
+	const int UNSIGNED_BYTE = 5121;
+	const int SHORT = 5122;
+	const int UNSIGNED_SHORT = 5123;
+	const int FLOAT = 5126;
+
+	unsigned char zigzag8(unsigned char delta) {
+		return static_cast<unsigned char>(((delta & 0x80) ? 0xff : 0) ^ (delta << 1));
+	}
+
+	// Encodes vertices for decodeVertexBuffer with uncompressed byte groups and a zero baseline in the tail
+	std::vector<unsigned char> encodeVertices(const std::vector<unsigned char>& vertices, size_t vertexSize) {
+		const size_t vertexCount = vertices.size() / vertexSize;
+		size_t blockSize = (8192 / vertexSize) & ~size_t(15);
+		blockSize = blockSize < 256 ? blockSize : 256;
+
+		std::vector<unsigned char> data = { 0xa0 };
+		std::vector<unsigned char> last(vertexSize, 0);
+		for (size_t first = 0; first < vertexCount; first += blockSize) {
+			size_t count = first + blockSize < vertexCount ? blockSize : vertexCount - first;
+			size_t groupCount = (count + 15) / 16;
+			for (size_t k = 0; k < vertexSize; k++) {
+				// every group stored as 16 raw bytes (bitsLog2 3)
+				data.insert(data.end(), (groupCount + 3) / 4, 0xff);
+				unsigned char previous = last[k];
+				for (size_t i = 0; i < groupCount * 16; i++) {
+					unsigned char value = i < count ? vertices[(first + i) * vertexSize + k] : previous;
+					data.push_back(zigzag8(static_cast<unsigned char>(value - previous)));
+					previous = value;
+				}
+				last[k] = vertices[(first + count - 1) * vertexSize + k];
+			}
+		}
+		data.insert(data.end(), vertexSize < 32 ? 32 : vertexSize, 0);
+		return data;
+	}
+
+	void encodeVByte(std::vector<unsigned char>& data, uint32_t value) {
+		while (value >= 128) {
+			data.push_back(static_cast<unsigned char>((value & 127) | 128));
+			value >>= 7;
+		}
+		data.push_back(static_cast<unsigned char>(value));
+	}
+
+	// Encodes indices for decodeIndexSequence, every delta relative to the previous index (baseline 0)
+	std::vector<unsigned char> encodeIndexSequence(const std::vector<uint32_t>& indices) {
+		std::vector<unsigned char> data = { 0xd1 };
+		uint32_t last = 0;
+		for (uint32_t index : indices) {
+			int32_t delta = static_cast<int32_t>(index - last);
+			uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+			encodeVByte(data, zigzag << 1);
+			last = index;
+		}
+		data.insert(data.end(), 4, 0);
+		return data;
+	}
+
+}
+
+
+TEST_CASE(MeshoptDecoder, VertexBufferRoundTrip) {
+	// More vertices than one block holds, with irregular byte patterns
+	const size_t vertexSize = 12;
+	std::vector<unsigned char> vertices(1000 * vertexSize);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		vertices[i] = static_cast<unsigned char>((i * 7919) ^ (i >> 3));
+	}
+	std::vector<unsigned char> data = encodeVertices(vertices, vertexSize);
+
+	std::vector<unsigned char> decoded(vertices.size());
+	CHECK(meshopt::decodeVertexBuffer(decoded.data(), 1000, vertexSize, data.data(), data.size()));
+	CHECK(decoded == vertices);
+
+	meshopt::CompressedView view = { data.data(), data.size(), 1000, vertexSize, meshopt::CompressionMode::Attributes, meshopt::CompressionFilter::None };
+	std::vector<unsigned char> viaView(vertices.size());
+	CHECK(meshopt::decodeView(view, viaView.data()));
+	CHECK(viaView == vertices);
+}
+
+TEST_CASE(MeshoptDecoder, MalformedVertexDataIsRejected) {
+	std::vector<unsigned char> vertices(64 * 8, 3);
+	std::vector<unsigned char> data = encodeVertices(vertices, 8);
+	std::vector<unsigned char> decoded(vertices.size());
+
+	CHECK(!meshopt::decodeVertexBuffer(decoded.data(), 64, 8, data.data(), data.size() - 1));
+	CHECK(!meshopt::decodeVertexBuffer(decoded.data(), 64, 8, data.data(), 40));
+	// Vertex sizes have to be a multiple of 4
+	CHECK(!meshopt::decodeVertexBuffer(decoded.data(), 64, 6, data.data(), data.size()));
+	data[0] = 0x00;
+	CHECK(!meshopt::decodeVertexBuffer(decoded.data(), 64, 8, data.data(), data.size()));
+}
+
+TEST_CASE(MeshoptDecoder, IndexSequenceRoundTrip) {
+	std::vector<uint32_t> indices = { 0, 1, 2, 100000, 5, 5, 70000, 3, 0 };
+	std::vector<unsigned char> data = encodeIndexSequence(indices);
+
+	std::vector<uint32_t> decoded(indices.size());
+	CHECK(meshopt::decodeIndexSequence(decoded.data(), decoded.size(), 4, data.data(), data.size()));
+	CHECK(decoded == indices);
+
+	std::vector<uint16_t> decoded16(3);
+	std::vector<unsigned char> small = encodeIndexSequence({ 7, 3, 65535 });
+	CHECK(meshopt::decodeIndexSequence(decoded16.data(), 3, 2, small.data(), small.size()));
+	CHECK(decoded16[0] == 7 && decoded16[1] == 3 && decoded16[2] == 65535);
+
+	// Truncated streams end before the tail
+	CHECK(!meshopt::decodeIndexSequence(decoded.data(), decoded.size(), 4, data.data(), data.size() - 1));
+	CHECK(!meshopt::decodeIndexSequence(decoded.data(), decoded.size(), 3, data.data(), data.size()));
+}
+
+TEST_CASE(MeshoptDecoder, IndexBufferDecodesNewVerticesAndEdges) {
+	// 0xfe with an explicit zero auxiliary code restarts at (0, 1, 2), code 0x00 reuses the last edge (0, 2) with the next vertex
+	std::vector<unsigned char> data = { 0xe1, 0xfe, 0x00, 0x00 };
+	data.insert(data.end(), 16, 0);
+
+	uint32_t decoded[6] = {};
+	CHECK(meshopt::decodeIndexBuffer(decoded, 6, 4, data.data(), data.size()));
+	const uint32_t expected[6] = { 0, 1, 2, 0, 2, 3 };
+	CHECK(memcmp(decoded, expected, sizeof(expected)) == 0);
+
+	// Leftover bytes before the code table, an unknown version and a partial triangle are errors
+	std::vector<unsigned char> padded = data;
+	padded.insert(padded.begin() + 4, 0);
+	CHECK(!meshopt::decodeIndexBuffer(decoded, 6, 4, padded.data(), padded.size()));
+	data[0] = 0xe2;
+	CHECK(!meshopt::decodeIndexBuffer(decoded, 6, 4, data.data(), data.size()));
+	data[0] = 0xe1;
+	CHECK(!meshopt::decodeIndexBuffer(decoded, 5, 4, data.data(), data.size()));
+}
+
+TEST_CASE(MeshoptDecoder, Filters) {
+	// Octahedral +z stays +z at full scale, the fourth component is kept
+	int8_t normals[8] = { 0, 0, 127, 42, 64, 0, 63, 0 };
+	CHECK(meshopt::decodeFilter(normals, 2, 4, meshopt::CompressionFilter::Octahedral));
+	CHECK(normals[0] == 0 && normals[1] == 0 && normals[2] == 127 && normals[3] == 42);
+	float length = std::sqrt(float(normals[4] * normals[4] + normals[5] * normals[5] + normals[6] * normals[6]));
+	CHECK(std::fabs(length - 127.0f) < 1.5f);
+
+	// Exponential: mantissa 3, exponent -1
+	uint32_t value = (uint32_t(-1) << 24) | 3;
+	CHECK(meshopt::decodeFilter(&value, 1, 4, meshopt::CompressionFilter::Exponential));
+	float decoded;
+	memcpy(&decoded, &value, sizeof(decoded));
+	CHECK(decoded == 1.5f);
+
+	CHECK(!meshopt::decodeFilter(normals, 1, 6, meshopt::CompressionFilter::Octahedral));
+	CHECK(!meshopt::decodeFilter(normals, 1, 4, meshopt::CompressionFilter::Quaternion));
+}
+
+TEST_CASE(AccessorDecoder, EveryIsaMatchesTheExpectedValues) {
+	// Odd counts and a stride larger than the element exercise the kernels' remainders
+	const size_t count = 37;
+	const size_t stride = 8;
+	std::vector<unsigned char> bytes(count * stride);
+	for (size_t i = 0; i < bytes.size(); i++) {
+		bytes[i] = static_cast<unsigned char>(i * 13 + 5);
+	}
+
+	struct Format {
+		int componentType;
+		bool normalized;
+	};
+	const Format formats[] = { { UNSIGNED_BYTE, true }, { BYTE, true }, { UNSIGNED_SHORT, true }, { SHORT, true }, { UNSIGNED_BYTE, false }, { SHORT, false } };
+	for (const Format& format : formats) {
+		for (uint32_t components = 1; components <= 4; components++) {
+			AccessorSource source = { bytes.data(), count, stride, format.componentType, components, format.normalized };
+			std::vector<float> expected(count * 4, -100.0f);
+			for (size_t i = 0; i < count; i++) {
+				for (uint32_t c = 0; c < components; c++) {
+					const unsigned char* element = bytes.data() + i * stride;
+					float value = 0.0f;
+					switch (format.componentType) {
+					case UNSIGNED_BYTE: value = format.normalized ? element[c] / 255.0f : element[c]; break;
+					case BYTE: value = std::fmax(int8_t(element[c]) / 127.0f, -1.0f); break;
+					case UNSIGNED_SHORT: { uint16_t v; memcpy(&v, element + c * 2, 2); value = v / 65535.0f; break; }
+					case SHORT: { int16_t v; memcpy(&v, element + c * 2, 2); value = format.normalized ? std::fmax(v / 32767.0f, -1.0f) : v; break; }
+					}
+					expected[i * 4 + c] = value;
+				}
+			}
+
+			for (uint32_t isa = 0; isa <= static_cast<uint32_t>(bestDecodeIsa()); isa++) {
+				// Components past componentCount must not be touched
+				std::vector<float> decoded(count * 4, -100.0f);
+				CHECK(decodeAccessor(source, decoded.data(), 4 * sizeof(float), static_cast<DecodeIsa>(isa)));
+				for (size_t i = 0; i < decoded.size(); i++) {
+					CHECK(std::fabs(decoded[i] - expected[i]) <= 1e-6f);
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE(AccessorDecoder, FloatsAndHalfsConvert) {
+	const float values[5] = { 0.0f, 1.0f, -2.5f, 65504.0f, 0.333251953125f };
+	const uint16_t halfs[5] = { 0x0000, 0x3c00, 0xc100, 0x7bff, 0x3555 };
+
+	for (uint32_t isa = 0; isa <= static_cast<uint32_t>(bestDecodeIsa()); isa++) {
+		float decoded[5] = {};
+		AccessorSource floats = { reinterpret_cast<const unsigned char*>(values), 5, sizeof(float), FLOAT, 1, false };
+		CHECK(decodeAccessor(floats, decoded, sizeof(float), static_cast<DecodeIsa>(isa)));
+		CHECK(memcmp(decoded, values, sizeof(values)) == 0);
+
+		memset(decoded, 0, sizeof(decoded));
+		AccessorSource half = { reinterpret_cast<const unsigned char*>(halfs), 5, sizeof(uint16_t), COMPONENT_TYPE_HALF_FLOAT, 1, false };
+		CHECK(decodeAccessor(half, decoded, sizeof(float), static_cast<DecodeIsa>(isa)));
+		CHECK(memcmp(decoded, values, sizeof(values)) == 0);
+	}
+
+	// 32 bit integers are not supported
+	float unused[1];
+	uint32_t integer = 1;
+	AccessorSource unsupported = { reinterpret_cast<const unsigned char*>(&integer), 1, 4, 5125, 1, false };
+	CHECK(!decodeAccessor(unsupported, unused, sizeof(float)));
+}
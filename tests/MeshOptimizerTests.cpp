@@ -0,0 +1,311 @@
+#include "Tests.h"
+#include "../include/MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+
+namespace {
+
+	using namespace vkbase;
+
+	struct TestMesh {
+		std::vector<float> positions;
+		std::vector<uint32_t> indices;
+
+		size_t vertexCount() const {
+			return positions.size() / 3;
+		}
+
+		const float* position(uint32_t index) const {
+			return &positions[index * 3];
+		}
+	};
+
+	void normal(const float* a, const float* b, const float* c, float* n) {
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	float dot(const float* a, const float* b) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	// Unit sphere with outward facing triangles (counter clockwise seen from outside), the poles' degenerate triangles are left out
+	TestMesh sphere(uint32_t rings, uint32_t segments) {
+		TestMesh mesh;
+		const float pi = 3.14159265358979f;
+		for (uint32_t i = 0; i <= rings; i++) {
+			float theta = pi * i / rings;
+			for (uint32_t j = 0; j <= segments; j++) {
+				float phi = 2.0f * pi * j / segments;
+				mesh.positions.push_back(std::sin(theta) * std::cos(phi));
+				mesh.positions.push_back(std::cos(theta));
+				mesh.positions.push_back(std::sin(theta) * std::sin(phi));
+			}
+		}
+		auto add = [&](uint32_t a, uint32_t b, uint32_t c) {
+			float n[3];
+			normal(mesh.position(a), mesh.position(b), mesh.position(c), n);
+			if (dot(n, n) < 1e-12f) {
+				return;
+			}
+			float centroid[3];
+			for (int k = 0; k < 3; k++) {
+				centroid[k] = mesh.position(a)[k] + mesh.position(b)[k] + mesh.position(c)[k];
+			}
+			if (dot(n, centroid) < 0.0f) {
+				std::swap(b, c);
+			}
+			mesh.indices.insert(mesh.indices.end(), { a, b, c });
+		};
+		for (uint32_t i = 0; i < rings; i++) {
+			for (uint32_t j = 0; j < segments; j++) {
+				uint32_t a = i * (segments + 1) + j;
+				uint32_t b = (i + 1) * (segments + 1) + j;
+				add(a, b, b + 1);
+				add(a, b + 1, a + 1);
+			}
+		}
+		return mesh;
+	}
+
+	// Unit square in the xy plane split into size * size quads, facing +z
+	TestMesh grid(uint32_t size) {
+		TestMesh mesh;
+		for (uint32_t y = 0; y <= size; y++) {
+			for (uint32_t x = 0; x <= size; x++) {
+				mesh.positions.insert(mesh.positions.end(), { float(x) / size, float(y) / size, 0.0f });
+			}
+		}
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				uint32_t a = y * (size + 1) + x;
+				uint32_t b = a + size + 1;
+				mesh.indices.insert(mesh.indices.end(), { a, a + 1, b + 1, a, b + 1, b });
+			}
+		}
+		return mesh;
+	}
+
+	// Triangles rotated so their smallest index comes first, which keeps the winding
+	std::multiset<std::array<uint32_t, 3>> triangleSet(const std::vector<uint32_t>& indices) {
+		std::multiset<std::array<uint32_t, 3>> triangles;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			std::array<uint32_t, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+			std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+			triangles.insert(t);
+		}
+		return triangles;
+	}
+
+	void shuffleTriangles(std::vector<uint32_t>& indices, uint32_t seed) {
+		std::mt19937 random(seed);
+		for (size_t i = indices.size() / 3; i > 1; i--) {
+			size_t j = random() % i;
+			std::swap_ranges(indices.begin() + (i - 1) * 3, indices.begin() + i * 3, indices.begin() + j * 3);
+		}
+	}
+
+}
+
+
+TEST_CASE(MeshOptimizer, MeshletsRespectLimitsAndCoverIndices) {
+	TestMesh mesh = sphere(24, 48);
+	meshopt::optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+	std::vector<meshopt::Meshlet> meshlets = meshopt::buildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount());
+
+	CHECK(meshlets.size() > 1);
+	uint32_t nextIndex = 0;
+	for (const meshopt::Meshlet& meshlet : meshlets) {
+		CHECK(meshlet.firstIndex == nextIndex);
+		CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+		CHECK(meshlet.indexCount / 3 <= meshopt::MESHLET_MAX_TRIANGLES);
+		std::set<uint32_t> vertices(mesh.indices.begin() + meshlet.firstIndex, mesh.indices.begin() + meshlet.firstIndex + meshlet.indexCount);
+		CHECK(vertices.size() == meshlet.vertexCount);
+		CHECK(meshlet.vertexCount <= meshopt::MESHLET_MAX_VERTICES);
+		nextIndex = meshlet.firstIndex + meshlet.indexCount;
+	}
+	CHECK(nextIndex == mesh.indices.size());
+
+	// Smaller limits split the same triangles into more meshlets
+	std::vector<meshopt::Meshlet> small = meshopt::buildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount(), 16, 8);
+	CHECK(small.size() > meshlets.size());
+	for (const meshopt::Meshlet& meshlet : small) {
+		CHECK(meshlet.vertexCount <= 16 && meshlet.indexCount / 3 <= 8);
+	}
+}
+
+TEST_CASE(MeshOptimizer, MeshletSpheresContainTheirTriangles) {
+	TestMesh mesh = sphere(16, 32);
+	std::vector<meshopt::Meshlet> meshlets = meshopt::buildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount());
+	for (const meshopt::Meshlet& meshlet : meshlets) {
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+			const float* p = mesh.position(mesh.indices[i]);
+			float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+			CHECK(std::sqrt(dot(d, d)) <= meshlet.radius * 1.0001f + 1e-5f);
+		}
+	}
+}
+
+TEST_CASE(MeshOptimizer, MeshletConeNeverRejectsVisibleTriangles) {
+	TestMesh mesh = sphere(16, 32);
+	meshopt::optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+	std::vector<meshopt::Meshlet> meshlets = meshopt::buildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount());
+
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	uint32_t culled = 0;
+	for (int camera = 0; camera < 200; camera++) {
+		// Cameras close to the surface and far away from it
+		float direction[3] = { coordinate(random), coordinate(random), coordinate(random) };
+		float length = std::sqrt(dot(direction, direction));
+		float distance = camera % 2 == 0 ? 1.1f : 10.0f;
+		float position[3] = { direction[0] / length * distance, direction[1] / length * distance, direction[2] / length * distance };
+
+		for (const meshopt::Meshlet& meshlet : meshlets) {
+			if (!meshopt::meshletBackfacing(meshlet, position)) {
+				continue;
+			}
+			culled++;
+			for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+				const float* a = mesh.position(mesh.indices[i]);
+				float n[3];
+				normal(a, mesh.position(mesh.indices[i + 1]), mesh.position(mesh.indices[i + 2]), n);
+				float toCamera[3] = { position[0] - a[0], position[1] - a[1], position[2] - a[2] };
+				CHECK(dot(n, toCamera) / std::sqrt(dot(n, n)) <= 1e-4f);
+			}
+		}
+	}
+	// The cone has to reject something, otherwise the check above proves nothing
+	CHECK(culled > 0);
+}
+
+TEST_CASE(MeshOptimizer, MeshletFrustumTestIsConservative) {
+	TestMesh mesh = sphere(16, 32);
+	std::vector<meshopt::Meshlet> meshlets = meshopt::buildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount());
+
+	uint32_t outside = 0;
+	for (float offset = -0.9f; offset < 1.0f; offset += 0.3f) {
+		// Keeps x >= offset
+		const float planes[1][4] = { { 1.0f, 0.0f, 0.0f, -offset } };
+		for (const meshopt::Meshlet& meshlet : meshlets) {
+			if (!meshopt::meshletOutsideFrustum(meshlet, planes, 1)) {
+				continue;
+			}
+			outside++;
+			for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+				CHECK(mesh.position(mesh.indices[i])[0] < offset + 1e-5f);
+			}
+		}
+	}
+	CHECK(outside > 0);
+}
+
+TEST_CASE(MeshOptimizer, VertexCacheOptimizationKeepsTriangles) {
+	TestMesh mesh = grid(32);
+	shuffleTriangles(mesh.indices, 1);
+	std::multiset<std::array<uint32_t, 3>> before = triangleSet(mesh.indices);
+	meshopt::VertexCacheStats shuffled = meshopt::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+
+	meshopt::optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+	meshopt::VertexCacheStats optimized = meshopt::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+	CHECK(triangleSet(mesh.indices) == before);
+	CHECK(optimized.acmr < shuffled.acmr);
+	CHECK(optimized.acmr < 1.0f);
+	CHECK(optimized.atvr >= 1.0f);
+
+	meshopt::optimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount());
+	CHECK(triangleSet(mesh.indices) == before);
+}
+
+TEST_CASE(MeshOptimizer, SimplifyKeepsBordersAndWinding) {
+	TestMesh mesh = grid(20);
+	std::vector<uint32_t> simplified(mesh.indices.size());
+	float error = -1.0f;
+	size_t count = meshopt::simplify(simplified.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount(),
+		mesh.indices.size() / 10, 0.01f, &error);
+	simplified.resize(count);
+
+	CHECK(count % 3 == 0);
+	CHECK(count < mesh.indices.size() / 2);
+	CHECK(error >= 0.0f && error <= 0.01f);
+
+	// A flat square with fixed borders keeps its area, and no triangle may flip
+	float area = 0.0f;
+	for (size_t i = 0; i < simplified.size(); i += 3) {
+		CHECK(simplified[i] < mesh.vertexCount() && simplified[i + 1] < mesh.vertexCount() && simplified[i + 2] < mesh.vertexCount());
+		float n[3];
+		normal(mesh.position(simplified[i]), mesh.position(simplified[i + 1]), mesh.position(simplified[i + 2]), n);
+		CHECK(n[2] >= 0.0f);
+		area += n[2] * 0.5f;
+	}
+	CHECK(std::fabs(area - 1.0f) < 1e-3f);
+
+	// Nothing to do without any error budget beyond coplanar collapses
+	size_t exact = meshopt::simplify(simplified.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), mesh.vertexCount(),
+		mesh.indices.size(), 0.0f);
+	CHECK(exact == mesh.indices.size());
+}
+
+TEST_CASE(MeshOptimizer, VertexFetchOrderFollowsFirstUse) {
+	struct Vertex {
+		float position[3];
+		uint32_t id;
+	};
+	TestMesh mesh = grid(8);
+	shuffleTriangles(mesh.indices, 2);
+	std::vector<Vertex> vertices(mesh.vertexCount() + 1);
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		memcpy(vertices[i].position, mesh.position(std::min<uint32_t>(i, uint32_t(mesh.vertexCount() - 1))), sizeof(vertices[i].position));
+		vertices[i].id = i;
+	}
+	// The last vertex is unreferenced
+	const uint32_t unused = uint32_t(vertices.size() - 1);
+	std::vector<uint32_t> originalIds(mesh.indices.begin(), mesh.indices.end());
+	std::vector<uint32_t> indices = mesh.indices;
+
+	meshopt::optimizeVertexFetch(vertices.data(), sizeof(Vertex), indices.data(), indices.size(), vertices.size());
+
+	uint32_t nextNew = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		CHECK(vertices[indices[i]].id == originalIds[i]);
+		CHECK(indices[i] <= nextNew);
+		nextNew = std::max(nextNew, indices[i] + 1);
+	}
+	CHECK(vertices.back().id == unused);
+}
+
+TEST_CASE(MeshOptimizer, TangentsFollowTheUvGradient) {
+	// position xyz, normal xyz, uv, tangent xyzw
+	struct Vertex {
+		float position[3];
+		float normal[3];
+		float uv[2];
+		float tangent[4];
+	};
+	std::vector<Vertex> vertices(4);
+	const float corners[4][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+	for (size_t i = 0; i < 4; i++) {
+		vertices[i] = { { corners[i][0], corners[i][1], 0.0f }, { 0.0f, 0.0f, 1.0f }, { corners[i][0], corners[i][1] }, {} };
+	}
+	std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+
+	meshopt::generateTangents(indices.data(), indices.size(), vertices[0].position, vertices[0].normal, vertices[0].uv, sizeof(Vertex), vertices.size(),
+		vertices[0].tangent);
+
+	for (const Vertex& vertex : vertices) {
+		CHECK(std::fabs(vertex.tangent[0] - 1.0f) < 1e-4f);
+		CHECK(std::fabs(vertex.tangent[1]) < 1e-4f && std::fabs(vertex.tangent[2]) < 1e-4f);
+		// bitangent = cross(normal, tangent) * w = +y, the direction v grows in
+		CHECK(vertex.tangent[3] == 1.0f);
+	}
+}
@@ -0,0 +1,188 @@
+#include "Tests.h"
+#include "../include/PipelineRegistry.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+	using namespace vkbase;
+
+	// Handles are only compared by the key, they never reach the driver
+	template<typename Handle>
+	Handle fakeHandle(uintptr_t value) {
+		Handle handle = VK_NULL_HANDLE;
+		memcpy(&handle, &value, std::min(sizeof(handle), sizeof(value)));
+		return handle;
+	}
+
+	// A complete create info whose state lives in the object, so two instances only differ in their pointers
+	struct PipelineState {
+		std::string vertexEntry = "main";
+		std::string fragmentEntry = "main";
+		uint32_t specializationValue = 1;
+		VkSpecializationMapEntry mapEntry = { 0, 0, sizeof(uint32_t) };
+		VkSpecializationInfo specialization = {};
+		VkPipelineShaderStageCreateInfo stages[2] = {};
+		VkVertexInputBindingDescription binding = { 0, 32, VK_VERTEX_INPUT_RATE_VERTEX };
+		VkVertexInputAttributeDescription attribute = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+		VkPipelineVertexInputStateCreateInfo vertexInput = {};
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+		VkViewport viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, { 1280, 720 } };
+		VkPipelineViewportStateCreateInfo viewportState = {};
+		VkPipelineRasterizationStateCreateInfo rasterization = {};
+		VkPipelineMultisampleStateCreateInfo multisample = {};
+		VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+		VkPipelineColorBlendAttachmentState blendAttachment = {};
+		VkPipelineColorBlendStateCreateInfo colorBlend = {};
+		std::vector<VkDynamicState> dynamicStates;
+		VkPipelineDynamicStateCreateInfo dynamicState = {};
+		VkGraphicsPipelineCreateInfo info = {};
+
+		PipelineState() {
+			specialization.mapEntryCount = 1;
+			specialization.pMapEntries = &mapEntry;
+			specialization.dataSize = sizeof(specializationValue);
+			specialization.pData = &specializationValue;
+
+			stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+			stages[0].module = fakeHandle<VkShaderModule>(1);
+			stages[1] = stages[0];
+			stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			stages[1].module = fakeHandle<VkShaderModule>(2);
+			stages[1].pSpecializationInfo = &specialization;
+
+			vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			vertexInput.vertexBindingDescriptionCount = 1;
+			vertexInput.pVertexBindingDescriptions = &binding;
+			vertexInput.vertexAttributeDescriptionCount = 1;
+			vertexInput.pVertexAttributeDescriptions = &attribute;
+			inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+			inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+			viewportState.viewportCount = 1;
+			viewportState.pViewports = &viewport;
+			viewportState.scissorCount = 1;
+			viewportState.pScissors = &scissor;
+			rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+			rasterization.cullMode = VK_CULL_MODE_BACK_BIT;
+			rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+			rasterization.lineWidth = 1.0f;
+			multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+			multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+			depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+			depthStencil.depthTestEnable = VK_TRUE;
+			depthStencil.depthWriteEnable = VK_TRUE;
+			depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			blendAttachment.colorWriteMask = 0xf;
+			colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+			colorBlend.attachmentCount = 1;
+			colorBlend.pAttachments = &blendAttachment;
+			dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+
+			info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			info.stageCount = 2;
+			info.pStages = stages;
+			info.pVertexInputState = &vertexInput;
+			info.pInputAssemblyState = &inputAssembly;
+			info.pViewportState = &viewportState;
+			info.pRasterizationState = &rasterization;
+			info.pMultisampleState = &multisample;
+			info.pDepthStencilState = &depthStencil;
+			info.pColorBlendState = &colorBlend;
+			info.layout = fakeHandle<VkPipelineLayout>(3);
+			info.renderPass = fakeHandle<VkRenderPass>(4);
+		}
+
+		PipelineState(const PipelineState&) = delete;
+
+		// Entry points and dynamic states are pointed to late, so tests can change them first
+		const VkGraphicsPipelineCreateInfo& createInfo() {
+			stages[0].pName = vertexEntry.c_str();
+			stages[1].pName = fragmentEntry.c_str();
+			dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+			dynamicState.pDynamicStates = dynamicStates.data();
+			info.pDynamicState = dynamicStates.empty() ? nullptr : &dynamicState;
+			return info;
+		}
+	};
+
+	bool sameKey(PipelineState& a, PipelineState& b) {
+		return PipelineRegistry::stateKey(a.createInfo()) == PipelineRegistry::stateKey(b.createInfo());
+	}
+
+}
+
+
+TEST_CASE(PipelineRegistry, EqualStatesShareAKey) {
+	PipelineState a;
+	PipelineState b;
+	CHECK(sameKey(a, b));
+
+	// pNext chains are not part of the key
+	VkPipelineRasterizationStateCreateInfo chained = {};
+	b.rasterization.pNext = &chained;
+	b.info.pNext = &chained;
+	CHECK(sameKey(a, b));
+}
+
+TEST_CASE(PipelineRegistry, StateChangesSplitKeys) {
+	PipelineState a;
+	{
+		PipelineState b;
+		b.rasterization.cullMode = VK_CULL_MODE_NONE;
+		CHECK(!sameKey(a, b));
+	}
+	{
+		PipelineState b;
+		b.blendAttachment.blendEnable = VK_TRUE;
+		CHECK(!sameKey(a, b));
+	}
+	{
+		PipelineState b;
+		b.fragmentEntry = "alphaMask";
+		CHECK(!sameKey(a, b));
+	}
+	{
+		PipelineState b;
+		b.specializationValue = 2;
+		CHECK(!sameKey(a, b));
+	}
+	{
+		PipelineState b;
+		b.stages[1].module = fakeHandle<VkShaderModule>(5);
+		CHECK(!sameKey(a, b));
+	}
+	{
+		PipelineState b;
+		b.info.pDepthStencilState = nullptr;
+		CHECK(!sameKey(a, b));
+	}
+	{
+		PipelineState b;
+		b.info.renderPass = fakeHandle<VkRenderPass>(6);
+		CHECK(!sameKey(a, b));
+	}
+}
+
+TEST_CASE(PipelineRegistry, DynamicViewportsAreIgnored) {
+	PipelineState a;
+	PipelineState b;
+	b.viewport.width = 640.0f;
+	b.scissor.extent.width = 640;
+	CHECK(!sameKey(a, b));
+
+	a.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	b.dynamicStates = a.dynamicStates;
+	CHECK(sameKey(a, b));
+
+	// Only the dynamic part is ignored
+	b.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT };
+	a.dynamicStates = b.dynamicStates;
+	CHECK(!sameKey(a, b));
+}
@@ -0,0 +1,280 @@
+#include "Tests.h"
+#include "../include/NodeHierarchy.h"
+#include "../include/RenderQueue.h"
+#include "../include/SceneCache.h"
+#include "../include/SceneStreaming.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+	using namespace vkbase;
+
+	bool nearlyEqual(const glm::mat4& a, const glm::mat4& b) {
+		for (int column = 0; column < 4; column++) {
+			for (int row = 0; row < 4; row++) {
+				if (std::fabs(a[column][row] - b[column][row]) > 1e-5f) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool contains(const std::vector<uint32_t>& list, uint32_t value) {
+		return std::find(list.begin(), list.end(), value) != list.end();
+	}
+
+	// Scratch file next to the test binary, removed with the test
+	struct TemporaryFile {
+		std::string path;
+
+		explicit TemporaryFile(const std::string& name) : path(name) {
+			remove(path.c_str());
+		}
+
+		~TemporaryFile() {
+			remove(path.c_str());
+		}
+
+		bool write(const std::string& contents) const {
+			FILE* file = fopen(path.c_str(), "wb");
+			if (!file) {
+				return false;
+			}
+			bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+			return (fclose(file) == 0) && ok;
+		}
+	};
+
+}
+
+
+TEST_CASE(RenderQueue, KeysOrderPassesStateAndDepth) {
+	// Passes first, opaque draws by state and then front to back
+	CHECK(drawSortKey(RenderPass::Opaque, 5, 9, 100.0f) < drawSortKey(RenderPass::Masked, 0, 0, 0.0f));
+	CHECK(drawSortKey(RenderPass::Masked, 5, 9, 100.0f) < drawSortKey(RenderPass::Blended, 0, 0, 0.0f));
+	CHECK(drawSortKey(RenderPass::Opaque, 1, 9, 100.0f) < drawSortKey(RenderPass::Opaque, 2, 0, 0.0f));
+	CHECK(drawSortKey(RenderPass::Opaque, 1, 1, 100.0f) < drawSortKey(RenderPass::Opaque, 1, 2, 0.0f));
+	CHECK(drawSortKey(RenderPass::Opaque, 1, 1, 1.0f) < drawSortKey(RenderPass::Opaque, 1, 1, 2.0f));
+	// Blended draws back to front regardless of their state
+	CHECK(drawSortKey(RenderPass::Blended, 9, 9, 2.0f) < drawSortKey(RenderPass::Blended, 0, 0, 1.0f));
+	// Negative depths clamp to the front, indices beyond their bits to the last one
+	CHECK(drawSortKey(RenderPass::Opaque, 1, 1, -5.0f) == drawSortKey(RenderPass::Opaque, 1, 1, 0.0f));
+	CHECK(drawSortKey(RenderPass::Opaque, 0x4000, 1, 0.0f) == drawSortKey(RenderPass::Opaque, 0x3fff, 1, 0.0f));
+}
+
+TEST_CASE(RenderQueue, SortIsStableAndMatchesStdSort) {
+	std::mt19937_64 random(3);
+	RenderQueue queue;
+	std::vector<std::pair<uint64_t, uint32_t>> reference;
+	for (uint32_t i = 0; i < 5000; i++) {
+		// Few distinct low digits, so equal keys are common and every radix digit is used
+		uint64_t key = (random() & 0xffffffffff000000ull) | (random() % 4);
+		if (i % 3 == 0 && !reference.empty()) {
+			key = reference[random() % reference.size()].first;
+		}
+		queue.push(key, i);
+		reference.emplace_back(key, i);
+	}
+	queue.sort();
+	std::stable_sort(reference.begin(), reference.end(), [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) {
+		return a.first < b.first;
+	});
+
+	CHECK(queue.size() == reference.size());
+	bool same = true;
+	for (size_t i = 0; i < reference.size(); i++) {
+		same = same && queue.key(i) == reference[i].first && queue.item(i) == reference[i].second;
+	}
+	CHECK(same);
+
+	queue.clear();
+	queue.push(1, 7);
+	queue.sort();
+	CHECK(queue.size() == 1 && queue.item(0) == 7);
+}
+
+TEST_CASE(NodeHierarchy, WorldMatricesFollowParents) {
+	NodeHierarchy nodes;
+	uint32_t root = nodes.addNode(-1, "root");
+	uint32_t child = nodes.addNode(root, "child");
+	uint32_t grandchild = nodes.addNode(child, "grandchild");
+	uint32_t other = nodes.addNode(-1, "other");
+	// A parent that does not precede the node makes it a root
+	uint32_t orphan = nodes.addNode(7, "orphan");
+	CHECK(nodes.parent(orphan) == -1);
+
+	nodes.setTranslation(root, glm::vec3(1.0f, 0.0f, 0.0f));
+	nodes.setScale(child, glm::vec3(2.0f));
+	nodes.setRotation(grandchild, glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+	nodes.setTranslation(grandchild, glm::vec3(0.0f, 1.0f, 0.0f));
+	CHECK(nodes.updateWorldMatrices());
+	CHECK(!nodes.updateWorldMatrices());
+
+	glm::mat4 rootWorld = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	glm::mat4 childWorld = rootWorld * glm::scale(glm::mat4(1.0f), glm::vec3(2.0f));
+	glm::mat4 grandchildWorld = childWorld * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
+		glm::mat4(glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+	CHECK(nearlyEqual(nodes.worldMatrix(root), rootWorld));
+	CHECK(nearlyEqual(nodes.worldMatrix(child), childWorld));
+	CHECK(nearlyEqual(nodes.worldMatrix(grandchild), grandchildWorld));
+	CHECK(nearlyEqual(nodes.worldMatrix(other), glm::mat4(1.0f)));
+
+	// Moving the root moves its descendants, their local transforms stay
+	nodes.setTranslation(root, glm::vec3(0.0f, 0.0f, 3.0f));
+	CHECK(nodes.updateWorldMatrices());
+	glm::mat4 moved = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 3.0f));
+	CHECK(nearlyEqual(nodes.worldMatrix(grandchild), moved * glm::inverse(rootWorld) * grandchildWorld));
+	CHECK(nearlyEqual(nodes.worldMatrix(other), glm::mat4(1.0f)));
+
+	// The matrix applies after the TRS transform
+	nodes.setMatrix(other, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+	nodes.setScale(other, glm::vec3(3.0f));
+	nodes.updateWorldMatrices();
+	CHECK(nearlyEqual(nodes.worldMatrix(other), glm::scale(glm::mat4(1.0f), glm::vec3(3.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f))));
+}
+
+TEST_CASE(NodeHierarchy, HiddenNodesHideDescendants) {
+	NodeHierarchy nodes;
+	uint32_t root = nodes.addNode(-1, "root");
+	uint32_t child = nodes.addNode(root, "child");
+	uint32_t grandchild = nodes.addNode(child, "grandchild");
+	nodes.setMesh(grandchild, 4);
+	nodes.updateWorldMatrices();
+	CHECK(nodes.visible(grandchild));
+	CHECK(nodes.mesh(grandchild) == 4 && nodes.mesh(child) == -1);
+	CHECK(nodes.name(child) == "child");
+
+	nodes.setVisible(child, false);
+	CHECK(nodes.updateWorldMatrices());
+	CHECK(nodes.visible(root) && !nodes.visible(child) && !nodes.visible(grandchild));
+
+	nodes.setVisible(child, true);
+	nodes.setVisible(root, false);
+	nodes.updateWorldMatrices();
+	CHECK(!nodes.visible(root) && !nodes.visible(child) && !nodes.visible(grandchild));
+
+	nodes.clear();
+	CHECK(nodes.size() == 0);
+	CHECK(!nodes.updateWorldMatrices());
+}
+
+TEST_CASE(ChunkResidency, PartitionGroupsMeshesByCell) {
+	std::vector<glm::vec3> boundsMin = { glm::vec3(0.0f), glm::vec3(1.0f), glm::vec3(12.0f, 0.0f, 0.0f), glm::vec3(1.0f) };
+	std::vector<glm::vec3> boundsMax = { glm::vec3(2.0f), glm::vec3(3.0f), glm::vec3(14.0f, 2.0f, 2.0f), glm::vec3(0.0f) };
+	std::vector<StreamChunk> chunks = partitionScene(boundsMin, boundsMax, 10.0f);
+
+	// The empty bounds of mesh 3 are left out
+	CHECK(chunks.size() == 2);
+	if (chunks.size() == 2) {
+		CHECK(chunks[0].meshes == std::vector<uint32_t>({ 0, 1 }));
+		CHECK(chunks[1].meshes == std::vector<uint32_t>({ 2 }));
+		// The sphere covers the bounds of all of the chunk's meshes
+		CHECK(glm::length(glm::vec3(chunks[0].boundingSphere) - glm::vec3(1.5f)) < 1e-5f);
+		CHECK(std::fabs(chunks[0].boundingSphere.w - glm::length(glm::vec3(3.0f)) * 0.5f) < 1e-5f);
+	}
+}
+
+TEST_CASE(ChunkResidency, LoadsNearestFirstWithinBudget) {
+	// Four chunks of 100 bytes, chunks 0 and 1 share image 0
+	std::vector<StreamChunk> chunks(4);
+	for (StreamChunk& chunk : chunks) {
+		chunk.geometryBytes = 100;
+	}
+	chunks[0].images = { 0 };
+	chunks[1].images = { 0 };
+	chunks[3].images = { 1 };
+	ChunkResidency residency;
+	residency.reset(chunks, { 50, 50 }, 300);
+
+	std::vector<uint32_t> load, evict, loadImages, evictImages;
+	residency.plan({ 1.0f, 2.0f, 3.0f, 4.0f }, UINT64_MAX, load, evict, loadImages, evictImages);
+	// 100 + 50 + 100 fit, chunk 2 would exceed the budget
+	CHECK(load == std::vector<uint32_t>({ 0, 1 }));
+	CHECK(evict.empty() && evictImages.empty());
+	CHECK(loadImages == std::vector<uint32_t>({ 0 }));
+	CHECK(residency.state(0) == ChunkState::Loading);
+	CHECK(residency.stats().residentBytes == 250);
+	CHECK(residency.stats().loadingChunks == 2);
+
+	residency.finishLoads(load);
+	CHECK(residency.state(1) == ChunkState::Resident);
+	CHECK(residency.stats().residentChunks == 2 && residency.stats().residentImages == 1);
+
+	// The camera moves to chunk 3, the least recently wanted chunks make room for it
+	residency.plan({ 4.0f, 3.0f, 2.0f, 1.0f }, UINT64_MAX, load, evict, loadImages, evictImages);
+	CHECK(contains(load, 3));
+	CHECK(contains(loadImages, 1));
+	CHECK(!evict.empty());
+	CHECK(residency.stats().residentBytes <= 300);
+	for (uint32_t chunk : evict) {
+		CHECK(residency.state(chunk) == ChunkState::Evicted);
+	}
+}
+
+TEST_CASE(ChunkResidency, UploadLimitAndCancelledLoads) {
+	std::vector<StreamChunk> chunks(3);
+	for (StreamChunk& chunk : chunks) {
+		chunk.geometryBytes = 100;
+	}
+	ChunkResidency residency;
+	residency.reset(chunks, {}, 1000);
+
+	// At least one chunk is planned even if it exceeds the upload limit
+	std::vector<uint32_t> load, evict, loadImages, evictImages;
+	residency.plan({ 1.0f, 2.0f, 3.0f }, 10, load, evict, loadImages, evictImages);
+	CHECK(load == std::vector<uint32_t>({ 0 }));
+	CHECK(residency.stats().missingChunks == 2);
+
+	residency.cancelLoads(load);
+	CHECK(residency.state(0) == ChunkState::Evicted);
+	CHECK(residency.stats().residentBytes == 0);
+
+	residency.plan({ 1.0f, 2.0f, 3.0f }, 150, load, evict, loadImages, evictImages);
+	CHECK(load == std::vector<uint32_t>({ 0, 1 }));
+}
+
+TEST_CASE(SceneCache, RoundTrip) {
+	TemporaryFile source("vktiny_test_source.gltf");
+	TemporaryFile cacheFile("vktiny_test_source.gltf.vkcache");
+	CHECK(source.write("{ \"asset\": { \"version\": \"2.0\" } }"));
+
+	const uint64_t settingsHash = 0x1234;
+	std::vector<uint32_t> indices = { 0, 1, 2, 2, 1, 3 };
+	SceneCacheNode node = {};
+	node.parent = -1;
+	node.mesh = 0;
+	node.scale = glm::vec3(1.0f);
+
+	SceneCacheWriter writer;
+	CHECK(writer.addSource(source.path));
+	node.name = writer.addString("node");
+	writer.setSection(SceneCacheSection::Indices, indices);
+	writer.setSection(SceneCacheSection::Nodes, std::vector<SceneCacheNode>{ node });
+	CHECK(writer.write(cacheFile.path, settingsHash));
+
+	SceneCache cache;
+	CHECK(cache.open(cacheFile.path, settingsHash));
+	size_t count = 0;
+	const uint32_t* cachedIndices = cache.section<uint32_t>(SceneCacheSection::Indices, count);
+	CHECK(count == indices.size() && cachedIndices && std::equal(indices.begin(), indices.end(), cachedIndices));
+	const SceneCacheNode* cachedNodes = cache.section<SceneCacheNode>(SceneCacheSection::Nodes, count);
+	CHECK(count == 1 && cachedNodes && cache.string(cachedNodes[0].name) == "node");
+	CHECK(cache.section<uint32_t>(SceneCacheSection::Clusters, count) == nullptr && count == 0);
+	CHECK(cache.sourcePaths() == std::vector<std::string>({ source.path }));
+
+	// Other settings or a changed source make the cache stale
+	SceneCache stale;
+	CHECK(!stale.open(cacheFile.path, settingsHash + 1));
+	CHECK(source.write("{ \"asset\": { \"version\": \"2.0\" }, \"scene\": 0 }"));
+	CHECK(!stale.open(cacheFile.path, settingsHash));
+}
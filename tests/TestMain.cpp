@@ -0,0 +1,50 @@
+#include "Tests.h"
+
+#include <cstring>
+#include <exception>
+
+
+namespace vkbase {
+
+	namespace test {
+
+		std::vector<TestCase>& registry() {
+			static std::vector<TestCase> cases;
+			return cases;
+		}
+
+		int failures = 0;
+
+	}
+
+}
+
+// Runs every test, or only the tests of the group given as the first argument (one CTest test per group)
+int main(int argc, char** argv) {
+	const char* group = argc > 1 ? argv[1] : nullptr;
+	int failedTests = 0;
+	int ran = 0;
+	for (const vkbase::test::TestCase& testCase : vkbase::test::registry()) {
+		if (group && strcmp(group, testCase.group) != 0) {
+			continue;
+		}
+		vkbase::test::failures = 0;
+		try {
+			testCase.run();
+		}
+		catch (const std::exception& e) {
+			std::fprintf(stderr, "%s.%s: unexpected exception: %s\n", testCase.group, testCase.name, e.what());
+			vkbase::test::failures++;
+		}
+		std::printf("%s %s.%s\n", vkbase::test::failures == 0 ? "passed" : "FAILED", testCase.group, testCase.name);
+		failedTests += vkbase::test::failures == 0 ? 0 : 1;
+		ran++;
+	}
+
+	if (ran == 0) {
+		std::fprintf(stderr, "no tests in group %s\n", group ? group : "");
+		return 1;
+	}
+	std::printf("%d of %d tests failed\n", failedTests, ran);
+	return failedTests == 0 ? 0 : 1;
+}
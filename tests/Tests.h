@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+
+namespace vkbase {
+
+	// Minimal test harness, every TEST_CASE registers itself and CHECK counts the failures of the running test
+	namespace test {
+
+		struct TestCase {
+			const char* group;
+			const char* name;
+			void (*run)();
+		};
+
+		std::vector<TestCase>& registry();
+
+		extern int failures;
+
+		struct Registrar {
+			Registrar(const char* group, const char* name, void (*run)()) {
+				registry().push_back({ group, name, run });
+			}
+		};
+
+	}
+
+}
+
+#define TEST_CASE(group, name) \
+	static void group##_##name(); \
+	static vkbase::test::Registrar group##_##name##_registrar(#group, #name, group##_##name); \
+	static void group##_##name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			vkbase::test::failures++; \
+		} \
+	} while (0)
@@ -0,0 +1,84 @@
+#include "Tests.h"
+#include "../include/ThreadPool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+
+TEST_CASE(ThreadPool, ParallelForRunsEveryItemOnce) {
+	vkbase::ThreadPool pool(4);
+	std::vector<std::atomic<uint32_t>> runs(1000);
+	for (auto& count : runs) {
+		count = 0;
+	}
+	pool.parallelFor(runs.size(), [&](size_t i) {
+		runs[i]++;
+	});
+	bool once = true;
+	for (auto& count : runs) {
+		once = once && count == 1;
+	}
+	CHECK(once);
+
+	// Nested loops are run by the caller when no helper is free
+	std::atomic<uint32_t> nested{ 0 };
+	pool.parallelFor(8, [&](size_t) {
+		pool.parallelFor(8, [&](size_t) {
+			nested++;
+		});
+	});
+	CHECK(nested == 64);
+}
+
+TEST_CASE(ThreadPool, MaxThreadsLimitsConcurrency) {
+	vkbase::ThreadPool pool(4);
+	std::atomic<uint32_t> active{ 0 };
+	std::atomic<uint32_t> peak{ 0 };
+	pool.parallelFor(200, [&](size_t) {
+		uint32_t now = ++active;
+		uint32_t previous = peak;
+		while (now > previous && !peak.compare_exchange_weak(previous, now)) {
+		}
+		std::this_thread::yield();
+		active--;
+	}, 2);
+	CHECK(peak <= 2);
+}
+
+TEST_CASE(ThreadPool, ParallelForRethrowsOnTheCaller) {
+	vkbase::ThreadPool pool(4);
+	for (int attempt = 0; attempt < 50; attempt++) {
+		bool caught = false;
+		try {
+			pool.parallelFor(100, [&](size_t i) {
+				if (i % 10 == 3) {
+					throw std::runtime_error("item failed");
+				}
+			});
+		}
+		catch (const std::runtime_error&) {
+			caught = true;
+		}
+		CHECK(caught);
+	}
+
+	// The pool keeps working after the failures
+	std::atomic<uint32_t> count{ 0 };
+	pool.parallelFor(100, [&](size_t) {
+		count++;
+	});
+	CHECK(count == 100);
+}
+
+TEST_CASE(ThreadPool, WaitBlocksUntilJobsFinished) {
+	vkbase::ThreadPool pool(2);
+	std::atomic<uint32_t> done{ 0 };
+	for (int i = 0; i < 32; i++) {
+		pool.submit([&] {
+			done++;
+		});
+	}
+	pool.wait();
+	CHECK(done == 32);
+}